@@ -0,0 +1,373 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "batch_baker.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/scene/builder.hpp"
+#include "shared/scene/scene.hpp"
+#include "shared/sim/pod_model.hpp"
+#include "shared/sim/wind_atlas.hpp"
+#include "shared/utility/task_graph.hpp"
+#include "shared/utility/util.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <dlog/dlog.hpp>
+
+#include <Scene/BsSceneManager.h>
+#include <Scene/BsSceneObject.h>
+#include <Utility/BsTimer.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+// ========================================================================== //
+// BatchBaker Implementation
+// ========================================================================== //
+
+namespace wind {
+
+BatchBaker::BatchBaker(const Config &config)
+    : App([] {
+        Info info = makeInfo("Baker", 640, 480, 20);
+        info.hidden = true;
+        return info;
+      }()),
+      m_config(config) {}
+
+// -------------------------------------------------------------------------- //
+
+void BatchBaker::onStartup() {
+  MICROPROFILE_SCOPEI("BatchBaker", "onStartup", MP_ORANGE1);
+  bs::Timer timer;
+
+  // Load scenes and build their simulations, one at a time
+  std::vector<Job> jobs;
+  for (const String &path : m_config.scenes) {
+    Job job{path};
+    if (load(job)) {
+      job.scene->setActive(false);
+      jobs.push_back(job);
+    } else {
+      m_failedCount++;
+    }
+  }
+
+  // Run all simulations to a steady state concurrently. The steps of each
+  // simulation are themselves split into tasks on the same pool.
+  DLOG_INFO("[BATCH] solving {} simulations", jobs.size());
+  TaskGraph graph;
+  for (Job &job : jobs) {
+    graph.add([&job, this]() {
+      job.steadyState = job.csim->getSim()->solveSteadyState(
+          m_config.stepDelta, m_config.tolerance, m_config.maxSteps);
+    });
+  }
+  graph.run();
+
+  // Bake each scene with only its own colliders active
+  for (Job &job : jobs) {
+    job.scene->setActive(true);
+    if (!bake(job)) {
+      m_failedCount++;
+    }
+    job.scene->destroy();
+  }
+
+  DLOG_INFO("[BATCH] baked {} of {} scenes in {:.1f} s",
+            m_config.scenes.size() - m_failedCount, m_config.scenes.size(),
+            timer.getMilliseconds() / 1000.0f);
+  quit();
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BatchBaker::load(Job &job) {
+  if (!Util::fileExist(job.path)) {
+    DLOG_ERROR("[BATCH] scene {} does not exist", job.path);
+    return false;
+  }
+  job.scene = Scene::loadFile(job.path);
+
+  job.simObj = ObjectBuilder(ObjectType::kEmpty).withName("wind_sim").build();
+  job.simObj->setParent(job.scene);
+  job.csim = job.simObj->addComponent<CSim>();
+  const bs::SPtr<bs::SceneInstance> scene =
+      bs::SceneManager::instance().getMainScene();
+  if (m_config.autoFit) {
+    job.csim->buildAuto(CSim::AutoConfig{}, scene);
+  } else {
+    job.csim->build(m_config.dim, m_config.cellSize, scene);
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BatchBaker::bake(Job &job) {
+  MICROPROFILE_SCOPEI("BatchBaker", "bake", MP_ORANGE1);
+  if (!job.steadyState.converged) {
+    DLOG_WARNING("[BATCH] {} did not converge in {} steps (change {:.4f})",
+                 job.path, job.steadyState.steps, job.steadyState.change);
+  }
+
+  if (m_config.podSnapshots > 0 && !buildPod(job)) {
+    job.simObj->destroy(true);
+    return false;
+  }
+
+  Baker::Options options = m_config.bake;
+  options.debugSplines = false;
+  Baker::Report report;
+  if (m_config.tune) {
+    Baker::TuneOptions tuning = m_config.tuning;
+    tuning.base = options;
+    tuning.reportPath = tuneReportPath(m_config, job.path);
+    Baker::TuneReport tuneReport;
+    Baker::tune(job.simObj, "wind_baked", tuning, &tuneReport);
+    if (tuneReport.trials.empty()) {
+      DLOG_ERROR("[BATCH] {} has no parameters to tune", job.path);
+      job.simObj->destroy(true);
+      return false;
+    }
+    report = tuneReport.trials[tuneReport.chosen].report;
+    if (!tuneReport.targetMet) {
+      DLOG_WARNING("[BATCH] {} does not meet the target error {:.4f}",
+                   job.path, tuning.targetError);
+    }
+  } else {
+    Baker::bake(job.simObj, "wind_baked", options, &report);
+  }
+  DLOG_INFO("[BATCH] {}: {} steps, {} splines, error {:.4f}", job.path,
+            job.steadyState.steps, report.splineCount, report.error);
+
+  // The atlas is built last, as it replaces the steady state that is baked
+  const bool atlasBuilt = m_config.atlasDirections == 0 || buildAtlas(job);
+
+  // The simulation is not part of the baked scene
+  job.simObj->destroy(true);
+  if (!atlasBuilt) {
+    return false;
+  }
+  if (options.gridDownsample == 0 && report.splineCount == 0) {
+    DLOG_ERROR("[BATCH] {} has no wind to bake", job.path);
+    return false;
+  }
+
+  const String path = outputPath(m_config, job.path);
+  Scene::saveFile(path, job.scene);
+  DLOG_INFO("[BATCH] wrote {}", path);
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BatchBaker::buildPod(Job &job) {
+  MICROPROFILE_SCOPEI("BatchBaker", "buildPod", MP_ORANGE1);
+
+  // Snapshots are taken one step apart, starting from the steady state
+  WindSimulation &sim = *job.csim->getSim();
+  PodBuilder builder(sim.V().getDim(), sim.getCellSize());
+  builder.collect(sim, m_config.stepDelta, m_config.podSnapshots);
+  PodModel model;
+  const String path = podPath(m_config, job.path);
+  if (!builder.build(model, m_config.stepDelta) ||
+      !model.save(path.c_str())) {
+    DLOG_ERROR("[BATCH] failed to build a wind model for {}", job.path);
+    return false;
+  }
+  DLOG_INFO("[BATCH] wrote {} with {} modes", path, model.getModeCount());
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BatchBaker::buildAtlas(Job &job) {
+  MICROPROFILE_SCOPEI("BatchBaker", "buildAtlas", MP_ORANGE1);
+
+  WindAtlas atlas;
+  atlas.build(*job.csim->getSim(), m_config.atlasDirections,
+              m_config.atlasStrength, m_config.stepDelta);
+  const String path = atlasPath(m_config, job.path);
+  if (!atlas.save(path.c_str())) {
+    DLOG_ERROR("[BATCH] failed to write the wind atlas of {}", job.path);
+    return false;
+  }
+  DLOG_INFO("[BATCH] wrote {} with {} directions", path,
+            atlas.getEntryCount());
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BatchBaker::parseArgs(s32 argc, char **argv, Config &config) {
+  const auto usage = [&]() {
+    DLOG_RAW(
+        "usage: {} [options] <scene.json>...\n"
+        "  --out <dir>        directory to write baked scenes to\n"
+        "  --auto             fit the simulation to each scene\n"
+        "  --dim <x> <y> <z>  simulation size in cells (default 14 6 14)\n"
+        "  --cell-size <m>    simulation cell size (default 0.5)\n"
+        "  --max-steps <n>    steps towards a steady state (default {})\n"
+        "  --tolerance <v>    steady state tolerance (default {})\n"
+        "  --spacing <cells>  distance between bake seeds (default {})\n"
+        "  --simplify <m>     spline simplification tolerance\n"
+        "  --grid <n>         bake a voxel grid keeping every n-th cell\n"
+        "  --grid-bits <n>    block compress the grid with n bits per\n"
+        "                     component (default 16-bit samples)\n"
+        "  --tune             choose the cheapest spline parameters that meet\n"
+        "                     the target error\n"
+        "  --target <m/s>     target error when tuning (default {})\n"
+        "  --metric <name>    error to target, 'median' or 'p95' (default\n"
+        "                     p95)\n"
+        "  --pod <n>          also build a reduced-order wind model from n\n"
+        "                     snapshots\n"
+        "  --atlas <n>        also build a wind atlas with n directions\n"
+        "  --atlas-strength <m/s>\n"
+        "                     inflow strength of the atlas (default {})\n",
+        argc > 0 ? argv[0] : "baker", WindSimulation::kSteadyStateMaxSteps,
+        WindSimulation::kSteadyStateTolerance, config.bake.seedSpacing,
+        config.tuning.targetError, config.atlasStrength);
+    return false;
+  };
+
+  for (s32 i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const s32 left = argc - i - 1;
+    if (std::strcmp(arg, "--out") == 0 && left >= 1) {
+      config.outDir = argv[++i];
+    } else if (std::strcmp(arg, "--auto") == 0) {
+      config.autoFit = true;
+    } else if (std::strcmp(arg, "--dim") == 0 && left >= 3) {
+      config.dim.x = std::atoi(argv[++i]);
+      config.dim.y = std::atoi(argv[++i]);
+      config.dim.z = std::atoi(argv[++i]);
+    } else if (std::strcmp(arg, "--cell-size") == 0 && left >= 1) {
+      config.cellSize = f32(std::atof(argv[++i]));
+    } else if (std::strcmp(arg, "--max-steps") == 0 && left >= 1) {
+      config.maxSteps = u32(std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--tolerance") == 0 && left >= 1) {
+      config.tolerance = f32(std::atof(argv[++i]));
+    } else if (std::strcmp(arg, "--spacing") == 0 && left >= 1) {
+      config.bake.seedSpacing = f32(std::atof(argv[++i]));
+    } else if (std::strcmp(arg, "--simplify") == 0 && left >= 1) {
+      config.bake.simplifyTolerance = f32(std::atof(argv[++i]));
+    } else if (std::strcmp(arg, "--grid") == 0 && left >= 1) {
+      config.bake.gridDownsample = u32(std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--grid-bits") == 0 && left >= 1) {
+      config.bake.gridBits = u32(std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--pod") == 0 && left >= 1) {
+      config.podSnapshots = u32(std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--atlas") == 0 && left >= 1) {
+      config.atlasDirections = u32(std::atoi(argv[++i]));
+    } else if (std::strcmp(arg, "--atlas-strength") == 0 && left >= 1) {
+      config.atlasStrength = f32(std::atof(argv[++i]));
+    } else if (std::strcmp(arg, "--tune") == 0) {
+      config.tune = true;
+    } else if (std::strcmp(arg, "--target") == 0 && left >= 1) {
+      config.tuning.targetError = f32(std::atof(argv[++i]));
+    } else if (std::strcmp(arg, "--metric") == 0 && left >= 1) {
+      const char *metric = argv[++i];
+      if (std::strcmp(metric, "median") == 0) {
+        config.tuning.metric = Baker::ErrorMetric::kMedian;
+      } else if (std::strcmp(metric, "p95") == 0) {
+        config.tuning.metric = Baker::ErrorMetric::kPercentile95;
+      } else {
+        DLOG_ERROR("unknown error metric '{}'", metric);
+        return usage();
+      }
+    } else if (arg[0] == '-') {
+      DLOG_ERROR("unknown or incomplete option '{}'", arg);
+      return usage();
+    } else {
+      config.scenes.push_back(arg);
+    }
+  }
+
+  if (config.scenes.empty()) {
+    return usage();
+  }
+  if (config.dim.x <= 0 || config.dim.y <= 0 || config.dim.z <= 0 ||
+      config.cellSize <= 0.0f || config.bake.seedSpacing <= 0.0f) {
+    DLOG_ERROR("simulation size, cell size and seed spacing must be positive");
+    return false;
+  }
+  if (config.tune && config.bake.gridDownsample > 0) {
+    DLOG_ERROR("only spline bakes can be tuned");
+    return false;
+  }
+  if (config.tuning.targetError <= 0.0f) {
+    DLOG_ERROR("target error must be positive");
+    return false;
+  }
+  if (config.atlasStrength <= 0.0f) {
+    DLOG_ERROR("atlas strength must be positive");
+    return false;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+String BatchBaker::outputPath(const Config &config, const String &scene) {
+  const std::filesystem::path source = scene.c_str();
+  std::filesystem::path out;
+  if (config.outDir.empty()) {
+    out = source.parent_path() /
+          (source.stem().string() + "_baked" + source.extension().string());
+  } else {
+    out = std::filesystem::path(config.outDir.c_str()) / source.filename();
+  }
+  return out.string().c_str();
+}
+
+// -------------------------------------------------------------------------- //
+
+String BatchBaker::tuneReportPath(const Config &config, const String &scene) {
+  std::filesystem::path out = outputPath(config, scene).c_str();
+  out.replace_extension(".tune.csv");
+  return out.string().c_str();
+}
+
+// -------------------------------------------------------------------------- //
+
+String BatchBaker::podPath(const Config &config, const String &scene) {
+  std::filesystem::path out = outputPath(config, scene).c_str();
+  out.replace_extension(".pod");
+  return out.string().c_str();
+}
+
+// -------------------------------------------------------------------------- //
+
+String BatchBaker::atlasPath(const Config &config, const String &scene) {
+  std::filesystem::path out = outputPath(config, scene).c_str();
+  out.replace_extension(".atlas");
+  return out.string().c_str();
+}
+
+} // namespace wind
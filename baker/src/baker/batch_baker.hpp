@@ -0,0 +1,155 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/app.hpp"
+#include "shared/scene/component/csim.hpp"
+#include "shared/sim/bake.hpp"
+
+#include <vector>
+
+// ========================================================================== //
+// BatchBaker Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Application that bakes the wind of a list of scenes without a user
+/// interface, for use in content pipelines.
+///
+/// Each scene is loaded and gets a simulation built for it, with all other
+/// scenes deactivated so that their colliders do not obstruct it. The
+/// simulations of all scenes are then run to a steady state concurrently,
+/// after which each scene is baked and saved in turn. When tuning, the bake
+/// parameters of each scene are chosen by 'Baker::tune' and a report of the
+/// trials is written next to the baked scene. A reduced-order model of each
+/// scene can also be built from snapshots of its simulation and written next
+/// to the baked scene. The application quits once all scenes have been
+/// processed.
+class BatchBaker final : public App {
+public:
+  /// Configuration of a batch
+  struct Config {
+    /// Paths of the scenes to bake
+    std::vector<String> scenes;
+    /// Directory to write baked scenes to. If empty then each baked scene is
+    /// written next to its source with a '_baked' suffix.
+    String outDir;
+    /// Whether to fit the simulation to the bounds of each scene
+    bool autoFit = false;
+    /// Dimensions of the simulation in cells, when not fitted
+    Vec3I dim{14, 6, 14};
+    /// Size of a simulation cell (m), when not fitted
+    f32 cellSize = 0.5f;
+    /// Delta time of the steps towards a steady state
+    f32 stepDelta = 0.0167f;
+    /// Tolerance of the steady state
+    f32 tolerance = WindSimulation::kSteadyStateTolerance;
+    /// Largest number of steps towards a steady state
+    u32 maxSteps = WindSimulation::kSteadyStateMaxSteps;
+    /// Options for baking
+    Baker::Options bake;
+    /// Whether to tune the bake parameters of each scene
+    bool tune = false;
+    /// Options for tuning. The options that are not tuned are taken from
+    /// 'bake'.
+    Baker::TuneOptions tuning;
+    /// Number of snapshots to build a reduced-order model from, or zero to
+    /// not build a model
+    u32 podSnapshots = 0;
+    /// Number of wind directions to build a wind atlas for, or zero to not
+    /// build an atlas
+    u32 atlasDirections = 0;
+    /// Inflow strength that the wind atlas is built with
+    f32 atlasStrength = 1.0f;
+  };
+
+public:
+  /// Construct a batch baker
+  explicit BatchBaker(const Config &config);
+
+  /// \copydoc App::onStartup
+  void onStartup() override;
+
+  /// Returns the number of scenes that failed to bake
+  u32 getFailedCount() const { return m_failedCount; }
+
+  /// Parse the command line into a configuration. Returns false and logs the
+  /// usage if the command line is invalid.
+  static bool parseArgs(s32 argc, char **argv, Config &config);
+
+  /// Returns the path that the baked version of a scene is written to
+  static String outputPath(const Config &config, const String &scene);
+
+  /// Returns the path that the tuning report of a scene is written to
+  static String tuneReportPath(const Config &config, const String &scene);
+
+  /// Returns the path that the reduced-order model of a scene is written to
+  static String podPath(const Config &config, const String &scene);
+
+  /// Returns the path that the wind atlas of a scene is written to
+  static String atlasPath(const Config &config, const String &scene);
+
+private:
+  /// Scene that is being baked
+  struct Job {
+    /// Path of the scene
+    String path;
+    /// Root of the scene
+    bs::HSceneObject scene;
+    /// Simulation object of the scene
+    bs::HSceneObject simObj;
+    /// Simulation component of the scene
+    HCSim csim;
+    /// Result of running the simulation to a steady state
+    WindSimulation::SteadyState steadyState;
+  };
+
+  /// Load a scene and build its simulation. Returns false if the scene could
+  /// not be loaded.
+  bool load(Job &job);
+
+  /// Bake and save a scene whose simulation is in a steady state
+  bool bake(Job &job);
+
+  /// Build and save a reduced-order model of a scene from snapshots of its
+  /// simulation
+  bool buildPod(Job &job);
+
+  /// Build and save a wind atlas of a scene. This leaves the simulation in
+  /// the steady state of the last direction of the atlas.
+  bool buildAtlas(Job &job);
+
+private:
+  /// Configuration
+  Config m_config;
+  /// Number of scenes that failed
+  u32 m_failedCount = 0;
+};
+
+} // namespace wind
@@ -115,15 +115,6 @@ void Editor::onStartup() {
   // Setup debug variables
   DebugManager::setBool("debug_draw_delta_field", true);
   DebugManager::setBool("debug_draw_spline", true);
-
-  // Run N iterations
-#if 0
-  const HCSim csim = getCSim();
-  for (u32 i = 0; i < 250; i++) {
-    DebugManager::setBool(WindSimulation::kDebugVelocitySource, true);
-    csim->getSim()->step(0.0167);
-  }
-#endif
 }
 
 // -------------------------------------------------------------------------- //
@@ -219,15 +210,45 @@ void Editor::bake() {
   // Baker::bakeAll();
 
   const bs::HSceneObject oSim = m_scene->findChild("wind_sim");
-  const bs::HSceneObject oBaked = Baker::bake(oSim, "wind_baked");
   const HCSim cSim = oSim->getComponent<CSim>();
-  const HCWind cWind = oBaked->getComponent<CWind>();
+
+  // Bake from the steady state of the simulation
+  cSim->getSim()->solveSteadyState(kBakeStepDelta);
+
+  // Show the traced streamlines in the editor
+  Baker::Options options;
+  options.debugSplines = true;
+  m_baked = Baker::bake(oSim, "wind_baked", options, nullptr, &m_bakeState);
+  const HCWind cWind = m_baked->getComponent<CWind>();
 
   m_deltaField.build(cSim, cWind);
 }
 
 // -------------------------------------------------------------------------- //
 
+void Editor::rebake() {
+  if (m_baked == nullptr || m_baked.isDestroyed()) {
+    bake();
+    return;
+  }
+
+  const bs::HSceneObject oSim = m_scene->findChild("wind_sim");
+  const HCSim cSim = oSim->getComponent<CSim>();
+
+  // Debug splines are only shown for full bakes, the objects of the splines
+  // that a re-bake replaces are not tracked and would pile up
+  Baker::Options options;
+  options.debugSplines = false;
+  if (!Baker::rebake(oSim, m_baked, m_bakeState, kBakeStepDelta, options)) {
+    DLOG_WARNING("re-baking failed, baking from scratch");
+    bake();
+    return;
+  }
+  m_deltaField.build(cSim, m_baked->getComponent<CWind>());
+}
+
+// -------------------------------------------------------------------------- //
+
 void Editor::registerControls() {
   using namespace bs;
 
@@ -28,6 +28,7 @@
 
 #include "shared/app.hpp"
 #include "shared/scene/component/csim.hpp"
+#include "shared/sim/bake.hpp"
 #include "shared/sim/delta.hpp"
 
 #include <Renderer/BsCamera.h>
@@ -63,9 +64,14 @@ public:
   /// \copydoc App::onPaint
   void onPaint(Painter &painter) override;
 
-  /// Bake wind simulations
+  /// Bake wind simulations. The simulation is first stepped until it reaches
+  /// a steady state.
   void bake();
 
+  /// Re-bake the parts of the last bake that are affected by changes to the
+  /// scene since it was baked. Bakes from scratch if nothing has been baked.
+  void rebake();
+
   /// Returns the root scene
   const bs::HSceneObject &getSceneRoot() { return m_root; }
 
@@ -106,6 +112,11 @@ private:
   /// Delta field
   DeltaField m_deltaField;
 
+  /// Last baked wind object
+  bs::HSceneObject m_baked;
+  /// State of the simulation when 'm_baked' was last baked
+  Baker::BakeState m_bakeState;
+
 public:
   /// Name of the default scene
   static constexpr char kDefaultSceneName[] = "res/scenes/world.json";
@@ -117,6 +128,9 @@ public:
 
   /// Scale of the ground plane
   static constexpr f32 kGroundPlaneScale = 7.0f;
+
+  /// Delta time used to step the simulation to a steady state before baking
+  static constexpr f32 kBakeStepDelta = 0.0167f;
 };
 
 } // namespace wind
@@ -456,6 +456,11 @@ UI::UI(Editor *editor) : m_editor(editor) {
     btn->setWidth(70);
     btn->setPosition(120, height);
     btn->onClick.connect([this]() { m_editor->bake(); });
+
+    GUIButton *rebakeBtn = panel->addNewElement<GUIButton>(HString("Re-bake"));
+    rebakeBtn->setWidth(70);
+    rebakeBtn->setPosition(194, height);
+    rebakeBtn->onClick.connect([this]() { m_editor->rebake(); });
     height += btn->getBounds().height + 2;
   }
 
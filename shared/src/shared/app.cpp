@@ -104,7 +104,8 @@ App *App::g_app = nullptr;
 
 App::App(const Info &info)
     : m_title(info.title), m_width(info.width), m_height(info.height),
-      m_tps(info.tps), m_widthPreFullscreen(info.width),
+      m_tps(info.tps), m_hidden(info.hidden),
+      m_widthPreFullscreen(info.width),
       m_heightPreFullscreen(info.height) {
   using namespace bs;
 
@@ -144,7 +145,9 @@ void App::run() {
 
   onStartup();
 
-  show();
+  if (!m_hidden) {
+    show();
+  }
   Application::instance().runMainLoop();
   Application::shutDown();
 }
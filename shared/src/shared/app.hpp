@@ -52,6 +52,8 @@ public:
     u32 height = 720;
     /// Ticks per second
     u32 tps = 20;
+    /// Whether the window is kept hidden, for tools without a user interface
+    bool hidden = false;
   };
 
   /* Video mode */
@@ -147,6 +149,8 @@ protected:
 
   /// TPS
   u32 m_tps;
+  /// Whether the window is kept hidden
+  bool m_hidden;
   /// Number of updates to skip
   u32 m_tpsSkip = 0;
 
@@ -216,6 +216,12 @@ public:
   virtual void paintT(Painter &painter, const Vec3F &offset = Vec3F(0, 0, 0),
                       const Vec3F &padding = Vec3F(0, 0, 0)) const = 0;
 
+  /// Returns a pointer to the linearly laid out data of the field
+  T *data() { return m_data; }
+
+  /// Returns a pointer to the linearly laid out data of the field
+  const T *data() const { return m_data; }
+
   /* Returns the reference to a vector in the vector field */
   T &get(u32 offset) {
     assert(offset < m_cellCount && "Offset cannot lie outside of field data");
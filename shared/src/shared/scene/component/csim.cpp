@@ -28,6 +28,90 @@
 
 #include "shared/debug/debug_manager.hpp"
 #include "shared/scene/builder.hpp"
+#include "shared/scene/component/cwind.hpp"
+#include "shared/scene/component/cwind_affectable.hpp"
+#include "shared/utility/bsprinter.hpp"
+#include "shared/wind/wind_system.hpp"
+
+#include <dlog/dlog.hpp>
+
+#include <Components/BsCCollider.h>
+#include <Components/BsCRenderable.h>
+#include <Components/BsCRigidbody.h>
+#include <Utility/BsTimer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// ========================================================================== //
+// Functions
+// ========================================================================== //
+
+namespace wind {
+
+/// Returns the bounds of all active colliders and wind volumes in the scene
+static bool csimSceneBounds(const bs::SPtr<bs::SceneInstance> &scene,
+                            Vec3F &min, Vec3F &max) {
+  bool found = false;
+  const auto grow = [&](const Vec3F &bMin, const Vec3F &bMax) {
+    min = found ? Vec3F::min(min, bMin) : bMin;
+    max = found ? Vec3F::max(max, bMax) : bMax;
+    found = true;
+  };
+
+  std::vector<bs::HSceneObject> objects{scene->getRoot()};
+  while (!objects.empty()) {
+    const bs::HSceneObject object = objects.back();
+    objects.pop_back();
+    if (!object->getActive()) {
+      continue;
+    }
+    for (u32 i = 0; i < object->getNumChildren(); i++) {
+      objects.push_back(object->getChild(i));
+    }
+
+    // Colliders, using the bounds of the renderable on the same object
+    const bs::HRenderable renderable =
+        object->getComponent<bs::CRenderable>();
+    if (renderable && object->getComponent<bs::CCollider>()) {
+      const bs::AABox box = renderable->getBounds().getBox();
+      grow(box.getMin(), box.getMax());
+    }
+
+    // Wind volumes
+    if (const HCWind wind = object->getComponent<CWind>()) {
+      const Vec3F halfScale = wind->getScale() / 2.0f;
+      grow(wind->getPos() - halfScale, wind->getPos() + halfScale);
+    }
+  }
+
+  return found;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the median cost (ms) of stepping a simulation of the specified
+/// extent and cell size
+static f32 csimMeasureStep(const Vec3I &extent, f32 cellSize, u32 steps) {
+  WindSimulation sim(extent.x, extent.y, extent.z, cellSize);
+  const f32 delta = bs::gTime().getFixedFrameDelta();
+
+  // Warm up caches and the task pool before timing
+  sim.step(delta);
+
+  std::vector<f32> costs;
+  bs::Timer timer;
+  for (u32 i = 0; i < steps; i++) {
+    timer.reset();
+    sim.step(delta);
+    costs.push_back(timer.getMicroseconds() / 1000.0f);
+  }
+  std::sort(costs.begin(), costs.end());
+  return costs[costs.size() / 2];
+}
+
+} // namespace wind
 
 // ========================================================================== //
 // CSpline Implementation
@@ -39,6 +123,15 @@ CSim::CSim(const bs::HSceneObject &parent) : CPaint(parent) {}
 
 // -------------------------------------------------------------------------- //
 
+CSim::~CSim() {
+  setLiveWind(false);
+  setPodModel("");
+  setWindAtlas("");
+  delete m_sim;
+}
+
+// -------------------------------------------------------------------------- //
+
 void CSim::build(s32 width, s32 height, s32 depth, f32 cellSize,
                  const bs::SPtr<bs::SceneInstance> &scene) {
   bs::SPtr<bs::SceneInstance> _scene = scene;
@@ -46,8 +139,85 @@ void CSim::build(s32 width, s32 height, s32 depth, f32 cellSize,
     _scene = bs::SceneManager::instance().getMainScene();
   }
 
+  m_origin = Vec3F::ZERO;
+  if (m_pod) {
+    m_pod->setOrigin(m_origin);
+  }
+  if (m_atlas) {
+    m_atlas->setOrigin(m_origin);
+  }
+  // The history steps the simulation and is rebuilt with the snapshots below
+  m_history = nullptr;
+  delete m_sim;
   m_sim = new WindSimulation(width, height, depth, cellSize);
+  m_densityView = false;
   m_sim->buildForScene(_scene);
+
+  // Snapshots must match the new simulation
+  if (m_snapshots) {
+    setLiveWind(false);
+    setLiveWind(true);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool CSim::buildAuto(const AutoConfig &config,
+                     const bs::SPtr<bs::SceneInstance> &scene) {
+  bs::SPtr<bs::SceneInstance> _scene = scene;
+  if (!scene) {
+    _scene = bs::SceneManager::instance().getMainScene();
+  }
+
+  // Fit domain to the scene
+  Vec3F min{-1.0f, -1.0f, -1.0f};
+  Vec3F max{1.0f, 1.0f, 1.0f};
+  if (!csimSceneBounds(_scene, min, max)) {
+    DLOG_WARNING("no colliders or wind volumes to fit simulation to");
+  }
+  min -= Vec3F::ONE * config.margin;
+  max += Vec3F::ONE * config.margin;
+  const Vec3I extent{s32(std::ceil(max.x - min.x)),
+                     s32(std::ceil(max.y - min.y)),
+                     s32(std::ceil(max.z - min.z))};
+
+  // Pick the finest cell size that fits the budget. Cell sizes must be 1/n
+  // for the domain to have a whole number of cells per meter.
+  const u32 steps = config.calibrationSteps > 0 ? config.calibrationSteps : 1;
+  f32 cellSize = 1.0f;
+  bool fits = false;
+  for (u32 n = 1; 1.0f / n >= config.minCellSize; n++) {
+    const f32 cost = csimMeasureStep(extent, 1.0f / n, steps);
+    DLOG_VERBOSE("simulation {}x{}x{} with cell size {}: {} ms per step",
+                 extent.x, extent.y, extent.z, 1.0f / n, cost);
+    if (cost > config.budgetMs) {
+      break;
+    }
+    cellSize = 1.0f / n;
+    fits = true;
+  }
+  DLOG_INFO("fitted simulation {}x{}x{} at {} with cell size {}", extent.x,
+            extent.y, extent.z, min, cellSize);
+
+  m_origin = min;
+  if (m_pod) {
+    m_pod->setOrigin(m_origin);
+  }
+  if (m_atlas) {
+    m_atlas->setOrigin(m_origin);
+  }
+  m_history = nullptr;
+  delete m_sim;
+  m_sim = new WindSimulation(extent.x, extent.y, extent.z, cellSize);
+  m_sim->buildForScene(_scene, m_origin);
+  m_densityView = false;
+
+  // Snapshots must match the new simulation
+  if (m_snapshots) {
+    setLiveWind(false);
+    setLiveWind(true);
+  }
+  return fits;
 }
 
 // -------------------------------------------------------------------------- //
@@ -58,15 +228,184 @@ bs::HSceneObject CSim::bake() {
 
 // -------------------------------------------------------------------------- //
 
-void CSim::paint(Painter &painter) { m_sim->paint(painter); }
+void CSim::setCheckpointing(const std::string &path, f32 interval) {
+  m_checkpointPath = path;
+  m_checkpointInterval = interval;
+  m_checkpointTime = 0.0f;
+  if (interval > 0.0f && !m_checkpointWriter) {
+    m_checkpointWriter = bs::bs_shared_ptr_new<CheckpointWriter>();
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool CSim::restoreCheckpoint(const std::string &path) {
+  return Checkpoint::load(*m_sim, path);
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::setLiveWind(bool enabled) {
+  if (enabled && !m_snapshots) {
+    m_snapshots = bs::bs_shared_ptr_new<WindSnapshots>(m_sim->V().getDim(),
+                                                       m_sim->getCellSize());
+    m_snapshots->publish(m_sim->V(), m_origin);
+    setLiveStepDelta(m_liveStepDelta);
+    gWindSystem().setSimSource(m_snapshots.get());
+  } else if (!enabled && m_snapshots) {
+    if (gWindSystem().getSimSource() == m_snapshots.get()) {
+      gWindSystem().setSimSource(nullptr);
+    }
+    m_history = nullptr;
+    m_snapshots = nullptr;
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::setLiveStepDelta(f32 delta) {
+  m_liveStepDelta = maxValue(delta, 0.0f);
+  m_history = nullptr;
+  if (m_snapshots && m_liveStepDelta > 0.0f) {
+    m_history = bs::bs_shared_ptr_new<WindHistory>(
+        m_sim, m_snapshots.get(), m_origin, m_liveStepDelta);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool CSim::setPodModel(const std::string &path) {
+  if (m_pod && gWindSystem().getPodSource() == m_pod.get()) {
+    gWindSystem().setPodSource(nullptr);
+  }
+  m_pod = nullptr;
+  if (path.empty()) {
+    return true;
+  }
+
+  const bs::SPtr<PodModel> pod = bs::bs_shared_ptr_new<PodModel>();
+  if (!pod->load(path)) {
+    return false;
+  }
+  pod->setOrigin(m_origin);
+  m_pod = pod;
+  gWindSystem().setPodSource(m_pod.get());
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool CSim::setWindAtlas(const std::string &path) {
+  if (m_atlas && gWindSystem().getAtlasSource() == m_atlas.get()) {
+    gWindSystem().setAtlasSource(nullptr);
+  }
+  m_atlas = nullptr;
+  if (path.empty()) {
+    return true;
+  }
+
+  const bs::SPtr<WindAtlas> atlas = bs::bs_shared_ptr_new<WindAtlas>();
+  if (!atlas->load(path)) {
+    return false;
+  }
+  atlas->setOrigin(m_origin);
+  m_atlas = atlas;
+  gWindSystem().setAtlasSource(m_atlas.get());
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::setAtlasWind(const Vec3F &direction, f32 strength) {
+  if (m_atlas) {
+    m_atlas->setWind(direction, strength);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::setBodyCoupling(bool enabled) {
+  m_bodyCoupling = enabled;
+  if (!enabled) {
+    m_sim->setBodies({});
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::paint(Painter &painter) {
+  updateDensityView();
+  m_sim->paint(painter, m_origin);
+}
 
 // -------------------------------------------------------------------------- //
 
 void CSim::fixedUpdate() {
+  updateDensityView();
+
+  // The reduced-order model replaces the simulation while it is played back
+  if (m_pod) {
+    m_pod->update(bs::gTime().getFixedFrameDelta());
+    return;
+  }
+
   if (DebugManager::getBool(WindSimulation::kDebugRun)) {
     const f32 delta = bs::gTime().getFixedFrameDelta();
-    m_sim->step(delta);
+    if (m_bodyCoupling) {
+      gatherBodies();
+    }
+    if (m_history) {
+      m_history->update(delta);
+    } else {
+      m_sim->step(delta);
+      if (m_snapshots) {
+        m_snapshots->publish(m_sim->V(), m_origin);
+      }
+    }
+
+    // Periodic checkpoint. Skipped if the previous one is still being written
+    m_checkpointTime += delta;
+    if (m_checkpointInterval > 0.0f &&
+        m_checkpointTime >= m_checkpointInterval &&
+        m_checkpointWriter->write(*m_sim, m_checkpointPath)) {
+      m_checkpointTime = 0.0f;
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::gatherBodies() {
+  std::vector<WindSimulation::Body> bodies;
+  for (const bs::GameObjectHandle<CWindAffectable> &affectable :
+       bs::gSceneManager().findComponents<CWindAffectable>()) {
+    const bs::HSceneObject so = affectable->SO();
+    const bs::HRigidbody rigid = so->getComponent<bs::CRigidbody>();
+    const bs::HRenderable renderable = so->getComponent<bs::CRenderable>();
+    if (!rigid || !renderable) {
+      continue;
+    }
+    const bs::AABox box = renderable->getBounds().getBox();
+    bodies.push_back(WindSimulation::Body{box.getMin() - m_origin,
+                                          box.getMax() - m_origin,
+                                          rigid->getVelocity()});
+  }
+  m_sim->setBodies(std::move(bodies));
+}
+
+// -------------------------------------------------------------------------- //
+
+void CSim::updateDensityView() {
+  const bool shown =
+      DebugManager::getBool(WindSimulation::kDebugPaintKey) &&
+      DebugManager::getS32(WindSimulation::kDebugFieldTypeKey) ==
+          s32(WindSimulation::FieldKind::kDens);
+  if (shown && !m_densityView) {
+    m_sim->addDensityConsumer();
+  } else if (!shown && m_densityView) {
+    m_sim->removeDensityConsumer();
   }
+  m_densityView = shown;
 }
 
 // -------------------------------------------------------------------------- //
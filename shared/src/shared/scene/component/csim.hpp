@@ -29,7 +29,12 @@
 #include "shared/math/math.hpp"
 #include "shared/scene/component/cpaint.hpp"
 #include "shared/scene/rtti.hpp"
+#include "shared/sim/checkpoint.hpp"
+#include "shared/sim/pod_model.hpp"
+#include "shared/sim/wind_atlas.hpp"
+#include "shared/sim/wind_history.hpp"
 #include "shared/sim/wind_sim.hpp"
+#include "shared/sim/wind_snapshots.hpp"
 
 #include <Reflection/BsRTTIType.h>
 #include <Scene/BsComponent.h>
@@ -45,6 +50,19 @@ namespace wind {
 class CSim : public CPaint {
   friend class CTagRTTI;
 
+public:
+  /// Configuration used when automatically building the simulation
+  struct AutoConfig {
+    /// Margin around the bounds of the scene (m)
+    f32 margin = 2.0f;
+    /// Target cost of a single simulation step (ms)
+    f32 budgetMs = 4.0f;
+    /// Smallest cell size to consider (m)
+    f32 minCellSize = 0.125f;
+    /// Number of steps that are timed for each cell size
+    u32 calibrationSteps = 5;
+  };
+
 public:
   /// Construct simulation component.
   CSim() = default;
@@ -52,6 +70,9 @@ public:
   /// Construct a simulation component.
   explicit CSim(const bs::HSceneObject &parent);
 
+  /// Destruct simulation component
+  ~CSim() override;
+
   /// Build the simualation for a specific scene. Nullptr can be passed to build
   /// for default scene.
   void build(s32 width, s32 height, s32 depth, f32 cellSize = 1.0f,
@@ -64,6 +85,19 @@ public:
     build(dim.x, dim.y, dim.z, cellSize, scene);
   }
 
+  /// Build the simulation for a specific scene, with a domain that is fitted
+  /// to the bounds of the colliders and wind volumes of the scene plus a
+  /// margin. Cell sizes of 1/n meters are timed from coarse to fine with a
+  /// short calibration run and the finest one that fits the budget is used.
+  /// Nullptr can be passed to build for default scene.
+  /// \return True if a cell size fits the budget, otherwise the coarsest cell
+  /// size is used and false is returned.
+  bool buildAuto(const AutoConfig &config = AutoConfig(),
+                 const bs::SPtr<bs::SceneInstance> &scene = nullptr);
+
+  /// Returns the world position of the minimum corner of the simulation domain
+  const Vec3F &getOrigin() const { return m_origin; }
+
   /// Bake the simulation out into an object that represents the individual
   /// objects generated.
   bs::HSceneObject bake();
@@ -71,6 +105,61 @@ public:
   /// Returns a pointer to the simulation object.
   WindSimulation *getSim() const { return m_sim; }
 
+  /// Write a checkpoint of the simulation to the file at 'path' every
+  /// 'interval' seconds of simulated time while it is running. Checkpoints
+  /// are written from a background thread. An interval of zero disables
+  /// checkpoints.
+  void setCheckpointing(const std::string &path, f32 interval);
+
+  /// Restore the simulation from a checkpoint file.
+  /// \pre Simulation must have been built with the same dimensions.
+  bool restoreCheckpoint(const std::string &path);
+
+  /// Set whether the velocity of the simulation is published to the wind
+  /// system after each step, so that 'WindSystem::getWindAtPoint' samples the
+  /// live simulation in addition to the wind volumes.
+  void setLiveWind(bool enabled);
+
+  /// Returns whether the velocity of the simulation is published
+  bool isLiveWind() const { return m_snapshots != nullptr; }
+
+  /// Set the delta that the simulation is stepped with while live wind is
+  /// enabled, independent of the fixed update rate. The wind system then
+  /// samples the live wind between the last two steps in time, see
+  /// 'WindHistory'. Zero steps the simulation once per fixed update.
+  void setLiveStepDelta(f32 delta);
+
+  /// Returns the delta that the simulation is stepped with while live wind is
+  /// enabled, or zero if it is stepped once per fixed update
+  f32 getLiveStepDelta() const { return m_liveStepDelta; }
+
+  /// Play back a reduced-order model instead of stepping the simulation. The
+  /// model is placed at the origin of the simulation and is sampled by the
+  /// wind system. An empty path stops the playback.
+  /// \return True if the model was loaded or the playback was stopped.
+  bool setPodModel(const std::string &path);
+
+  /// Returns the reduced-order model that is played back, if any
+  const PodModel *getPodModel() const { return m_pod.get(); }
+
+  /// Load a wind atlas that is placed at the origin of the simulation and
+  /// sampled by the wind system. An empty path removes the atlas.
+  /// \return True if the atlas was loaded or removed.
+  bool setWindAtlas(const std::string &path);
+
+  /// Set the global wind that the entries of the wind atlas are blended for
+  void setAtlasWind(const Vec3F &direction, f32 strength);
+
+  /// Returns the wind atlas, if any
+  const WindAtlas *getWindAtlas() const { return m_atlas.get(); }
+
+  /// Set whether rigid bodies with a 'CWindAffectable' component are splatted
+  /// into the simulation before each step, so that they disturb the wind.
+  void setBodyCoupling(bool enabled);
+
+  /// Returns whether rigid bodies are splatted into the simulation
+  bool isBodyCoupling() const { return m_bodyCoupling; }
+
   /// Paint simulation
   void paint(Painter &painter) override;
 
@@ -84,9 +173,43 @@ public:
   /// \copydoc bs::IReflectable::getRTTI
   bs::RTTITypeBase *getRTTI() const override { return getRTTIStatic(); }
 
+private:
+  /// Gather the bounds and velocity of the coupled rigid bodies
+  void gatherBodies();
+
+  /// Register the density debug view as a consumer of the density field of
+  /// the simulation while it is shown, and unregister it when it is not
+  void updateDensityView();
+
 private:
   /// Simulation
   WindSimulation *m_sim = nullptr;
+  /// World position of the minimum corner of the simulation domain
+  Vec3F m_origin = Vec3F::ZERO;
+
+  /// Whether the density debug view is registered as a density consumer
+  bool m_densityView = false;
+  /// Whether rigid bodies are splatted into the simulation
+  bool m_bodyCoupling = false;
+  /// Published velocity snapshots, when live wind is enabled
+  bs::SPtr<WindSnapshots> m_snapshots;
+  /// Step delta of the simulation while live wind is enabled, or zero
+  f32 m_liveStepDelta = 0.0f;
+  /// Steps the simulation at 'm_liveStepDelta', when live wind is enabled
+  bs::SPtr<WindHistory> m_history;
+  /// Reduced-order model that is played back, if any
+  bs::SPtr<PodModel> m_pod;
+  /// Wind atlas, if any
+  bs::SPtr<WindAtlas> m_atlas;
+
+  /// Writer of periodic checkpoints
+  bs::SPtr<CheckpointWriter> m_checkpointWriter;
+  /// Path to write periodic checkpoints to
+  std::string m_checkpointPath;
+  /// Simulated time between periodic checkpoints
+  f32 m_checkpointInterval = 0.0f;
+  /// Simulated time since the last periodic checkpoint
+  f32 m_checkpointTime = 0.0f;
 };
 
 // -------------------------------------------------------------------------- //
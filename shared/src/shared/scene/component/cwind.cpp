@@ -125,7 +125,7 @@ Vec3F CWind::getWindAtPoint(Vec3F point) const {
   const auto origo = SO()->getTransform().pos();
   point = point - origo;
   Vec3F wind = Vec3F::ZERO;
-  for (auto fn : m_functions) {
+  for (const auto &fn : m_functions) {
     wind += fn(point);
   }
   bs::Transform t = SO()->getTransform();
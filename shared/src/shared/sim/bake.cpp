@@ -30,11 +30,18 @@
 #include "shared/scene/builder.hpp"
 #include "shared/scene/component/csim.hpp"
 #include "shared/scene/component/cwind.hpp"
+#include "shared/sim/delta.hpp"
 #include "shared/sim/vector_field.hpp"
 #include "shared/sim/wind_sim.hpp"
 #include "shared/utility/bsprinter.hpp"
+#include "shared/utility/task_graph.hpp"
+#include "thirdparty/dutil/file.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <random>
+#include <utility>
 #include <vector>
 
 #include <dlog/dlog.hpp>
@@ -43,6 +50,7 @@
 
 #include <Physics/BsPhysics.h>
 #include <Scene/BsSceneManager.h>
+#include <Utility/BsTimer.h>
 
 // ========================================================================== //
 // Functions
@@ -64,11 +72,27 @@ static bool bakerIsInside(Vec3F p, Vec3F min, Vec3F max) {
 
 // -------------------------------------------------------------------------- //
 
+/// Number of seeds that are traced by each baking task
+static constexpr u32 kBakerSeedsPerTask = 16;
+
+// -------------------------------------------------------------------------- //
+
+/// Streamline traced from a single seed
+struct BakerTrace {
+  std::vector<Vec3F> points;
+  std::vector<f32> forces;
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Trace a streamline from 'startPos'. Points are in simulation space, which
+/// is offset by 'origin' from the physics scene. This only reads the wind and
+/// the physics scene, so that seeds can be traced concurrently.
 static void bakerBakeAux(std::vector<Vec3F> &points, std::vector<f32> &forces,
-                         const VectorField &wind, Vec3F startPos) {
+                         const VectorField &wind,
+                         const bs::PhysicsScene &physicsScene,
+                         const Vec3F &origin, Vec3F startPos, u32 maxSteps) {
   const Vec3F dimM = wind.getDimM();
-  const bs::SPtr<bs::PhysicsScene> &physicsScene =
-      bs::gSceneManager().getMainScene()->getPhysicsScene();
 
   if (!bakerIsInside(startPos, Vec3F::ZERO, dimM)) {
     DLOG_ERROR("cannot bake at point {}, not inside wind simlation {}",
@@ -79,10 +103,9 @@ static void bakerBakeAux(std::vector<Vec3F> &points, std::vector<f32> &forces,
   Vec3F point = startPos;
   points.push_back(point);
 
-  constexpr u32 kMaxSteps = 100;
   bool useCollisionSample = false;
   Vec3F collisionSample{};
-  for (u32 i = 0; i < kMaxSteps; i++) {
+  for (u32 i = 0; i < maxSteps; i++) {
     const auto oldPoint = point;
     const Vec3F force =
         !useCollisionSample ? wind.sampleNear(point) : collisionSample;
@@ -101,11 +124,12 @@ static void bakerBakeAux(std::vector<Vec3F> &points, std::vector<f32> &forces,
     Vec3F dir = (point - oldPoint);
     dir.normalize();
     const f32 len = distance(point, oldPoint);
-    if (physicsScene->rayCast(oldPoint, dir, hit,
-                              WindSystem::kWindOccluderLayer, len)) {
+    if (physicsScene.rayCast(oldPoint + origin, dir, hit,
+                             WindSystem::kWindOccluderLayer, len)) {
+      const Vec3F hitPoint = hit.point - origin;
       useCollisionSample = true;
-      collisionSample = wind.sampleNear(hit.point);
-      point = hit.point - (dir * 0.01f);
+      collisionSample = wind.sampleNear(hitPoint);
+      point = hitPoint - (dir * 0.01f);
     }
 
     points.push_back(point);
@@ -132,23 +156,576 @@ static void bakerBakeAux(std::vector<Vec3F> &points, std::vector<f32> &forces,
     // DLOG_INFO("points {}, forces {}", points.size(), forces.size());
     AlfAssert(points.size() == forces.size(),
               "points and forces are not same size");
-
-    constexpr f32 kPi = 3.141592f;
-    const f32 k = (kPi * 8.0f) / ((dimM.x + dimM.y + dimM.z) / 3.0f);
-    const Vec4F color{std::cos(k * startPos.x) / 2.0f + 0.5f,
-                      std::cos(k * startPos.y) / 2.0f + 0.5f,
-                      std::cos(k * startPos.z) / 2.0f + 0.5f, 1.0f};
-    auto spline =
-        ObjectBuilder{ObjectType::kEmpty}
-            .withName("bakeSpline")
-            .withSpline(points, 2, ObjectBuilder::kSplineSamplesAuto, color)
-            .build();
   } else {
     points.clear();
     forces.clear();
   }
 }
 
+// -------------------------------------------------------------------------- //
+
+/// Move traced points from simulation space to world space
+static void bakerToWorld(std::vector<Vec3F> &points, const Vec3F &origin) {
+  for (Vec3F &point : points) {
+    point += origin;
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Create the debug spline object of a traced streamline. This creates a scene
+/// object and must therefore be called from the main thread.
+static void bakerDebugSpline(const std::vector<Vec3F> &points, Vec3F dimM,
+                             Vec3F startPos) {
+  constexpr f32 kPi = 3.141592f;
+  const f32 k = (kPi * 8.0f) / ((dimM.x + dimM.y + dimM.z) / 3.0f);
+  const Vec4F color{std::cos(k * startPos.x) / 2.0f + 0.5f,
+                    std::cos(k * startPos.y) / 2.0f + 0.5f,
+                    std::cos(k * startPos.z) / 2.0f + 0.5f, 1.0f};
+  ObjectBuilder{ObjectType::kEmpty}
+      .withName("bakeSpline")
+      .withSpline(points, 2, ObjectBuilder::kSplineSamplesAuto, color)
+      .build();
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Number of candidates that are tried around each active Poisson-disk seed
+static constexpr u32 kBakerPoissonCandidates = 30;
+
+/// Weight that is added to each cell when importance sampling, as a fraction
+/// of the average weight, so that calm regions still get some seeds
+static constexpr f32 kBakerImportanceFloor = 0.1f;
+
+// -------------------------------------------------------------------------- //
+
+/// Seeds on a regular lattice, in cells
+static std::vector<Vec3F> bakerSeedsLattice(const FieldBase::Dim &dim,
+                                            f32 spacing) {
+  const u32 step = maxValue(u32(std::lround(spacing)), 1u);
+  std::vector<Vec3F> seeds;
+  for (u32 x = 1; x < dim.width - 1; x += step) {
+    for (u32 y = 1; y < dim.height - 1; y += step) {
+      for (u32 z = 1; z < dim.depth - 1; z += step) {
+        seeds.push_back(Vec3F(f32(x), f32(y), f32(z)));
+      }
+    }
+  }
+  return seeds;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Poisson-disk distributed seeds, in cells, generated with Bridson's
+/// algorithm. No two seeds are closer than 'radius'.
+static std::vector<Vec3F> bakerSeedsPoissonDisk(const FieldBase::Dim &dim,
+                                                f32 radius,
+                                                std::mt19937 &rng) {
+  // Seeds lie in the same region as the lattice
+  const Vec3F lo{1.0f, 1.0f, 1.0f};
+  const Vec3F size{maxValue(f32(dim.width) - 3.0f, 0.0f),
+                   maxValue(f32(dim.height) - 3.0f, 0.0f),
+                   maxValue(f32(dim.depth) - 3.0f, 0.0f)};
+  radius = maxValue(radius, 0.5f);
+
+  // Background grid with at most one seed per cell
+  const f32 gridCell = radius / std::sqrt(3.0f);
+  const s32 gx = s32(size.x / gridCell) + 1;
+  const s32 gy = s32(size.y / gridCell) + 1;
+  const s32 gz = s32(size.z / gridCell) + 1;
+  std::vector<s32> grid(u64(gx) * gy * gz, -1);
+  const auto gridIndex = [&](const Vec3F &p, s32 &x, s32 &y, s32 &z) {
+    x = minValue(s32((p.x - lo.x) / gridCell), gx - 1);
+    y = minValue(s32((p.y - lo.y) / gridCell), gy - 1);
+    z = minValue(s32((p.z - lo.z) / gridCell), gz - 1);
+  };
+
+  std::vector<Vec3F> seeds;
+  std::vector<u32> active;
+  const auto add = [&](const Vec3F &p) {
+    s32 x, y, z;
+    gridIndex(p, x, y, z);
+    grid[x + gx * (y + gy * z)] = s32(seeds.size());
+    active.push_back(u32(seeds.size()));
+    seeds.push_back(p);
+  };
+  const auto accept = [&](const Vec3F &p) {
+    if (p.x < lo.x || p.y < lo.y || p.z < lo.z || p.x > lo.x + size.x ||
+        p.y > lo.y + size.y || p.z > lo.z + size.z) {
+      return false;
+    }
+    s32 x, y, z;
+    gridIndex(p, x, y, z);
+    for (s32 k = maxValue(z - 2, 0); k <= minValue(z + 2, gz - 1); k++) {
+      for (s32 j = maxValue(y - 2, 0); j <= minValue(y + 2, gy - 1); j++) {
+        for (s32 i = maxValue(x - 2, 0); i <= minValue(x + 2, gx - 1); i++) {
+          const s32 other = grid[i + gx * (j + gy * k)];
+          if (other >= 0 && distance(seeds[other], p) < radius) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  };
+
+  std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+  std::normal_distribution<f32> normal(0.0f, 1.0f);
+  add(lo + Vec3F(unit(rng) * size.x, unit(rng) * size.y, unit(rng) * size.z));
+  while (!active.empty()) {
+    const u32 index = u32(unit(rng) * active.size()) % active.size();
+    const Vec3F center = seeds[active[index]];
+
+    // Try candidates in the shell between 'radius' and '2 * radius'
+    bool found = false;
+    for (u32 i = 0; i < kBakerPoissonCandidates && !found; i++) {
+      Vec3F dir{normal(rng), normal(rng), normal(rng)};
+      if (dir.squaredLength() < 1e-6f) {
+        continue;
+      }
+      dir.normalize();
+      const Vec3F candidate = center + dir * (radius * (1.0f + unit(rng)));
+      if (accept(candidate)) {
+        add(candidate);
+        found = true;
+      }
+    }
+    if (!found) {
+      active[index] = active.back();
+      active.pop_back();
+    }
+  }
+  return seeds;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Seeds that are importance sampled, in cells. Each cell is weighted by the
+/// magnitude of either the velocity gradient or the vorticity.
+static std::vector<Vec3F> bakerSeedsImportance(const VectorField &vel,
+                                               const FieldBase::Dim &dim,
+                                               bool vorticity, u32 count,
+                                               std::mt19937 &rng) {
+  if (dim.width < 3 || dim.height < 3 || dim.depth < 3) {
+    return {};
+  }
+
+  // Weights of the cells in the same region as the lattice
+  const u32 w = dim.width - 2;
+  const u32 h = dim.height - 2;
+  const u32 d = dim.depth - 2;
+  std::vector<f64> cdf(u64(w) * h * d);
+  f64 total = 0.0;
+  for (u32 z = 0; z < d; z++) {
+    for (u32 y = 0; y < h; y++) {
+      for (u32 x = 0; x < w; x++) {
+        const s32 cx = s32(x + 1), cy = s32(y + 1), cz = s32(z + 1);
+        const Vec3F dx = (vel.get(cx + 1, cy, cz) - vel.get(cx - 1, cy, cz));
+        const Vec3F dy = (vel.get(cx, cy + 1, cz) - vel.get(cx, cy - 1, cz));
+        const Vec3F dz = (vel.get(cx, cy, cz + 1) - vel.get(cx, cy, cz - 1));
+        f32 weight;
+        if (vorticity) {
+          const Vec3F curl{dy.z - dz.y, dz.x - dx.z, dx.y - dy.x};
+          weight = curl.length() * 0.5f;
+        } else {
+          weight = std::sqrt(dx.squaredLength() + dy.squaredLength() +
+                             dz.squaredLength()) *
+                   0.5f;
+        }
+        total += weight;
+        cdf[x + u64(w) * (y + u64(h) * z)] = total;
+      }
+    }
+  }
+
+  // Add the floor to every cell
+  const f64 minWeight =
+      total > 0.0 ? total / cdf.size() * kBakerImportanceFloor : 1.0;
+  for (u64 i = 0; i < cdf.size(); i++) {
+    cdf[i] += minWeight * (i + 1);
+  }
+  total = cdf.back();
+
+  std::uniform_real_distribution<f64> unit(0.0, 1.0);
+  std::vector<Vec3F> seeds;
+  for (u32 i = 0; i < count; i++) {
+    const f64 target = unit(rng) * total;
+    const u64 cell = u64(std::upper_bound(cdf.begin(), cdf.end(), target) -
+                         cdf.begin());
+    const u64 index = minValue(cell, u64(cdf.size() - 1));
+    const u32 x = u32(index % w);
+    const u32 y = u32((index / w) % h);
+    const u32 z = u32(index / (u64(w) * h));
+    seeds.push_back(Vec3F(x + 1.0f + f32(unit(rng)), y + 1.0f + f32(unit(rng)),
+                          z + 1.0f + f32(unit(rng))));
+  }
+  return seeds;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Simplify a traced streamline with the Ramer-Douglas-Peucker algorithm,
+/// applied jointly to the points and forces. A point is kept if it lies
+/// further than 'tolerance' from the segment between the points that are kept
+/// around it, or if its force differs by more than 'forceTolerance' from the
+/// force interpolated along that segment.
+static void bakerSimplify(std::vector<Vec3F> &points, std::vector<f32> &forces,
+                          f32 tolerance, f32 forceTolerance) {
+  const u32 count = u32(points.size());
+  if (count <= 3) {
+    return;
+  }
+
+  // Squared distance from 'p' to the segment 'a'-'b', along with the
+  // parameter of the closest point on the segment
+  const auto segmentDistance = [](Vec3F p, Vec3F a, Vec3F b, f32 &t) {
+    const Vec3F ab = b - a;
+    const f32 length2 = ab.squaredLength();
+    t = length2 > 0.0f ? clamp((p - a).dot(ab) / length2, 0.0f, 1.0f) : 0.0f;
+    return (a + ab * t - p).squaredLength();
+  };
+
+  std::vector<bool> keep(count, false);
+  keep.front() = true;
+  keep.back() = true;
+  std::vector<std::pair<u32, u32>> stack{{0, count - 1}};
+  while (!stack.empty()) {
+    const auto [first, last] = stack.back();
+    stack.pop_back();
+
+    // Find the point that deviates the most, relative to the tolerances
+    f32 maxDeviation = 1.0f;
+    u32 index = first;
+    for (u32 i = first + 1; i < last; i++) {
+      f32 t;
+      const f32 dist = std::sqrt(
+          segmentDistance(points[i], points[first], points[last], t));
+      const f32 force = forces[first] + (forces[last] - forces[first]) * t;
+      const f32 deviation =
+          maxValue(tolerance > 0.0f ? dist / tolerance : 0.0f,
+                   forceTolerance > 0.0f
+                       ? std::abs(forces[i] - force) / forceTolerance
+                       : 0.0f);
+      if (deviation > maxDeviation) {
+        maxDeviation = deviation;
+        index = i;
+      }
+    }
+    if (index != first) {
+      keep[index] = true;
+      stack.emplace_back(first, index);
+      stack.emplace_back(index, last);
+    }
+  }
+
+  // Splines need at least three points
+  if (std::count(keep.begin(), keep.end(), true) < 3) {
+    keep[count / 2] = true;
+  }
+
+  u32 out = 0;
+  for (u32 i = 0; i < count; i++) {
+    if (keep[i]) {
+      points[out] = points[i];
+      forces[out] = forces[i];
+      out++;
+    }
+  }
+  points.resize(out);
+  forces.resize(out);
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the mean distance from the points of 'a' to the closest point of
+/// 'b'. Returns early with a value above 'limit' once the mean can no longer
+/// be below it.
+static f32 bakerMeanClosestDistance(const std::vector<Vec3F> &a,
+                                    const std::vector<Vec3F> &b, f32 limit) {
+  const f32 budget = limit * a.size();
+  f32 sum = 0.0f;
+  for (const Vec3F &p : a) {
+    f32 closest = std::numeric_limits<f32>::max();
+    for (const Vec3F &q : b) {
+      closest = minValue(closest, (p - q).squaredLength());
+    }
+    sum += std::sqrt(closest);
+    if (sum > budget) {
+      return limit * 2.0f;
+    }
+  }
+  return sum / a.size();
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Greedily cluster traced streamlines. Streamlines are visited from longest
+/// to shortest, and each one either becomes a representative or, if its
+/// symmetric mean closest-point distance to a representative is below
+/// 'maxDistance', is merged into that representative. The force of each point
+/// of a representative is averaged with the force of the closest point of each
+/// streamline that is merged into it. Merged traces are cleared.
+/// \return Number of merged streamlines.
+static u32 bakerCluster(std::vector<BakerTrace> &traces, f32 maxDistance) {
+  // Bounds of each trace, for culling pairs that are too far apart
+  struct Bounds {
+    Vec3F min, max;
+  };
+  std::vector<Bounds> bounds(traces.size());
+  std::vector<u32> order;
+  for (u32 i = 0; i < traces.size(); i++) {
+    const std::vector<Vec3F> &points = traces[i].points;
+    if (points.empty()) {
+      continue;
+    }
+    bounds[i] = Bounds{points[0], points[0]};
+    for (const Vec3F &p : points) {
+      bounds[i].min = Vec3F::min(bounds[i].min, p);
+      bounds[i].max = Vec3F::max(bounds[i].max, p);
+    }
+    order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+    return traces[a].points.size() > traces[b].points.size();
+  });
+
+  // Sum of merged forces and number of contributions for each point of the
+  // representatives
+  std::vector<u32> representatives;
+  std::vector<std::vector<f32>> forceSums(traces.size());
+  std::vector<std::vector<u32>> forceCounts(traces.size());
+  u32 merged = 0;
+  for (const u32 index : order) {
+    const BakerTrace &trace = traces[index];
+    const Bounds &b = bounds[index];
+
+    s32 target = -1;
+    for (const u32 rep : representatives) {
+      // The mean distance can never be less than the gap between the bounds
+      const Bounds &r = bounds[rep];
+      const Vec3F gap = Vec3F::max(Vec3F::max(r.min - b.max, b.min - r.max),
+                                   Vec3F::ZERO);
+      if (gap.length() > maxDistance) {
+        continue;
+      }
+      const std::vector<Vec3F> &repPoints = traces[rep].points;
+      const f32 meanDistance =
+          maxValue(bakerMeanClosestDistance(trace.points, repPoints,
+                                            maxDistance),
+                   bakerMeanClosestDistance(repPoints, trace.points,
+                                            maxDistance));
+      if (meanDistance <= maxDistance) {
+        target = s32(rep);
+        break;
+      }
+    }
+
+    if (target < 0) {
+      representatives.push_back(index);
+      forceSums[index] = trace.forces;
+      forceCounts[index].assign(trace.forces.size(), 1);
+      continue;
+    }
+
+    // Merge forces into the representative
+    const std::vector<Vec3F> &repPoints = traces[target].points;
+    for (u32 i = 0; i < repPoints.size(); i++) {
+      u32 closest = 0;
+      f32 closestDist = std::numeric_limits<f32>::max();
+      for (u32 j = 0; j < trace.points.size(); j++) {
+        const f32 dist = (repPoints[i] - trace.points[j]).squaredLength();
+        if (dist < closestDist) {
+          closestDist = dist;
+          closest = j;
+        }
+      }
+      forceSums[target][i] += trace.forces[closest];
+      forceCounts[target][i]++;
+    }
+    traces[index].points.clear();
+    traces[index].forces.clear();
+    merged++;
+  }
+
+  for (const u32 rep : representatives) {
+    std::vector<f32> &forces = traces[rep].forces;
+    for (u32 i = 0; i < forces.size(); i++) {
+      forces[i] = forceSums[rep][i] / forceCounts[rep][i];
+    }
+  }
+  return merged;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Measure the error of the baked wind compared to the simulation and the
+/// time that it takes to evaluate the baked wind at each cell
+static void bakerMeasure(const HCSim &csim, const HCWind &cwind,
+                         Baker::Report &report) {
+  DeltaField delta;
+  delta.build(csim, cwind);
+  report.error = delta.getError();
+  report.medianError = delta.getErrorPercentile(50.0f);
+  report.percentile95Error = delta.getErrorPercentile(95.0f);
+
+  // Evaluate at the same points as the delta field
+  const WindSimulation *sim = csim->getSim();
+  const FieldBase::Dim dim = sim->getDim();
+  const Vec3F origin = csim->getOrigin();
+  bs::Timer timer;
+  for (u32 k = 0; k < dim.depth; k++) {
+    for (u32 j = 0; j < dim.height; j++) {
+      for (u32 i = 0; i < dim.width; i++) {
+        cwind->getWindAtPoint(
+            Vec3F(i + 1.0f, j + 1.0f, k + 1.0f) * sim->getCellSize() + origin);
+      }
+    }
+  }
+  const u32 count = dim.width * dim.height * dim.depth;
+  report.evalMicros =
+      count > 0 ? f32(timer.getMicroseconds()) / f32(count) : 0.0f;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Choose seeds with the seed strategy of the bake options, in meters
+static std::vector<Vec3F> bakerSeeds(const VectorField &vel,
+                                     const FieldBase::Dim &dim,
+                                     const Baker::Options &options) {
+  using SeedStrategy = Baker::SeedStrategy;
+  std::mt19937 rng(options.randomSeed);
+  std::vector<Vec3F> seeds;
+  switch (options.seedStrategy) {
+  case SeedStrategy::kPoissonDisk: {
+    seeds = bakerSeedsPoissonDisk(dim, options.seedSpacing, rng);
+    break;
+  }
+  case SeedStrategy::kGradient:
+  case SeedStrategy::kVorticity: {
+    const u32 count = options.seedCount > 0
+                          ? options.seedCount
+                          : u32(bakerSeedsLattice(dim, options.seedSpacing)
+                                    .size());
+    seeds = bakerSeedsImportance(
+        vel, dim, options.seedStrategy == SeedStrategy::kVorticity, count,
+        rng);
+    break;
+  }
+  case SeedStrategy::kLattice:
+    [[fallthrough]];
+  default: {
+    seeds = bakerSeedsLattice(dim, options.seedSpacing);
+    break;
+  }
+  }
+  for (Vec3F &seed : seeds) {
+    seed *= vel.getCellSize();
+  }
+  return seeds;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Mark the cells whose obstruction changed, or whose velocity changed by more
+/// than 'tolerance', since 'state' was captured. The marked region is dilated
+/// by one cell to cover the rounding of the tracer to the nearest cell.
+/// @return Number of changed cells, before dilation.
+static u32 bakerAffectedCells(const WindSimulation &sim,
+                              const Baker::BakeState &state, f32 tolerance,
+                              std::vector<u8> &affected) {
+  const VectorField &vel = sim.V();
+  const ObstructionField &obs = sim.O();
+  const FieldBase::Dim &dim = vel.getDim();
+  std::vector<u8> changed(vel.getCellCount(), 0);
+  u32 count = 0;
+  for (u32 i = 0; i < vel.getCellCount(); i++) {
+    const bool obsChanged = u8(obs.get(i)) != state.obstruction[i];
+    const f32 change2 = (vel.get(i) - state.velocity[i]).squaredLength();
+    const bool velChanged = change2 > tolerance * tolerance;
+    if (obsChanged || velChanged) {
+      changed[i] = 1;
+      count++;
+    }
+  }
+
+  affected.assign(vel.getCellCount(), 0);
+  for (s32 z = 0; z < s32(dim.depth); z++) {
+    for (s32 y = 0; y < s32(dim.height); y++) {
+      for (s32 x = 0; x < s32(dim.width); x++) {
+        if (!changed[vel.fromPos(x, y, z)]) {
+          continue;
+        }
+        for (s32 k = maxValue(z - 1, 0);
+             k <= minValue(z + 1, s32(dim.depth) - 1); k++) {
+          for (s32 j = maxValue(y - 1, 0);
+               j <= minValue(y + 1, s32(dim.height) - 1); j++) {
+            for (s32 i = maxValue(x - 1, 0);
+                 i <= minValue(x + 1, s32(dim.width) - 1); i++) {
+              affected[vel.fromPos(i, j, k)] = 1;
+            }
+          }
+        }
+      }
+    }
+  }
+  return count;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns whether a point in simulation space is in an affected cell. The
+/// point is rounded to the nearest cell, like the tracer does.
+static bool bakerIsAffected(const Vec3F &p, const std::vector<u8> &affected,
+                            const VectorField &vel) {
+  const FieldBase::Dim &dim = vel.getDim();
+  const f32 cellSize = vel.getCellSize();
+  const s32 x = clamp(s32(std::lround(p.x / cellSize)), 0, s32(dim.width) - 1);
+  const s32 y =
+      clamp(s32(std::lround(p.y / cellSize)), 0, s32(dim.height) - 1);
+  const s32 z = clamp(s32(std::lround(p.z / cellSize)), 0, s32(dim.depth) - 1);
+  return affected[vel.fromPos(x, y, z)] != 0;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns whether a spline passes through an affected cell. The points are in
+/// world space, offset by 'origin' from the simulation. The segments between
+/// points are sampled at half the cell size, as points may have been removed
+/// by simplification and the tracer casts rays along the segments.
+static bool bakerPassesThrough(const std::vector<Vec3F> &points,
+                               const std::vector<u8> &affected,
+                               const VectorField &vel, const Vec3F &origin) {
+  const f32 cellSize = vel.getCellSize();
+  const auto isAffected = [&](const Vec3F &world) {
+    return bakerIsAffected(world - origin, affected, vel);
+  };
+
+  for (u32 i = 0; i < points.size(); i++) {
+    if (isAffected(points[i])) {
+      return true;
+    }
+    if (i + 1 < points.size()) {
+      const Vec3F segment = points[i + 1] - points[i];
+      const u32 samples = u32(segment.length() / (cellSize * 0.5f));
+      for (u32 j = 1; j <= samples; j++) {
+        if (isAffected(points[i] + segment * (f32(j) / (samples + 1)))) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the error statistic of a report that tuning targets
+static f32 bakerMetric(const Baker::Report &report,
+                       Baker::ErrorMetric metric) {
+  return metric == Baker::ErrorMetric::kMedian ? report.medianError
+                                               : report.percentile95Error;
+}
+
 } // namespace wind
 
 // ========================================================================== //
@@ -179,7 +756,9 @@ void Baker::bakeAll() {
 
 // -------------------------------------------------------------------------- //
 
-bs::HSceneObject Baker::bake(const bs::HSceneObject &obj, const String &name) {
+bs::HSceneObject Baker::bake(const bs::HSceneObject &obj, const String &name,
+                             const Options &options, Report *report,
+                             BakeState *state) {
   const HCSim csim = obj->getComponent<CSim>();
   AlfAssert(
       csim != nullptr,
@@ -189,10 +768,13 @@ bs::HSceneObject Baker::bake(const bs::HSceneObject &obj, const String &name) {
   const VectorField &vel = sim->V();
   const FieldBase::Dim dim = sim->getDim();
   const Vec3F dimM = sim->getDimM();
+  const Vec3F origin = csim->getOrigin();
 
+  // The simulation covers the world from its origin, independently of where
+  // the simulation object is placed
   const auto parent = csim->SO()->getParent();
   const Vec3F scale{dimM.x - 1, dimM.y - 1, dimM.z - 1};
-  const Vec3F pos = parent->getTransform().getPosition() + scale / 2.0f;
+  const Vec3F pos = origin + scale / 2.0f;
   const auto volumeType = WindSystem::VolumeType::kCube;
 
   const String name_ = name.empty() ? "baked wind" : name;
@@ -205,36 +787,93 @@ bs::HSceneObject Baker::bake(const bs::HSceneObject &obj, const String &name) {
   windSO->setParent(parent);
   auto cwind = windSO->getComponent<CWind>();
 
-  const u32 stepX = 4;
-  const u32 stepY = 4;
-  const u32 stepZ = 4;
-  DLOG_INFO("[BAKE] step size [{}, {}, {}]", stepX, stepY, stepZ);
+  // Bake a voxel grid
+  if (options.gridDownsample > 0) {
+    BaseFn grid = BaseFn::fnGrid(vel, options.gridDownsample, origin,
+                                 options.gridBits);
+    const auto &g = std::get<BaseFn::Grid>(grid.fn);
+    DLOG_INFO("[BAKE] grid {}x{}x{}, sim size: {}, baked size: {}", g.dimX,
+              g.dimY, g.dimZ, vel.getCellCount() * sizeof(f32) * 3,
+              g.getSize());
+    cwind->addFunction(std::move(grid));
+    if (report) {
+      *report = Report{};
+      bakerMeasure(csim, cwind, *report);
+    }
+    if (state) {
+      state->capture(*sim);
+    }
+    return windSO;
+  }
+
+  // Choose seeds
+  DLOG_INFO("[BAKE] seed strategy: {}, spacing {}",
+            seedStrategyToString(options.seedStrategy), options.seedSpacing);
+  const std::vector<Vec3F> seeds = bakerSeeds(vel, dim, options);
 
-  // TODO(Filip) use "blue noise" to chose points to sample
-  std::vector<BaseFn::SplineBase> splines{};
-  u32 particles = 0;
-  for (u32 x = 1; x < dim.width - 1; x += stepX) {
-    for (u32 y = 1; y < dim.height - 1; y += stepY) {
-      for (u32 z = 1; z < dim.depth - 1; z += stepZ) {
-        const Vec3F start = vel.cellToMeter(x, y, z);
-        std::vector<Vec3F> points;
-        std::vector<f32> forces;
-        bakerBakeAux(points, forces, vel, start);
-        if (!points.empty()) {
-          splines.push_back(
-              BaseFn::SplineBase{std::move(points), std::move(forces), 2,
-                                 ObjectBuilder::kSplineSamplesAuto});
+  // Trace seeds in parallel. Each task writes to the traces of its own seeds,
+  // which are then merged in seed order so that the result does not depend on
+  // the scheduling.
+  const bs::PhysicsScene &physicsScene =
+      *bs::gSceneManager().getMainScene()->getPhysicsScene();
+  std::vector<BakerTrace> traces(seeds.size());
+  std::vector<u32> tracedPoints(seeds.size(), 0);
+  TaskGraph graph;
+  for (u32 begin = 0; begin < seeds.size(); begin += kBakerSeedsPerTask) {
+    const u32 end = minValue(begin + kBakerSeedsPerTask, u32(seeds.size()));
+    graph.add([&, begin, end]() {
+      for (u32 i = begin; i < end; i++) {
+        bakerBakeAux(traces[i].points, traces[i].forces, vel, physicsScene,
+                     origin, seeds[i], options.maxSteps);
+        tracedPoints[i] = u32(traces[i].points.size());
+        if (options.simplifyTolerance > 0.0f) {
+          bakerSimplify(traces[i].points, traces[i].forces,
+                        options.simplifyTolerance,
+                        options.simplifyForceTolerance);
         }
-        particles++;
       }
+    });
+  }
+  graph.run();
+  DLOG_INFO("[BAKE] particles traced: {}", seeds.size());
+
+  // Merge redundant streamlines
+  u32 mergedCount = 0;
+  if (options.clusterDistance > 0.0f) {
+    mergedCount = bakerCluster(traces, options.clusterDistance);
+    DLOG_INFO("[BAKE] clustering merged {} streamlines", mergedCount);
+  }
+
+  // Merge traces and create debug splines on this thread
+  std::vector<BaseFn::SplineBase> splines{};
+  for (u32 i = 0; i < traces.size(); i++) {
+    BakerTrace &trace = traces[i];
+    if (!trace.points.empty()) {
+      bakerToWorld(trace.points, origin);
+      if (options.debugSplines) {
+        bakerDebugSpline(trace.points, vel.getDimM(), seeds[i]);
+      }
+      splines.push_back(BaseFn::SplineBase{std::move(trace.points),
+                                           std::move(trace.forces), 2,
+                                           ObjectBuilder::kSplineSamplesAuto});
     }
   }
-  DLOG_INFO("[BAKE] particles traced: {}", particles);
 
   u32 pointCount = 0;
   for (const auto &spline : splines) {
     pointCount += spline.points.size();
   }
+  u32 tracedPointCount = 0;
+  for (const u32 count : tracedPoints) {
+    tracedPointCount += count;
+  }
+  if (options.simplifyTolerance > 0.0f) {
+    DLOG_INFO("[BAKE] simplified {} points to {} ({:.1f}%)", tracedPointCount,
+              pointCount,
+              tracedPointCount > 0 ? 100.0f * pointCount / tracedPointCount
+                                   : 100.0f);
+  }
+  const u32 splineCount = u32(splines.size());
   if (!splines.empty()) {
     cwind->addFunction(BaseFn::fnSpline(std::move(splines)));
   }
@@ -245,7 +884,366 @@ bs::HSceneObject Baker::bake(const bs::HSceneObject &obj, const String &name) {
                 sizeof(f32) * 3,
             pointCount * sizeof(f32) * 3 + sizeof(f32));
 
+  if (report) {
+    report->particleCount = u32(seeds.size());
+    report->splineCount = splineCount;
+    report->mergedCount = mergedCount;
+    report->pointCount = pointCount;
+    report->tracedPointCount = tracedPointCount;
+    bakerMeasure(csim, cwind, *report);
+    DLOG_INFO("[BAKE] {} seeds: {} splines, {} points, error {:.4f}",
+              seedStrategyToString(options.seedStrategy), splineCount,
+              pointCount, report->error);
+  }
+  if (state) {
+    state->capture(*sim);
+  }
+
   return windSO;
 }
 
+// -------------------------------------------------------------------------- //
+
+bool Baker::rebake(const bs::HSceneObject &obj, const bs::HSceneObject &baked,
+                   BakeState &state, f32 stepDelta, const Options &options,
+                   Report *report) {
+  const HCSim csim = obj->getComponent<CSim>();
+  AlfAssert(
+      csim != nullptr,
+      "Object being baked is required to have a wind simulation component");
+  const HCWind cwind = baked->getComponent<CWind>();
+  if (cwind == nullptr) {
+    DLOG_ERROR("[REBAKE] object {} has no wind to re-bake",
+               baked->getName().c_str());
+    return false;
+  }
+  WindSimulation *sim = csim->getSim();
+  if (!state.matches(*sim)) {
+    DLOG_ERROR("[REBAKE] bake state does not match the simulation, a full "
+               "bake is required");
+    return false;
+  }
+
+  // Rebuild obstructions and run to a steady state from the velocity that was
+  // baked, which is close to the new steady state away from the changes
+  bs::Timer timer;
+  const Vec3F origin = csim->getOrigin();
+  state.restore(*sim);
+  sim->buildForScene(bs::gSceneManager().getMainScene(), origin);
+  const WindSimulation::SteadyState steady = sim->solveSteadyState(stepDelta);
+  const f32 solveMs = timer.getMilliseconds();
+
+  // Region that changed
+  const VectorField &vel = sim->V();
+  std::vector<u8> affected;
+  const u32 affectedCellCount =
+      bakerAffectedCells(*sim, state, options.rebakeTolerance, affected);
+  DLOG_INFO("[REBAKE] {} of {} cells changed, steady state after {} steps "
+            "({:.1f} ms)",
+            affectedCellCount, vel.getCellCount(), steady.steps, solveMs);
+
+  // Seed the affected region again with the strategy of the bake. Seeds are
+  // chosen over the whole simulation so that the region gets the same density
+  // of seeds as when baking.
+  std::vector<Vec3F> regionSeeds;
+  if (affectedCellCount > 0) {
+    for (const Vec3F &seed : bakerSeeds(vel, sim->getDim(), options)) {
+      if (bakerIsAffected(seed, affected, vel)) {
+        regionSeeds.push_back(seed);
+      }
+    }
+  }
+
+  // Split the splines into those that are kept and those that are traced
+  // again. Splines that start in the affected region are replaced by the new
+  // seeds, the others are traced again from their first point.
+  u32 retracedCount = 0;
+  u32 reseededCount = 0;
+  u32 splineCount = 0;
+  u32 pointCount = 0;
+  const bs::PhysicsScene &physicsScene =
+      *bs::gSceneManager().getMainScene()->getPhysicsScene();
+
+  // A bake where no seed traced a spline has no spline function to hold the
+  // new seeds. Grids already cover the whole simulation.
+  std::vector<BaseFn> &functions = cwind->getFunctions();
+  const bool hasSplineOrGrid =
+      std::any_of(functions.begin(), functions.end(), [](const BaseFn &fn) {
+        return fn.isType<BaseFn::Spline>() || fn.isType<BaseFn::Grid>();
+      });
+  if (!regionSeeds.empty() && !hasSplineOrGrid) {
+    cwind->addFunction(BaseFn::fnSpline({}));
+  }
+
+  for (BaseFn &fn : cwind->getFunctions()) {
+    if (fn.isType<BaseFn::Grid>()) {
+      const auto &grid = std::get<BaseFn::Grid>(fn.fn);
+      const u32 downsample =
+          maxValue(u32(std::lround(grid.cellSize / vel.getCellSize())), 1u);
+      fn = BaseFn::fnGrid(vel, downsample, origin, grid.getBits());
+      continue;
+    }
+    if (!fn.isType<BaseFn::Spline>()) {
+      continue;
+    }
+
+    std::vector<BaseFn::SplineBase> &splines =
+        std::get<BaseFn::Spline>(fn.fn).splines;
+    std::vector<BaseFn::SplineBase> kept;
+    std::vector<Vec3F> seeds;
+    for (BaseFn::SplineBase &spline : splines) {
+      if (spline.points.empty()) {
+        continue;
+      }
+      if (!bakerPassesThrough(spline.points, affected, vel, origin)) {
+        kept.push_back(std::move(spline));
+        continue;
+      }
+      const Vec3F first = spline.points.front() - origin;
+      if (!bakerIsAffected(first, affected, vel)) {
+        seeds.push_back(first);
+      }
+    }
+    retracedCount += u32(seeds.size());
+    if (!regionSeeds.empty()) {
+      reseededCount += u32(regionSeeds.size());
+      seeds.insert(seeds.end(), regionSeeds.begin(), regionSeeds.end());
+      regionSeeds.clear();
+    }
+
+    // Trace in parallel, like when baking
+    std::vector<BakerTrace> traces(seeds.size());
+    TaskGraph graph;
+    for (u32 begin = 0; begin < seeds.size(); begin += kBakerSeedsPerTask) {
+      const u32 end = minValue(begin + kBakerSeedsPerTask, u32(seeds.size()));
+      graph.add([&, begin, end]() {
+        for (u32 i = begin; i < end; i++) {
+          bakerBakeAux(traces[i].points, traces[i].forces, vel, physicsScene,
+                       origin, seeds[i], options.maxSteps);
+          if (options.simplifyTolerance > 0.0f) {
+            bakerSimplify(traces[i].points, traces[i].forces,
+                          options.simplifyTolerance,
+                          options.simplifyForceTolerance);
+          }
+        }
+      });
+    }
+    graph.run();
+
+    for (u32 i = 0; i < traces.size(); i++) {
+      BakerTrace &trace = traces[i];
+      if (trace.points.empty()) {
+        continue;
+      }
+      bakerToWorld(trace.points, origin);
+      if (options.debugSplines) {
+        bakerDebugSpline(trace.points, vel.getDimM(), seeds[i]);
+      }
+      kept.push_back(BaseFn::SplineBase{std::move(trace.points),
+                                        std::move(trace.forces), 2,
+                                        ObjectBuilder::kSplineSamplesAuto});
+    }
+    splineCount += u32(kept.size());
+    for (const auto &spline : kept) {
+      pointCount += u32(spline.points.size());
+    }
+    fn = BaseFn::fnSpline(std::move(kept));
+  }
+  DLOG_INFO("[REBAKE] traced {} splines again and {} new seeds, {} splines",
+            retracedCount, reseededCount, splineCount);
+
+  state.capture(*sim);
+  if (report) {
+    *report = Report{};
+    report->particleCount = retracedCount + reseededCount;
+    report->splineCount = splineCount;
+    report->pointCount = pointCount;
+    report->affectedCellCount = affectedCellCount;
+    report->retracedCount = retracedCount;
+    report->reseededCount = reseededCount;
+    bakerMeasure(csim, cwind, *report);
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+void Baker::BakeState::capture(const WindSimulation &sim) {
+  const VectorField &vel = sim.V();
+  const ObstructionField &obs = sim.O();
+  dim = vel.getDim();
+  velocity.resize(vel.getCellCount());
+  obstruction.resize(vel.getCellCount());
+  for (u32 i = 0; i < vel.getCellCount(); i++) {
+    velocity[i] = vel.get(i);
+    obstruction[i] = u8(obs.get(i));
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void Baker::BakeState::restore(WindSimulation &sim) const {
+  AlfAssert(matches(sim), "Bake state must match the simulation");
+  VectorField &vel = sim.V();
+  for (u32 i = 0; i < vel.getCellCount(); i++) {
+    vel.set(i, velocity[i]);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool Baker::BakeState::matches(const WindSimulation &sim) const {
+  const FieldBase::Dim &simDim = sim.V().getDim();
+  return simDim.width == dim.width && simDim.height == dim.height &&
+         simDim.depth == dim.depth &&
+         velocity.size() == sim.V().getCellCount();
+}
+
+// -------------------------------------------------------------------------- //
+
+bs::HSceneObject Baker::tune(const bs::HSceneObject &obj, const String &name,
+                             const TuneOptions &options, TuneReport *report) {
+  const char *metricName =
+      options.metric == ErrorMetric::kMedian ? "median" : "95th percentile";
+  DLOG_INFO("[TUNE] target {} error {:.4f}", metricName, options.targetError);
+
+  TuneReport result;
+  bs::HSceneObject best;
+  bool bestMeets = false;
+  for (const f32 seedSpacing : options.seedSpacings) {
+    for (const u32 maxSteps : options.maxSteps) {
+      for (const f32 simplifyTolerance : options.simplifyTolerances) {
+        TuneTrial trial{options.base, Report{}};
+        trial.options.seedSpacing = seedSpacing;
+        trial.options.maxSteps = maxSteps;
+        trial.options.simplifyTolerance = simplifyTolerance;
+        trial.options.debugSplines = false;
+        const bs::HSceneObject baked =
+            bake(obj, name, trial.options, &trial.report);
+
+        const f32 error = bakerMetric(trial.report, options.metric);
+        const bool meets = error <= options.targetError;
+        DLOG_INFO("[TUNE] spacing {}, steps {}, tolerance {}: {} error "
+                  "{:.4f}, {:.3f} us per query, {} points",
+                  seedSpacing, maxSteps, simplifyTolerance, metricName, error,
+                  trial.report.evalMicros, trial.report.pointCount);
+
+        // Prefer meeting the target, then the cheapest to evaluate. The cost
+        // of a query grows with the number of spline points around it, so the
+        // point count ranks the cost without the noise of a timed pass. Ties
+        // go to fewer splines, then to the lower error. If nothing meets the
+        // target then prefer the most accurate.
+        bool better = best == nullptr;
+        if (!better) {
+          const TuneTrial &chosen = result.trials[result.chosen];
+          const f32 chosenError = bakerMetric(chosen.report, options.metric);
+          if (meets != bestMeets) {
+            better = meets;
+          } else if (meets) {
+            const Report &a = trial.report;
+            const Report &b = chosen.report;
+            better = a.pointCount != b.pointCount
+                         ? a.pointCount < b.pointCount
+                         : a.splineCount != b.splineCount
+                               ? a.splineCount < b.splineCount
+                               : error < chosenError;
+          } else {
+            better = error < chosenError;
+          }
+        }
+        if (better) {
+          if (best != nullptr) {
+            best->destroy();
+          }
+          best = baked;
+          bestMeets = meets;
+          result.chosen = u32(result.trials.size());
+        } else {
+          baked->destroy();
+        }
+        result.trials.push_back(trial);
+      }
+    }
+  }
+  result.targetMet = bestMeets;
+
+  if (result.trials.empty()) {
+    DLOG_WARNING("[TUNE] there are no candidate parameters to tune");
+    if (report) {
+      *report = std::move(result);
+    }
+    return best;
+  }
+
+  const TuneTrial &chosen = result.trials[result.chosen];
+  if (result.targetMet) {
+    DLOG_INFO("[TUNE] chose spacing {}, steps {}, tolerance {}: {} error "
+              "{:.4f}, {} points, {:.3f} us per query",
+              chosen.options.seedSpacing, chosen.options.maxSteps,
+              chosen.options.simplifyTolerance, metricName,
+              bakerMetric(chosen.report, options.metric),
+              chosen.report.pointCount, chosen.report.evalMicros);
+  } else {
+    DLOG_WARNING("[TUNE] no parameters meet the target, chose the most "
+                 "accurate: spacing {}, steps {}, tolerance {}: {} error "
+                 "{:.4f}",
+                 chosen.options.seedSpacing, chosen.options.maxSteps,
+                 chosen.options.simplifyTolerance, metricName,
+                 bakerMetric(chosen.report, options.metric));
+  }
+
+  // Write report
+  if (!options.reportPath.empty()) {
+    std::string csv = "seedSpacing;maxSteps;simplifyTolerance;splines;points;"
+                      "error;medianError;percentile95Error;evalMicros;"
+                      "chosen\n";
+    for (u32 i = 0; i < result.trials.size(); i++) {
+      const TuneTrial &trial = result.trials[i];
+      csv += dlog::Format("{};{};{};{};{};{};{};{};{};{}\n",
+                          trial.options.seedSpacing, trial.options.maxSteps,
+                          trial.options.simplifyTolerance,
+                          trial.report.splineCount, trial.report.pointCount,
+                          trial.report.error, trial.report.medianError,
+                          trial.report.percentile95Error,
+                          trial.report.evalMicros,
+                          i == result.chosen ? 1 : 0);
+    }
+    dutil::File file{};
+    dutil::File::Result res =
+        file.Open(options.reportPath, dutil::File::Mode::kWrite);
+    if (res == dutil::File::Result::kSuccess) {
+      res = file.Write(csv);
+    }
+    if (res != dutil::File::Result::kSuccess) {
+      DLOG_ERROR("failed to write tuning report {}: {}", options.reportPath,
+                 dutil::File::ResultToString(res));
+    }
+  }
+
+  if (report) {
+    *report = std::move(result);
+  }
+  return best;
+}
+
+// -------------------------------------------------------------------------- //
+
+const char *Baker::seedStrategyToString(SeedStrategy strategy) {
+  switch (strategy) {
+  case SeedStrategy::kPoissonDisk: {
+    return "poisson-disk";
+  }
+  case SeedStrategy::kGradient: {
+    return "gradient";
+  }
+  case SeedStrategy::kVorticity: {
+    return "vorticity";
+  }
+  case SeedStrategy::kLattice:
+    [[fallthrough]];
+  default:
+    return "lattice";
+  }
+}
+
 } // namespace wind
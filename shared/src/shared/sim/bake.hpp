@@ -27,23 +27,212 @@
 // ========================================================================== //
 
 #include "shared/macros.hpp"
+#include "shared/math/field.hpp"
 #include "shared/scene/component/cwind.hpp"
 
+#include <vector>
+
 // ========================================================================== //
 // Baker Declaration
 // ========================================================================== //
 
 namespace wind {
 
+WIND_FORWARD_DECLARE(WindSimulation);
+
 ///
 class Baker {
   WIND_NAMESPACE_CLASS(Baker);
 
+public:
+  /// Strategies for choosing the seeds that particles are traced from
+  enum class SeedStrategy {
+    kLattice = 0, ///< Regular lattice with 'seedSpacing' cells between seeds.
+    kPoissonDisk, ///< Blue noise with at least 'seedSpacing' cells between.
+    kGradient,    ///< Importance sampled by velocity gradient magnitude.
+    kVorticity,   ///< Importance sampled by vorticity magnitude.
+  };
+
+  /// Options for baking
+  struct Options {
+    /// Strategy for choosing seeds
+    SeedStrategy seedStrategy = SeedStrategy::kLattice;
+    /// Distance between seeds in cells, for the lattice and Poisson-disk
+    /// strategies
+    f32 seedSpacing = 4.0f;
+    /// Number of seeds for the importance strategies. Zero means the number
+    /// of seeds that the lattice would have.
+    u32 seedCount = 0;
+    /// Seed of the random number generator
+    u32 randomSeed = 0;
+    /// Largest number of steps that a particle is traced for
+    u32 maxSteps = 100;
+    /// Largest distance (m) that a removed point may lie from the simplified
+    /// spline. Zero keeps every traced point.
+    f32 simplifyTolerance = 0.0f;
+    /// Largest difference in force (m/s) between a removed point and the
+    /// force interpolated along the simplified spline
+    f32 simplifyForceTolerance = 0.1f;
+    /// Largest mean distance (m) between two streamlines for them to be
+    /// merged into one. Zero disables clustering.
+    f32 clusterDistance = 0.0f;
+    /// Bake the velocity field into a voxel grid, keeping every
+    /// 'gridDownsample' cell along each axis, instead of tracing splines. Zero
+    /// bakes splines.
+    u32 gridDownsample = 0;
+    /// Number of bits per component to block compress the voxel grid with.
+    /// Zero stores each component as a 16-bit integer.
+    u32 gridBits = 0;
+    /// Whether to create a debug spline object for each traced streamline
+    bool debugSplines = false;
+    /// Smallest change in velocity (m/s) of a cell for the splines that pass
+    /// through it to be traced again when re-baking
+    f32 rebakeTolerance = 0.05f;
+  };
+
+  /// Result of baking
+  struct Report {
+    /// Number of particles that were traced
+    u32 particleCount = 0;
+    /// Number of splines that were baked
+    u32 splineCount = 0;
+    /// Number of splines that were merged into other splines by clustering
+    u32 mergedCount = 0;
+    /// Total number of points in the baked splines
+    u32 pointCount = 0;
+    /// Total number of traced points, before simplification
+    u32 tracedPointCount = 0;
+    /// Average error of the baked wind compared to the simulation, as
+    /// measured by 'DeltaField'
+    f32 error = 0.0f;
+    /// Median error
+    f32 medianError = 0.0f;
+    /// 95th percentile of the error
+    f32 percentile95Error = 0.0f;
+    /// Average time to evaluate the baked wind at a point, in microseconds,
+    /// from a single timed pass. Tuning does not rank by it, as it is noisy.
+    f32 evalMicros = 0.0f;
+    /// Number of cells that were affected by changes when re-baking
+    u32 affectedCellCount = 0;
+    /// Number of splines that were traced again when re-baking
+    u32 retracedCount = 0;
+    /// Number of new seeds that were traced in the affected region when
+    /// re-baking
+    u32 reseededCount = 0;
+  };
+
+  /// Obstructions and velocity of a simulation at the time that it was baked,
+  /// which re-baking compares against to find the regions that changed
+  struct BakeState {
+    /// Dimensions of the simulation, including boundary cells
+    FieldBase::Dim dim{0, 0, 0};
+    /// Velocity of each cell
+    std::vector<Vec3F> velocity;
+    /// Whether each cell is obstructed
+    std::vector<u8> obstruction;
+
+    /// Capture the state of a simulation
+    void capture(const WindSimulation &sim);
+
+    /// Set the velocity of a simulation to the captured velocity
+    /// \pre The state must match the simulation.
+    void restore(WindSimulation &sim) const;
+
+    /// Returns whether the state was captured from a simulation of the same
+    /// dimensions
+    bool matches(const WindSimulation &sim) const;
+  };
+
+  /// Error statistic that tuning targets
+  enum class ErrorMetric {
+    kMedian = 0,   ///< Median error
+    kPercentile95, ///< 95th percentile of the error
+  };
+
+  /// Options for tuning the bake parameters. Every combination of the
+  /// candidate values is baked.
+  struct TuneOptions {
+    /// Error statistic to target
+    ErrorMetric metric = ErrorMetric::kPercentile95;
+    /// Largest acceptable error (m/s)
+    f32 targetError = 0.5f;
+    /// Options for the parameters that are not tuned
+    Options base;
+    /// Candidate distances between seeds
+    std::vector<f32> seedSpacings = {8.0f, 6.0f, 4.0f, 3.0f, 2.0f};
+    /// Candidate largest number of steps per particle
+    std::vector<u32> maxSteps = {50, 100, 200};
+    /// Candidate simplification tolerances
+    std::vector<f32> simplifyTolerances = {0.5f, 0.25f, 0.1f, 0.0f};
+    /// Path of a CSV file to write the report to. Empty to only log it.
+    String reportPath;
+  };
+
+  /// Result of a single bake during tuning
+  struct TuneTrial {
+    /// Options that were baked with
+    Options options;
+    /// Result of the bake
+    Report report;
+  };
+
+  /// Result of tuning
+  struct TuneReport {
+    /// Every trial, in the order that they were baked
+    std::vector<TuneTrial> trials;
+    /// Index of the chosen trial
+    u32 chosen = 0;
+    /// Whether the chosen trial meets the target error
+    bool targetMet = false;
+  };
+
 public:
   static void bakeAll();
 
+  /// Bake the simulation of an object into a wind object. If 'report' is not
+  /// null then it is filled in, which includes measuring the error of the
+  /// baked wind. If 'state' is not null then the state of the simulation is
+  /// captured into it, for re-baking later.
   static bs::HSceneObject bake(const bs::HSceneObject &obj,
-                               const String &name = "");
+                               const String &name = "",
+                               const Options &options = Options(),
+                               Report *report = nullptr,
+                               BakeState *state = nullptr);
+
+  /// Re-bake the parts of a baked wind object that are affected by changes to
+  /// the scene since 'state' was captured by 'bake' or a previous re-bake.
+  ///
+  /// The obstructions of the simulation are rebuilt and the simulation is run
+  /// to a steady state again, warm started from the velocity in 'state'.
+  /// Cells whose obstruction changed, or whose velocity changed by more than
+  /// 'rebakeTolerance', form the affected region. It is seeded again with the
+  /// seed strategy of 'options'. Splines that pass through the region are
+  /// traced again from their first point, unless that point is inside the
+  /// region, and the other splines are kept as they are. The new seeds are
+  /// added to the first spline function, which is created if the wind has
+  /// neither splines nor a grid. Grids are baked again.
+  /// Clustering is not applied to the traced splines. 'state' is updated to
+  /// the new steady state.
+  /// @return Whether the wind could be re-baked.
+  static bool rebake(const bs::HSceneObject &obj,
+                     const bs::HSceneObject &baked, BakeState &state,
+                     f32 stepDelta, const Options &options = Options(),
+                     Report *report = nullptr);
+
+  /// Find the cheapest bake parameters that meet an error target. Each
+  /// combination of candidates is baked and measured, the cheapest one to
+  /// evaluate that meets the target is kept and the other bakes are
+  /// destroyed. The cost is ranked by the number of spline points, then the
+  /// number of splines, so that the choice does not depend on timing noise.
+  /// If no combination meets the target then the most accurate one is kept.
+  /// Debug splines are not created while tuning.
+  static bs::HSceneObject tune(const bs::HSceneObject &obj,
+                               const String &name = "",
+                               const TuneOptions &options = TuneOptions(),
+                               TuneReport *report = nullptr);
+
+  /// Returns the name of a seed strategy
+  static const char *seedStrategyToString(SeedStrategy strategy);
 };
 
 } // namespace wind
@@ -0,0 +1,290 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "shared/sim/block_field.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/math/math.hpp"
+#include "shared/sim/vector_field.hpp"
+#include "thirdparty/dutil/file.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <alflib/core/assert.hpp>
+#include <dlog/dlog.hpp>
+
+#include <cmath>
+#include <cstring>
+
+// ========================================================================== //
+// BlockVectorField Implementation
+// ========================================================================== //
+
+namespace wind {
+
+f32 BlockVectorField::encode(const VectorField &field, u32 bits) {
+  MICROPROFILE_SCOPEI("BlockVectorField", "encode", MP_ORANGE1);
+
+  m_dim = field.getDim();
+  m_cellSize = field.getCellSize();
+  m_bits = clamp(bits, 1u, kMaxBits);
+  allocate();
+  const u32 levels = (1u << m_bits) - 1u;
+
+  f32 maxError = 0.0f;
+  for (u32 bz = 0; bz < m_blocksZ; bz++) {
+    for (u32 by = 0; by < m_blocksY; by++) {
+      for (u32 bx = 0; bx < m_blocksX; bx++) {
+        const u32 block = bx + m_blocksX * (by + m_blocksY * bz);
+        const u32 x0 = bx * kBlockSize;
+        const u32 y0 = by * kBlockSize;
+        const u32 z0 = bz * kBlockSize;
+        const u32 x1 = minValue(x0 + kBlockSize, m_dim.width);
+        const u32 y1 = minValue(y0 + kBlockSize, m_dim.height);
+        const u32 z1 = minValue(z0 + kBlockSize, m_dim.depth);
+
+        // Range of the cells of the block that are inside the field
+        Vec3F min = field.get(s32(x0), s32(y0), s32(z0));
+        Vec3F max = min;
+        for (u32 z = z0; z < z1; z++) {
+          for (u32 y = y0; y < y1; y++) {
+            for (u32 x = x0; x < x1; x++) {
+              const Vec3F v = field.get(s32(x), s32(y), s32(z));
+              min = Vec3F::min(min, v);
+              max = Vec3F::max(max, v);
+            }
+          }
+        }
+        Block &b = m_blocks[block];
+        for (u32 c = 0; c < 3; c++) {
+          b.min[c] = min[c];
+          b.step[c] = (max[c] - min[c]) / f32(levels);
+        }
+
+        // Indices, with cells outside the field left at zero
+        u8 *indices = m_indices.data() + block * m_blockBytes;
+        for (u32 z = z0; z < z1; z++) {
+          for (u32 y = y0; y < y1; y++) {
+            for (u32 x = x0; x < x1; x++) {
+              const Vec3F v = field.get(s32(x), s32(y), s32(z));
+              const u32 cell =
+                  (x - x0) + kBlockSize * ((y - y0) + kBlockSize * (z - z0));
+              for (u32 c = 0; c < 3; c++) {
+                const u32 index =
+                    b.step[c] > 0.0f
+                        ? clamp(u32(std::lround((v[c] - b.min[c]) /
+                                                b.step[c])),
+                                0u, levels)
+                        : 0u;
+                maxError = maxValue(
+                    maxError, std::abs(b.min[c] + b.step[c] * index - v[c]));
+                const u32 bit = (cell * 3 + c) * m_bits;
+                const u32 word = index << (bit % 8);
+                indices[bit / 8] |= u8(word & 0xFFu);
+                indices[bit / 8 + 1] |= u8(word >> 8u);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  DLOG_VERBOSE("block compressed {}x{}x{} field with {} bits: {} bytes "
+               "({:.1f}% of f32), max error {:.4f}",
+               m_dim.width, m_dim.height, m_dim.depth, m_bits, getSize(),
+               100.0f * getSize() / (sizeof(f32) * 3 * field.getCellCount()),
+               maxError);
+  return maxError;
+}
+
+// -------------------------------------------------------------------------- //
+
+void BlockVectorField::decode(VectorField &field) const {
+  MICROPROFILE_SCOPEI("BlockVectorField", "decode", MP_ORANGE1);
+  AlfAssert(field.getDim().width == m_dim.width &&
+                field.getDim().height == m_dim.height &&
+                field.getDim().depth == m_dim.depth,
+            "Field must have the same dimensions as the encoded field");
+
+  for (u32 z = 0; z < m_dim.depth; z++) {
+    for (u32 y = 0; y < m_dim.height; y++) {
+      for (u32 x = 0; x < m_dim.width; x++) {
+        field.set(s32(x), s32(y), s32(z), get(x, y, z));
+      }
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F BlockVectorField::sampleTrilinear(const Vec3F &point) const {
+  if (empty()) {
+    return Vec3F::ZERO;
+  }
+
+  // Lower cell and fraction along each axis
+  const f32 cellX = clamp(point.x / m_cellSize, 0.0f, f32(m_dim.width - 1));
+  const f32 cellY = clamp(point.y / m_cellSize, 0.0f, f32(m_dim.height - 1));
+  const f32 cellZ = clamp(point.z / m_cellSize, 0.0f, f32(m_dim.depth - 1));
+  const u32 x0 = minValue(u32(cellX), maxValue(m_dim.width, 2u) - 2);
+  const u32 y0 = minValue(u32(cellY), maxValue(m_dim.height, 2u) - 2);
+  const u32 z0 = minValue(u32(cellZ), maxValue(m_dim.depth, 2u) - 2);
+  const u32 x1 = minValue(x0 + 1, m_dim.width - 1);
+  const u32 y1 = minValue(y0 + 1, m_dim.height - 1);
+  const u32 z1 = minValue(z0 + 1, m_dim.depth - 1);
+  const f32 fx = cellX - x0;
+  const f32 fy = cellY - y0;
+  const f32 fz = cellZ - z0;
+
+  // Interpolate along x, then y, then z
+  const Vec3F c00 = get(x0, y0, z0) * (1 - fx) + get(x1, y0, z0) * fx;
+  const Vec3F c10 = get(x0, y1, z0) * (1 - fx) + get(x1, y1, z0) * fx;
+  const Vec3F c01 = get(x0, y0, z1) * (1 - fx) + get(x1, y0, z1) * fx;
+  const Vec3F c11 = get(x0, y1, z1) * (1 - fx) + get(x1, y1, z1) * fx;
+  const Vec3F c0 = c00 * (1 - fy) + c10 * fy;
+  const Vec3F c1 = c01 * (1 - fy) + c11 * fy;
+  return c0 * (1 - fz) + c1 * fz;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BlockVectorField::save(const std::string &path) const {
+  MICROPROFILE_SCOPEI("BlockVectorField", "save", MP_ORANGE1);
+
+  std::vector<u8> buffer;
+  toBytes(buffer);
+  dutil::File file{};
+  dutil::File::Result res = file.Open(path, dutil::File::Mode::kWrite);
+  if (res == dutil::File::Result::kSuccess) {
+    res = file.Write(buffer);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to write block field {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BlockVectorField::load(const std::string &path) {
+  MICROPROFILE_SCOPEI("BlockVectorField", "load", MP_ORANGE1);
+
+  dutil::File file{};
+  dutil::File::Result res = file.Open(path, dutil::File::Mode::kRead);
+  std::vector<u8> buffer;
+  if (res == dutil::File::Result::kSuccess) {
+    res = file.Load(buffer);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to load block field {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  if (!fromBytes(buffer.data(), buffer.size())) {
+    DLOG_ERROR("block field {} is invalid", path);
+    return false;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+void BlockVectorField::toBytes(std::vector<u8> &buffer) const {
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.width = m_dim.width;
+  header.height = m_dim.height;
+  header.depth = m_dim.depth;
+  header.cellSize = m_cellSize;
+  header.bits = m_bits;
+
+  const u64 blocksSize = sizeof(Block) * m_blocks.size();
+  const u64 indicesSize = m_indices.size();
+  buffer.resize(sizeof(Header) + blocksSize + indicesSize);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  std::memcpy(buffer.data() + sizeof(Header), m_blocks.data(), blocksSize);
+  std::memcpy(buffer.data() + sizeof(Header) + blocksSize, m_indices.data(),
+              indicesSize);
+}
+
+// -------------------------------------------------------------------------- //
+
+bool BlockVectorField::fromBytes(const u8 *data, u64 size) {
+  // Validate header
+  Header header;
+  if (size < sizeof(Header)) {
+    DLOG_WARNING("block field is too small to contain a header");
+    *this = BlockVectorField{};
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(Header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    DLOG_WARNING("block field has an invalid magic number or version");
+    *this = BlockVectorField{};
+    return false;
+  }
+  if (header.width == 0 || header.height == 0 || header.depth == 0 ||
+      header.bits == 0 || header.bits > kMaxBits) {
+    DLOG_WARNING("block field has invalid dimensions or bits");
+    *this = BlockVectorField{};
+    return false;
+  }
+
+  // Read data
+  m_dim = FieldBase::Dim{header.width, header.height, header.depth};
+  m_cellSize = header.cellSize;
+  m_bits = header.bits;
+  allocate();
+  const u64 blocksSize = sizeof(Block) * m_blocks.size();
+  const u64 indicesSize = m_indices.size();
+  if (size < sizeof(Header) + blocksSize + indicesSize) {
+    DLOG_WARNING("block field is truncated");
+    *this = BlockVectorField{};
+    return false;
+  }
+  std::memcpy(m_blocks.data(), data + sizeof(Header), blocksSize);
+  std::memcpy(m_indices.data(), data + sizeof(Header) + blocksSize,
+              indicesSize);
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+void BlockVectorField::allocate() {
+  m_blocksX = (m_dim.width + kBlockSize - 1) / kBlockSize;
+  m_blocksY = (m_dim.height + kBlockSize - 1) / kBlockSize;
+  m_blocksZ = (m_dim.depth + kBlockSize - 1) / kBlockSize;
+  m_blockBytes = kBlockCells * 3 * m_bits / 8;
+  const u32 blockCount = m_blocksX * m_blocksY * m_blocksZ;
+  m_blocks.assign(blockCount, Block{});
+  m_indices.assign(u64(blockCount) * m_blockBytes + 1, 0);
+}
+
+} // namespace wind
@@ -0,0 +1,195 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/math/field.hpp"
+#include "shared/types.hpp"
+
+#include <string>
+#include <vector>
+
+// ========================================================================== //
+// BlockVectorField Declaration
+// ========================================================================== //
+
+namespace wind {
+
+WIND_FORWARD_DECLARE(VectorField);
+
+/// Block-compressed vector field.
+///
+/// The field is split into blocks of 4x4x4 cells. Each block stores the
+/// minimum of each component and the step between quantisation levels, and
+/// each cell stores a 'bits'-bit index per component. With 4 bits this is
+/// 120 bytes per block instead of the 768 bytes of three f32 per cell.
+///
+/// Every cell can be decoded on its own, with one block lookup and three bit
+/// reads, which makes the field suitable for sampling in the hot path.
+class BlockVectorField {
+public:
+  /// Magic number at the start of each file ("WBLK")
+  static constexpr u32 kMagic = 0x4B4C4257u;
+  /// Current version of the format
+  static constexpr u32 kVersion = 1u;
+  /// Number of cells along each axis of a block
+  static constexpr u32 kBlockSize = 4u;
+  /// Number of cells in a block
+  static constexpr u32 kBlockCells = kBlockSize * kBlockSize * kBlockSize;
+  /// Default number of bits per component
+  static constexpr u32 kDefaultBits = 4u;
+  /// Largest number of bits per component
+  static constexpr u32 kMaxBits = 8u;
+
+  /// Range of a block
+  struct Block {
+    /// Minimum of each component
+    f32 min[3];
+    /// Step between two quantisation levels of each component
+    f32 step[3];
+  };
+
+  /// Header of a file. The header is followed by the blocks and then the
+  /// packed indices.
+  struct Header {
+    /// Magic number, must be 'kMagic'
+    u32 magic;
+    /// Version of the format, must be 'kVersion'
+    u32 version;
+    /// Width of the field in cells
+    u32 width;
+    /// Height of the field in cells
+    u32 height;
+    /// Depth of the field in cells
+    u32 depth;
+    /// Size of a cell in meters
+    f32 cellSize;
+    /// Number of bits per component
+    u32 bits;
+  };
+
+public:
+  /// Construct empty field
+  BlockVectorField() = default;
+
+  /// Encode a vector field with 'bits' bits per component, which is clamped
+  /// to [1, kMaxBits].
+  /// @return Largest error of any component.
+  f32 encode(const VectorField &field, u32 bits = kDefaultBits);
+
+  /// Decode the whole field into 'field', which must have the same
+  /// dimensions.
+  void decode(VectorField &field) const;
+
+  /// Decode a single cell
+  Vec3F get(u32 x, u32 y, u32 z) const {
+    const u32 block =
+        (x / kBlockSize) +
+        m_blocksX * ((y / kBlockSize) + m_blocksY * (z / kBlockSize));
+    const u32 cell = (x % kBlockSize) +
+                     kBlockSize * ((y % kBlockSize) +
+                                   kBlockSize * (z % kBlockSize));
+    const Block &b = m_blocks[block];
+    const u8 *indices = m_indices.data() + block * m_blockBytes;
+    const u32 bit = cell * 3 * m_bits;
+    return Vec3F(b.min[0] + b.step[0] * readIndex(indices, bit),
+                 b.min[1] + b.step[1] * readIndex(indices, bit + m_bits),
+                 b.min[2] + b.step[2] * readIndex(indices, bit + 2 * m_bits));
+  }
+
+  /// Sample the field at a point in local meters with trilinear
+  /// interpolation. The point is clamped to the field, like for
+  /// 'VectorField::sampleTrilinear'.
+  Vec3F sampleTrilinear(const Vec3F &point) const;
+
+  /// Save the field to a file
+  bool save(const std::string &path) const;
+
+  /// Load the field from a file
+  bool load(const std::string &path);
+
+  /// Write the field to a buffer, in the same format as 'save'
+  void toBytes(std::vector<u8> &buffer) const;
+
+  /// Read the field from a buffer that was written by 'toBytes'. The field is
+  /// left empty if the buffer is invalid.
+  /// \return True if the field was read.
+  bool fromBytes(const u8 *data, u64 size);
+
+  /// Returns whether the field is empty
+  bool empty() const { return m_blocks.empty(); }
+
+  /// Returns the dimensions of the field
+  const FieldBase::Dim &getDim() const { return m_dim; }
+
+  /// Returns the size of a cell in meters
+  f32 getCellSize() const { return m_cellSize; }
+
+  /// Returns the number of bits per component
+  u32 getBits() const { return m_bits; }
+
+  /// Returns the size of the encoded field in bytes
+  u64 getSize() const {
+    return sizeof(Block) * m_blocks.size() + m_indices.size();
+  }
+
+private:
+  /// Read an index of 'm_bits' bits that starts at bit 'bit'. Indices may
+  /// straddle two bytes, which is why the index buffer is padded by one byte.
+  u32 readIndex(const u8 *indices, u32 bit) const {
+    const u32 byte = bit / 8;
+    const u32 word = u32(indices[byte]) | (u32(indices[byte + 1]) << 8u);
+    return (word >> (bit % 8)) & ((1u << m_bits) - 1u);
+  }
+
+  /// Resize the storage for the current dimensions and bits
+  void allocate();
+
+private:
+  /// Dimensions of the field
+  FieldBase::Dim m_dim{0, 0, 0};
+  /// Size of a cell in meters
+  f32 m_cellSize = 1.0f;
+  /// Number of bits per component
+  u32 m_bits = kDefaultBits;
+  /// Number of blocks along the x axis
+  u32 m_blocksX = 0;
+  /// Number of blocks along the y axis
+  u32 m_blocksY = 0;
+  /// Number of blocks along the z axis
+  u32 m_blocksZ = 0;
+  /// Number of bytes of indices per block
+  u32 m_blockBytes = 0;
+
+  /// Range of each block
+  std::vector<Block> m_blocks;
+  /// Packed indices of each block, 3 per cell
+  std::vector<u8> m_indices;
+};
+
+} // namespace wind
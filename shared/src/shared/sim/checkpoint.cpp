@@ -0,0 +1,384 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "shared/sim/checkpoint.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/sim/wind_sim.hpp"
+#include "thirdparty/dutil/file.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <dlog/dlog.hpp>
+
+#include <cstring>
+#include <fstream>
+
+// ========================================================================== //
+// Checkpoint Implementation
+// ========================================================================== //
+
+namespace wind {
+
+namespace {
+
+/// Align an offset up to the checkpoint alignment
+u64 alignOffset(u64 offset) {
+  const u64 alignment = Checkpoint::kAlignment;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Copy field data into a section of a checkpoint buffer
+template <typename T>
+void writeSection(std::vector<u8> &buffer, u64 offset, const T *data,
+                  u32 count) {
+  std::memcpy(buffer.data() + offset, data, sizeof(T) * count);
+}
+
+} // namespace
+
+// -------------------------------------------------------------------------- //
+
+void Checkpoint::write(const WindSimulation &sim, std::vector<u8> &buffer) {
+  MICROPROFILE_SCOPEI("Checkpoint", "write", MP_ORANGE1);
+
+  const FieldBase::Dim &dim = sim.m_v.getDim();
+  const u32 cellCount = sim.m_v.getCellCount();
+  const bool density = sim.hasDensity();
+
+  // Header
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.flags = (density ? kFlagDensity : 0u) |
+                 (sim.m_densityDiffusionActive ? kFlagDensityDiffusion : 0u) |
+                 (sim.m_densityAdvectionActive ? kFlagDensityAdvection : 0u) |
+                 (sim.m_velocityDiffusionActive ? kFlagVelocityDiffusion : 0u) |
+                 (sim.m_velocityAdvectionActive ? kFlagVelocityAdvection : 0u);
+  header.width = dim.width;
+  header.height = dim.height;
+  header.depth = dim.depth;
+  header.cellSize = sim.m_cellSize;
+  header.diffusion = sim.m_diffusion;
+  header.viscosity = sim.m_viscosity;
+  for (u32 face = 0; face < DomainBoundary::kFaceCount; face++) {
+    const Vec3F &inflow = sim.m_boundary.inflow[face];
+    header.conditions[face] = u32(sim.m_boundary.conditions[face]);
+    header.inflow[face * 3 + 0] = inflow.x;
+    header.inflow[face * 3 + 1] = inflow.y;
+    header.inflow[face * 3 + 2] = inflow.z;
+  }
+
+  // Layout sections
+  u64 offset = alignOffset(sizeof(Header));
+  for (u32 section = 0; section < kSectionCount; section++) {
+    const bool densitySection = section == kDens || section == kDens0;
+    if (densitySection && !density) {
+      continue;
+    }
+    header.offsets[section] = offset;
+    const u64 elementSize = section == kObstr ? sizeof(bool) : sizeof(f32);
+    const u64 elementCount =
+        section == kObstrFaces ? 3u * cellCount : cellCount;
+    offset = alignOffset(offset + elementSize * elementCount);
+  }
+  header.size = offset;
+
+  // Write header and sections
+  buffer.resize(header.size);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  if (density) {
+    writeSection(buffer, header.offsets[kDens], sim.m_d->data(), cellCount);
+    writeSection(buffer, header.offsets[kDens0], sim.m_d0->data(), cellCount);
+  }
+  writeSection(buffer, header.offsets[kVelX], sim.m_v.getX()->data(),
+               cellCount);
+  writeSection(buffer, header.offsets[kVelY], sim.m_v.getY()->data(),
+               cellCount);
+  writeSection(buffer, header.offsets[kVelZ], sim.m_v.getZ()->data(),
+               cellCount);
+  writeSection(buffer, header.offsets[kVel0X], sim.m_v0.getX()->data(),
+               cellCount);
+  writeSection(buffer, header.offsets[kVel0Y], sim.m_v0.getY()->data(),
+               cellCount);
+  writeSection(buffer, header.offsets[kVel0Z], sim.m_v0.getZ()->data(),
+               cellCount);
+  writeSection(buffer, header.offsets[kObstr], sim.m_o.data(), cellCount);
+  writeSection(buffer, header.offsets[kObstrFaces], sim.m_o.getFaces(),
+               3u * cellCount);
+}
+
+// -------------------------------------------------------------------------- //
+
+bool Checkpoint::validate(const WindSimulation &sim, const Header &header,
+                          u64 size) {
+  if (header.magic != kMagic) {
+    DLOG_ERROR("checkpoint has an invalid magic number");
+    return false;
+  }
+  if (header.version != kVersion) {
+    DLOG_ERROR("checkpoint has version {}, expected version {}",
+               header.version, kVersion);
+    return false;
+  }
+  if (header.size > size) {
+    DLOG_ERROR("checkpoint is truncated ({} of {} bytes)", size, header.size);
+    return false;
+  }
+  const FieldBase::Dim dim{header.width, header.height, header.depth};
+  if (dim != sim.m_v.getDim() || header.cellSize != sim.m_cellSize) {
+    DLOG_ERROR("checkpoint dimensions ({}, {}, {}) do not match simulation",
+               dim.width, dim.height, dim.depth);
+    return false;
+  }
+  for (u32 face = 0; face < DomainBoundary::kFaceCount; face++) {
+    if (header.conditions[face] > u32(DomainCondition::kPeriodic)) {
+      DLOG_ERROR("checkpoint has an invalid domain condition {}",
+                 header.conditions[face]);
+      return false;
+    }
+  }
+
+  // Every section that is read must lie within the data, so that nothing is
+  // written to the simulation unless the entire checkpoint can be restored
+  const u64 cellCount = sim.m_v.getCellCount();
+  const bool density = sim.hasDensity() && (header.flags & kFlagDensity);
+  for (u32 section = 0; section < kSectionCount; section++) {
+    const bool densitySection = section == kDens || section == kDens0;
+    if (densitySection && !density) {
+      continue;
+    }
+    const u64 elementSize = section == kObstr ? sizeof(bool) : sizeof(f32);
+    const u64 bytes =
+        elementSize * (section == kObstrFaces ? 3u * cellCount : cellCount);
+    const u64 offset = header.offsets[section];
+    if (offset < sizeof(Header) || offset > header.size ||
+        header.size - offset < bytes) {
+      DLOG_ERROR("checkpoint section {} at offset {} is outside of its data",
+                 section, offset);
+      return false;
+    }
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+template <typename Read>
+bool Checkpoint::readSections(WindSimulation &sim, const Header &header,
+                              Read &&read) {
+  // Restore fields
+  const u32 cellCount = sim.m_v.getCellCount();
+  const u64 bytes = sizeof(f32) * u64(cellCount);
+  bool valid = read(kVelX, sim.m_v.getX()->data(), bytes) &&
+               read(kVelY, sim.m_v.getY()->data(), bytes) &&
+               read(kVelZ, sim.m_v.getZ()->data(), bytes) &&
+               read(kVel0X, sim.m_v0.getX()->data(), bytes) &&
+               read(kVel0Y, sim.m_v0.getY()->data(), bytes) &&
+               read(kVel0Z, sim.m_v0.getZ()->data(), bytes) &&
+               read(kObstr, sim.m_o.data(), sizeof(bool) * u64(cellCount)) &&
+               read(kObstrFaces, sim.m_o.getFaces(), 3u * bytes);
+  if (valid && sim.hasDensity() && (header.flags & kFlagDensity)) {
+    valid = read(kDens, sim.m_d->data(), bytes) &&
+            read(kDens0, sim.m_d0->data(), bytes);
+  }
+  // The faces were written in place, so the partial coverage state of the
+  // field must be brought up to date
+  sim.m_o.updatePartialCells();
+  if (!valid) {
+    DLOG_ERROR("failed to read checkpoint sections");
+    return false;
+  }
+
+  // Restore parameters
+  sim.m_diffusion = header.diffusion;
+  sim.m_viscosity = header.viscosity;
+  sim.m_densityDiffusionActive = header.flags & kFlagDensityDiffusion;
+  sim.m_densityAdvectionActive = header.flags & kFlagDensityAdvection;
+  sim.m_velocityDiffusionActive = header.flags & kFlagVelocityDiffusion;
+  sim.m_velocityAdvectionActive = header.flags & kFlagVelocityAdvection;
+  for (u32 face = 0; face < DomainBoundary::kFaceCount; face++) {
+    sim.m_boundary.conditions[face] = DomainCondition(header.conditions[face]);
+    sim.m_boundary.inflow[face] =
+        Vec3F(header.inflow[face * 3 + 0], header.inflow[face * 3 + 1],
+              header.inflow[face * 3 + 2]);
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool Checkpoint::restore(WindSimulation &sim, const u8 *data, u64 size) {
+  MICROPROFILE_SCOPEI("Checkpoint", "restore", MP_ORANGE1);
+
+  if (size < sizeof(Header)) {
+    DLOG_ERROR("checkpoint is too small to contain a header");
+    return false;
+  }
+  Header header;
+  std::memcpy(&header, data, sizeof(Header));
+  if (!validate(sim, header, size)) {
+    return false;
+  }
+
+  return readSections(sim, header, [&](Section section, void *out, u64 bytes) {
+    std::memcpy(out, data + header.offsets[section], bytes);
+    return true;
+  });
+}
+
+// -------------------------------------------------------------------------- //
+
+bool Checkpoint::save(const WindSimulation &sim, const std::string &path) {
+  std::vector<u8> buffer;
+  write(sim, buffer);
+  return writeFile(buffer, path);
+}
+
+// -------------------------------------------------------------------------- //
+
+bool Checkpoint::load(WindSimulation &sim, const std::string &path) {
+  MICROPROFILE_SCOPEI("Checkpoint", "load", MP_ORANGE1);
+
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    DLOG_ERROR("failed to open checkpoint {}", path);
+    return false;
+  }
+  stream.seekg(0, std::ios::end);
+  const u64 size = u64(stream.tellg());
+  stream.seekg(0, std::ios::beg);
+
+  Header header;
+  if (size < sizeof(Header) ||
+      !stream.read(reinterpret_cast<char *>(&header), sizeof(Header))) {
+    DLOG_ERROR("checkpoint {} is too small to contain a header", path);
+    return false;
+  }
+  if (!validate(sim, header, size)) {
+    return false;
+  }
+
+  // Each section is read straight into the field that it belongs to
+  return readSections(sim, header, [&](Section section, void *out, u64 bytes) {
+    stream.seekg(std::streamoff(header.offsets[section]), std::ios::beg);
+    return bool(stream.read(static_cast<char *>(out), std::streamsize(bytes)));
+  });
+}
+
+// -------------------------------------------------------------------------- //
+
+bool Checkpoint::writeFile(const std::vector<u8> &buffer,
+                           const std::string &path) {
+  MICROPROFILE_SCOPEI("Checkpoint", "writeFile", MP_ORANGE1);
+
+  const std::string tmpPath = path + ".tmp";
+  dutil::File::Result res;
+  {
+    dutil::File file{};
+    res = file.Open(tmpPath, dutil::File::Mode::kWrite);
+    if (res == dutil::File::Result::kSuccess) {
+      res = file.Write(buffer);
+    }
+  }
+  if (res == dutil::File::Result::kSuccess) {
+    if (dutil::File::FileExists(path)) {
+      dutil::File::Remove(path);
+    }
+    res = dutil::File::Rename(tmpPath, path);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to write checkpoint {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  return true;
+}
+
+} // namespace wind
+
+// ========================================================================== //
+// CheckpointWriter Implementation
+// ========================================================================== //
+
+namespace wind {
+
+CheckpointWriter::CheckpointWriter() : m_thread([this]() { run(); }) {}
+
+// -------------------------------------------------------------------------- //
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_condition.notify_one();
+  m_thread.join();
+}
+
+// -------------------------------------------------------------------------- //
+
+bool CheckpointWriter::write(const WindSimulation &sim,
+                             const std::string &path) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_busy) {
+      return false;
+    }
+  }
+
+  // The background thread does not touch the buffer while not busy
+  Checkpoint::write(sim, m_buffer);
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_path = path;
+    m_busy = true;
+  }
+  m_condition.notify_one();
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+void CheckpointWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_condition.wait(lock, [this]() { return m_busy || !m_running; });
+    if (m_busy) {
+      const std::string path = m_path;
+      lock.unlock();
+      Checkpoint::writeFile(m_buffer, path);
+      lock.lock();
+      m_busy = false;
+    } else {
+      break;
+    }
+  }
+}
+
+} // namespace wind
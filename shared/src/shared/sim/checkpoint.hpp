@@ -0,0 +1,217 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/sim/stencil.hpp"
+#include "shared/types.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ========================================================================== //
+// Checkpoint Declaration
+// ========================================================================== //
+
+namespace wind {
+
+WIND_FORWARD_DECLARE(WindSimulation);
+
+/// Binary checkpoint of the state of a wind simulation.
+///
+/// A checkpoint consists of a fixed-size header, which also holds the
+/// conditions at the faces of the domain, followed by the raw data of each
+/// field ('m_d', 'm_d0', the components of 'm_v' and 'm_v0', and 'm_o'
+/// along with the open fraction of its faces).
+/// Each field is stored at an offset recorded in the header that is aligned to
+/// 'kAlignment' bytes. Data is stored in the native byte order.
+///
+/// Restoring a checkpoint does not parse anything. The header is validated and
+/// the field data is copied straight into the simulation. This means that the
+/// data can be restored directly from a memory-mapped file.
+class Checkpoint {
+public:
+  /// Magic number at the start of each checkpoint ("WSCP")
+  static constexpr u32 kMagic = 0x50435357u;
+  /// Current version of the checkpoint format
+  static constexpr u32 kVersion = 3u;
+  /// Alignment of each section of field data
+  static constexpr u32 kAlignment = 64u;
+
+  /// Sections of field data in a checkpoint
+  enum Section : u32 {
+    kDens = 0,
+    kDens0,
+    kVelX,
+    kVelY,
+    kVelZ,
+    kVel0X,
+    kVel0Y,
+    kVel0Z,
+    kObstr,
+    kObstrFaces,
+    kSectionCount
+  };
+
+  /// Flags that are stored in the header of a checkpoint
+  enum Flag : u32 {
+    kFlagDensity = 1u << 0u,
+    kFlagDensityDiffusion = 1u << 1u,
+    kFlagDensityAdvection = 1u << 2u,
+    kFlagVelocityDiffusion = 1u << 3u,
+    kFlagVelocityAdvection = 1u << 4u,
+  };
+
+  /// Header of a checkpoint
+  struct Header {
+    /// Magic number, must be 'kMagic'
+    u32 magic;
+    /// Version of the format, must be 'kVersion'
+    u32 version;
+    /// Combination of 'Flag' values
+    u32 flags;
+    /// Width of the fields in cells, including boundary cells
+    u32 width;
+    /// Height of the fields in cells, including boundary cells
+    u32 height;
+    /// Depth of the fields in cells, including boundary cells
+    u32 depth;
+    /// Size of a cell in meters
+    f32 cellSize;
+    /// Diffusion rate of the simulation
+    f32 diffusion;
+    /// Viscosity of the simulation
+    f32 viscosity;
+    /// Condition at each face of the domain, as 'DomainCondition' values
+    u32 conditions[DomainBoundary::kFaceCount];
+    /// Inflow velocity at each face of the domain (x, y and z interleaved)
+    f32 inflow[DomainBoundary::kFaceCount * 3];
+    /// Padding so that the offsets are 8-byte aligned
+    u32 padding;
+    /// Offset of each section from the start of the checkpoint. The density
+    /// sections are zero when the checkpoint has no density.
+    u64 offsets[kSectionCount];
+    /// Size of the entire checkpoint in bytes
+    u64 size;
+  };
+
+public:
+  /// Write the state of a simulation into a buffer. The buffer is resized to
+  /// fit the checkpoint.
+  static void write(const WindSimulation &sim, std::vector<u8> &buffer);
+
+  /// Restore the state of a simulation from checkpoint data. Density is only
+  /// restored if the simulation currently has a density field.
+  /// \pre Simulation must have the same dimensions as the checkpoint.
+  /// \return True if the checkpoint was valid and restored, otherwise false.
+  static bool restore(WindSimulation &sim, const u8 *data, u64 size);
+
+  /// Save a checkpoint of a simulation to a file
+  static bool save(const WindSimulation &sim, const std::string &path);
+
+  /// Load a checkpoint from a file into a simulation. The field data is read
+  /// from the file straight into the fields of the simulation.
+  static bool load(WindSimulation &sim, const std::string &path);
+
+  /// Write a checkpoint buffer to a file. The data is written to a temporary
+  /// file that then replaces the target, so that a previous checkpoint is
+  /// never left half-written.
+  static bool writeFile(const std::vector<u8> &buffer,
+                        const std::string &path);
+
+private:
+  /// Validate a checkpoint header against a simulation and the size of the
+  /// checkpoint data. This includes checking that every section that would be
+  /// restored lies within the data.
+  static bool validate(const WindSimulation &sim, const Header &header,
+                       u64 size);
+
+  /// Read the sections of a checkpoint into a simulation and restore its
+  /// parameters. 'read(section, out, bytes)' copies the data of a section to
+  /// 'out' and returns false if it could not be read.
+  /// \pre The header must have been validated.
+  template <typename Read>
+  static bool readSections(WindSimulation &sim, const Header &header,
+                           Read &&read);
+};
+
+} // namespace wind
+
+// ========================================================================== //
+// CheckpointWriter Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Writes checkpoints of a simulation to file from a background thread.
+///
+/// The state of the simulation is copied into a buffer on the calling thread,
+/// which is cheap compared to a step, and the buffer is then written to file
+/// by the background thread.
+class CheckpointWriter {
+public:
+  /// Construct writer and start the background thread
+  CheckpointWriter();
+
+  /// Destruct writer. Waits for any pending checkpoint to be written.
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter &other) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &other) = delete;
+
+  /// Copy the state of the simulation and write it to a file in the
+  /// background. If the previous checkpoint is still being written then no
+  /// checkpoint is taken.
+  /// \return True if a checkpoint was taken.
+  bool write(const WindSimulation &sim, const std::string &path);
+
+private:
+  /// Run the background thread
+  void run();
+
+private:
+  /// Buffer that the state is copied into
+  std::vector<u8> m_buffer;
+  /// Path to write the pending checkpoint to
+  std::string m_path;
+  /// Whether a checkpoint is pending or being written
+  bool m_busy = false;
+  /// Whether the background thread should keep running
+  bool m_running = true;
+
+  /// Mutex for the state above
+  std::mutex m_mutex;
+  /// Condition variable that the background thread waits on
+  std::condition_variable m_condition;
+  /// Background thread
+  std::thread m_thread;
+};
+
+} // namespace wind
@@ -26,6 +26,8 @@
 // Headers
 // ========================================================================== //
 
+#include <algorithm>
+#include <cmath>
 #include <dlog/dlog.hpp>
 #include <vector>
 
@@ -68,7 +70,8 @@ void DeltaField::build(const HCSim &csim, const HCWind &cwind) {
       for (u32 i = 0; i < dim.width; i++) {
         Vec3F vSim = sim->V().get(i + 1, j + 1, k + 1);
         Vec3F vBake = cwind->getWindAtPoint(
-            Vec3F(i + 1.0f, j + 1.0f, k + 1.0f) * sim->getCellSize());
+            Vec3F(i + 1.0f, j + 1.0f, k + 1.0f) * sim->getCellSize() +
+            csim->getOrigin());
         const bool obs = sim->O().get(i, j, k);
         m_delta->set(i, j, k, obs ? Vec3F::ZERO : vBake - vSim);
         m_sim->set(i, j, k, vSim);
@@ -114,6 +117,27 @@ f32 DeltaField::getError() const {
   return error / count;
 }
 
+f32 DeltaField::getErrorPercentile(f32 percentile) const {
+  const FieldBase::Dim dim = m_delta->getDim();
+  std::vector<f32> errors;
+  errors.reserve(dim.width * dim.height * dim.depth);
+  for (u32 k = 0; k < dim.depth; k++) {
+    for (u32 j = 0; j < dim.height; j++) {
+      for (u32 i = 0; i < dim.width; i++) {
+        errors.push_back(m_delta->get(i, j, k).length());
+      }
+    }
+  }
+  if (errors.empty()) {
+    return 0.0f;
+  }
+  const f32 rank = clamp(percentile, 0.0f, 100.0f) / 100.0f *
+                   f32(errors.size() - 1);
+  const auto nth = errors.begin() + std::ptrdiff_t(std::lround(rank));
+  std::nth_element(errors.begin(), nth, errors.end());
+  return *nth;
+}
+
 DeltaField::BoxPlot DeltaField::boxPlot() {
   // Create sorted list of errors
   const FieldBase::Dim dim = m_delta->getDim();
@@ -64,6 +64,10 @@ public:
 
   f32 getError() const;
 
+  /// Returns the error (length of the delta) that 'percentile' percent of the
+  /// cells are at or below
+  f32 getErrorPercentile(f32 percentile) const;
+
   BoxPlot boxPlot();
 
   /// Paint delta field
@@ -33,6 +33,8 @@
 #include <Debug/BsDebugDraw.h>
 #include <Physics/BsPhysics.h>
 
+#include <algorithm>
+
 // ========================================================================== //
 // VectorField Implementation
 // ========================================================================== //
@@ -41,7 +43,7 @@ namespace wind {
 
 ObstructionField::ObstructionField(u32 width, u32 height, u32 depth,
                                    f32 cellsize)
-    : Field(width, height, depth, cellsize) {
+    : Field(width, height, depth, cellsize), m_faces(m_cellCount * 3, 1.0f) {
   using namespace bs;
   for (u32 i = 0; i < m_cellCount; i++) {
     m_data[i] = false;
@@ -58,6 +60,21 @@ void ObstructionField::buildForScene(
   // Physics scene
   const SPtr<PhysicsScene> physicsScene = scene->getPhysicsScene();
 
+  // Start from an open field, so that the field can be rebuilt after the
+  // scene has changed
+  for (u32 i = 0; i < m_cellCount; i++) {
+    m_data[i] = false;
+  }
+  std::fill(m_faces.begin(), m_faces.end(), 1.0f);
+  m_partialCells.clear();
+
+  // Sub-cells of each cell that are covered, one bit per sub-cell
+  constexpr u32 kSamples = kCoverageSamples;
+  constexpr u32 kSubCells = kSamples * kSamples * kSamples;
+  static_assert(kSubCells <= 32, "Sub-cells of a cell must fit in 32 bits");
+  std::vector<u32> covered(m_cellCount, 0u);
+  const f32 subSize = m_cellSize / kSamples;
+
   // Check for collisions in each cell
   for (u32 z = 0; z < m_dim.depth; z++) {
     const f32 zPos = position.z + (z * m_cellSize);
@@ -65,16 +82,130 @@ void ObstructionField::buildForScene(
       const f32 yPos = position.y + (y * m_cellSize);
       for (u32 x = 0; x < m_dim.width; x++) {
         const f32 xPos = position.x + (x * m_cellSize);
-        const f32 offMin = 0.05f * m_cellSize;
-        const f32 offMax = 0.95f * m_cellSize;
+        const f32 offMin = 0.01f * m_cellSize;
+        const f32 offMax = 0.99f * m_cellSize;
         AABox aabb{Vector3(xPos + offMin, yPos + offMin, zPos + offMin),
                    Vector3(xPos + offMax, yPos + offMax, zPos + offMax)};
-        if (physicsScene->boxOverlapAny(aabb, Quaternion::IDENTITY)) {
+        if (!physicsScene->boxOverlapAny(aabb, Quaternion::IDENTITY)) {
+          continue;
+        }
+        if (m_coverageRule == CoverageRule::kAny) {
           get(x, y, z) = true;
+          continue;
+        }
+
+        // Sample sub-cells of cells that overlap
+        u32 &mask = covered[fromPos(x, y, z)];
+        u32 count = 0;
+        for (u32 i = 0; i < kSubCells; i++) {
+          const Vector3 subPos(xPos + (i % kSamples) * subSize,
+                               yPos + (i / kSamples % kSamples) * subSize,
+                               zPos + (i / (kSamples * kSamples)) * subSize);
+          AABox subBox{subPos + Vector3::ONE * (0.05f * subSize),
+                       subPos + Vector3::ONE * (0.95f * subSize)};
+          if (physicsScene->boxOverlapAny(subBox, Quaternion::IDENTITY)) {
+            mask |= 1u << i;
+            count++;
+          }
+        }
+        get(x, y, z) = count * 2 >= kSubCells;
+      }
+    }
+  }
+
+  // Open fraction of faces. A line of sub-cells through the face, from the
+  // center of one cell to the center of the other, is open if none of its
+  // sub-cells are covered.
+  const auto subCell = [](u32 axis, u32 along, u32 a, u32 b) {
+    u32 pos[3];
+    pos[axis] = along;
+    pos[(axis + 1) % 3] = a;
+    pos[(axis + 2) % 3] = b;
+    return 1u << (pos[0] + kSamples * (pos[1] + kSamples * pos[2]));
+  };
+  const u32 steps[3] = {1, m_dim.width, m_dim.width * m_dim.height};
+  for (u32 offset = 0; offset < m_cellCount; offset++) {
+    const Pos pos = fromOffset(offset);
+    const s32 bounds[3] = {s32(m_dim.width), s32(m_dim.height),
+                           s32(m_dim.depth)};
+    const s32 coords[3] = {pos.x, pos.y, pos.z};
+    for (u32 axis = 0; axis < 3; axis++) {
+      if (coords[axis] + 1 >= bounds[axis]) {
+        continue;
+      }
+      const u32 mask0 = covered[offset];
+      const u32 mask1 = covered[offset + steps[axis]];
+      if (mask0 == 0 && mask1 == 0) {
+        continue;
+      }
+
+      u32 open = 0;
+      for (u32 a = 0; a < kSamples; a++) {
+        for (u32 b = 0; b < kSamples; b++) {
+          bool blocked = false;
+          for (u32 along = kSamples / 2; along < kSamples; along++) {
+            blocked |= (mask0 & subCell(axis, along, a, b)) != 0;
+          }
+          for (u32 along = 0; along <= kSamples / 2; along++) {
+            blocked |= (mask1 & subCell(axis, along, a, b)) != 0;
+          }
+          open += blocked ? 0 : 1;
+        }
+      }
+      m_faces[offset * 3 + axis] = f32(open) / f32(kSamples * kSamples);
+    }
+  }
+  updatePartialCells();
+}
+
+// -------------------------------------------------------------------------- //
+
+void ObstructionField::setOpen(u32 axis, u32 offset, f32 open) {
+  m_faces[offset * 3 + axis] = open;
+  if (open < 1.0f) {
+    const u32 steps[3] = {1, m_dim.width, m_dim.width * m_dim.height};
+    const auto insert = [this](u32 cell) {
+      const auto it =
+          std::lower_bound(m_partialCells.begin(), m_partialCells.end(), cell);
+      if (it == m_partialCells.end() || *it != cell) {
+        m_partialCells.insert(it, cell);
+      }
+    };
+    insert(offset);
+    if (offset + steps[axis] < m_cellCount) {
+      insert(offset + steps[axis]);
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void ObstructionField::setFaces(const f32 *faces) {
+  std::copy(faces, faces + m_cellCount * 3, m_faces.begin());
+  updatePartialCells();
+}
+
+// -------------------------------------------------------------------------- //
+
+void ObstructionField::updatePartialCells() {
+  // Cells are collected in any order and sorted once, as inserting each cell
+  // in order is quadratic in the number of partial cells
+  m_partialCells.clear();
+  const u32 steps[3] = {1, m_dim.width, m_dim.width * m_dim.height};
+  for (u32 offset = 0; offset < m_cellCount; offset++) {
+    for (u32 axis = 0; axis < 3; axis++) {
+      if (m_faces[offset * 3 + axis] < 1.0f) {
+        m_partialCells.push_back(offset);
+        if (offset + steps[axis] < m_cellCount) {
+          m_partialCells.push_back(offset + steps[axis]);
         }
       }
     }
   }
+  std::sort(m_partialCells.begin(), m_partialCells.end());
+  m_partialCells.erase(
+      std::unique(m_partialCells.begin(), m_partialCells.end()),
+      m_partialCells.end());
 }
 
 // -------------------------------------------------------------------------- //
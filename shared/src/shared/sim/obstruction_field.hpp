@@ -31,6 +31,8 @@
 
 #include <Scene/BsSceneManager.h>
 
+#include <vector>
+
 // ========================================================================== //
 // VectorField Declaration
 // ========================================================================== //
@@ -39,20 +41,128 @@ namespace wind {
 
 /// Class that represents an obstruction field. This field represents whether
 /// or not a cell has an obstruction in it.
+///
+/// In addition to whether a cell is obstructed, the field stores the fraction
+/// of each face between two cells that is open to flow. This lets geometry
+/// that only partially covers cells (thin walls, diagonal surfaces) affect the
+/// flow without requiring a smaller cell size. Faces next to an obstructed cell
+/// are always closed.
 class ObstructionField : public Field<bool> {
+public:
+  /// Number of samples along each axis of a cell that is used to determine
+  /// the coverage of cells when building for a scene.
+  static constexpr u32 kCoverageSamples = 3;
+
+  /// Rule that decides which cells are obstructed when building for a scene
+  enum class CoverageRule {
+    /// Cells that overlap any object are obstructed. All faces between open
+    /// cells are fully open.
+    kAny,
+    /// Cells that are at least half covered are obstructed. The faces of the
+    /// cells that are covered less are given the fraction that is open, which
+    /// means that thin objects only block part of the flow.
+    kHalf
+  };
+
+  /// Cell that is obstructed by a moving body
+  struct MovingCell {
+    /// Offset of the cell
+    u32 offset;
+    /// Velocity of the body (m/s)
+    Vec3F velocity;
+  };
+
 public:
   // Construct an obstruction field with the specified 'width', 'height' and
   // 'depth' (in number of cells). The size of a cell (in meters) can also be
   // specified.
   ObstructionField(u32 width, u32 height, u32 depth, f32 cellsize = 1.0f);
 
-  ///
+  /// Build the field for the physics objects in a scene. Which cells are
+  /// obstructed is decided by the coverage rule. With 'CoverageRule::kHalf'
+  /// each cell that overlaps an object is sampled with 'kCoverageSamples'
+  /// cubed sub-cells. A cell is obstructed if at least half of the sub-cells
+  /// are, otherwise the open fraction of the faces of the cell are determined
+  /// from the sub-cells.
   void buildForScene(const bs::SPtr<bs::SceneInstance> &scene,
                      const bs::Vector3 &position = bs::Vector3());
 
+  /// Returns the open fraction of the face between the cell at 'offset' and
+  /// its neighbor in the positive direction along an axis (0 = x, 1 = y,
+  /// 2 = z). The data offset between the neighbors is given by 'step'.
+  f32 getOpen(u32 axis, u32 step, u32 offset) const {
+    return m_data[offset] || m_data[offset + step]
+               ? 0.0f
+               : m_faces[offset * 3 + axis];
+  }
+
+  /// Returns whether the face between the cell at 'offset' and its neighbor
+  /// in the positive direction along an axis has no open fraction. Unlike
+  /// 'getOpen' this does not depend on whether the cells are obstructed.
+  bool isFaceClosed(u32 axis, u32 offset) const {
+    return m_faces[offset * 3 + axis] <= 0.0f;
+  }
+
+  /// Set the open fraction of the face between the cell at 'offset' and its
+  /// neighbor in the positive direction along an axis.
+  void setOpen(u32 axis, u32 offset, f32 open);
+
+  /// Returns the open fraction of the three positive faces of each cell (x, y
+  /// and z interleaved)
+  const f32 *getFaces() const { return m_faces.data(); }
+
+  /// Returns the open fraction of the three positive faces of each cell (x, y
+  /// and z interleaved). 'updatePartialCells' must be called after writing to
+  /// the faces.
+  f32 *getFaces() { return m_faces.data(); }
+
+  /// Set the open fraction of the three positive faces of each cell (x, y and
+  /// z interleaved)
+  void setFaces(const f32 *faces);
+
+  /// Update which cells have partially open faces from the faces
+  void updatePartialCells();
+
+  /// Returns whether any face is partially open. The solver only uses the
+  /// open fractions when this is the case.
+  bool hasPartialCoverage() const { return !m_partialCells.empty(); }
+
+  /// Returns the offsets of the cells that have at least one partially open
+  /// face, in ascending order
+  const std::vector<u32> &getPartialCells() const { return m_partialCells; }
+
+  /// Set the rule that decides which cells are obstructed when building for a
+  /// scene. Defaults to 'CoverageRule::kAny'.
+  void setCoverageRule(CoverageRule rule) { m_coverageRule = rule; }
+
+  /// Returns the rule that decides which cells are obstructed
+  CoverageRule getCoverageRule() const { return m_coverageRule; }
+
+  /// Returns the cells that are obstructed by moving bodies, which must be
+  /// kept in ascending order of offset. While such a cell is obstructed the
+  /// boundary fill sets its velocity to that of the body, instead of blocking
+  /// it like the velocity of other obstructed cells.
+  std::vector<MovingCell> &getMovingCells() { return m_movingCells; }
+
+  /// Returns the cells that are obstructed by moving bodies
+  const std::vector<MovingCell> &getMovingCells() const {
+    return m_movingCells;
+  }
+
   /// \copydoc Field::paintT
   void paintT(Painter &painter, const Vec3F &offset = Vec3F::ZERO,
               const Vec3F &padding = Vec3F(0, 0, 0)) const override;
+
+private:
+  /// Rule that decides which cells are obstructed
+  CoverageRule m_coverageRule = CoverageRule::kAny;
+  /// Open fraction of the three positive faces of each cell (x, y and z
+  /// interleaved)
+  std::vector<f32> m_faces;
+  /// Offsets of the cells with at least one partially open face, sorted
+  std::vector<u32> m_partialCells;
+  /// Cells that are obstructed by moving bodies, sorted
+  std::vector<MovingCell> m_movingCells;
 };
 
 } // namespace wind
\ No newline at end of file
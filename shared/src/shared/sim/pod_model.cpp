@@ -0,0 +1,536 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "shared/sim/pod_model.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/sim/vector_field.hpp"
+#include "shared/sim/wind_sim.hpp"
+#include "thirdparty/dutil/file.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <dlog/dlog.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+// ========================================================================== //
+// Functions
+// ========================================================================== //
+
+namespace wind {
+
+namespace {
+
+/// Maximum number of sweeps of the Jacobi eigenvalue solver
+constexpr u32 kJacobiMaxSweeps = 64u;
+
+// -------------------------------------------------------------------------- //
+
+/// Compute the eigenvalues and eigenvectors of a symmetric (n x n) matrix with
+/// the cyclic Jacobi method. The matrix is destroyed, the eigenvalues end up on
+/// its diagonal and the eigenvectors in the columns of 'vectors'.
+void jacobiEigen(std::vector<f64> &matrix, std::vector<f64> &vectors, u32 n) {
+  vectors.assign(u64(n) * n, 0.0);
+  for (u32 i = 0; i < n; i++) {
+    vectors[i * n + i] = 1.0;
+  }
+
+  for (u32 sweep = 0; sweep < kJacobiMaxSweeps; sweep++) {
+    f64 offDiagonal = 0.0;
+    f64 diagonal = 0.0;
+    for (u32 p = 0; p < n; p++) {
+      diagonal += matrix[p * n + p] * matrix[p * n + p];
+      for (u32 q = p + 1; q < n; q++) {
+        offDiagonal += matrix[p * n + q] * matrix[p * n + q];
+      }
+    }
+    if (offDiagonal <= 1e-22 * diagonal) {
+      break;
+    }
+
+    for (u32 p = 0; p < n; p++) {
+      for (u32 q = p + 1; q < n; q++) {
+        const f64 apq = matrix[p * n + q];
+        if (apq == 0.0) {
+          continue;
+        }
+
+        // Rotation that zeroes the (p, q) element
+        const f64 theta = (matrix[q * n + q] - matrix[p * n + p]) / (2 * apq);
+        const f64 t = (theta >= 0 ? 1.0 : -1.0) /
+                      (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        const f64 c = 1.0 / std::sqrt(t * t + 1.0);
+        const f64 s = t * c;
+
+        for (u32 k = 0; k < n; k++) {
+          const f64 akp = matrix[k * n + p];
+          const f64 akq = matrix[k * n + q];
+          matrix[k * n + p] = c * akp - s * akq;
+          matrix[k * n + q] = s * akp + c * akq;
+        }
+        for (u32 k = 0; k < n; k++) {
+          const f64 apk = matrix[p * n + k];
+          const f64 aqk = matrix[q * n + k];
+          matrix[p * n + k] = c * apk - s * aqk;
+          matrix[q * n + k] = s * apk + c * aqk;
+        }
+        for (u32 k = 0; k < n; k++) {
+          const f64 vkp = vectors[k * n + p];
+          const f64 vkq = vectors[k * n + q];
+          vectors[k * n + p] = c * vkp - s * vkq;
+          vectors[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+} // namespace wind
+
+// ========================================================================== //
+// PodModel Implementation
+// ========================================================================== //
+
+namespace wind {
+
+void PodModel::update(f32 delta) {
+  const u32 snapshotCount =
+      u32(m_trajectory.size()) / maxValue(m_modeCount, 1u);
+  if (snapshotCount == 0 || m_modeCount == 0) {
+    return;
+  }
+
+  // Loop over the trajectory, interpolating from the last snapshot back to
+  // the first one at the end
+  const f32 duration = snapshotCount * m_interval;
+  m_time = std::fmod(m_time + delta, duration);
+  if (m_time < 0.0f) {
+    m_time += duration;
+  }
+  if (m_time >= duration) {
+    // Adding the duration to a tiny negative time can round up to it
+    m_time = 0.0f;
+  }
+  const f32 position = m_time / m_interval;
+  const u32 index0 = minValue(u32(position), snapshotCount - 1);
+  const u32 index1 = (index0 + 1) % snapshotCount;
+  const f32 t = position - index0;
+  const f32 *c0 = m_trajectory.data() + u64(index0) * m_modeCount;
+  const f32 *c1 = m_trajectory.data() + u64(index1) * m_modeCount;
+  for (u32 k = 0; k < m_modeCount; k++) {
+    m_coefficients[k] = c0[k] * (1.0f - t) + c1[k] * t;
+  }
+  updateWeights();
+}
+
+// -------------------------------------------------------------------------- //
+
+void PodModel::setCoefficients(const f32 *coefficients) {
+  std::copy(coefficients, coefficients + m_modeCount, m_coefficients.begin());
+  updateWeights();
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F PodModel::sample(const Vec3F &point) const {
+  // Lower cell and fraction along each axis
+  const f32 cellX = clamp(point.x / m_cellSize, 0.0f, f32(m_dim.width - 1));
+  const f32 cellY = clamp(point.y / m_cellSize, 0.0f, f32(m_dim.height - 1));
+  const f32 cellZ = clamp(point.z / m_cellSize, 0.0f, f32(m_dim.depth - 1));
+  const u32 x0 = minValue(u32(cellX), m_dim.width - 2);
+  const u32 y0 = minValue(u32(cellY), m_dim.height - 2);
+  const u32 z0 = minValue(u32(cellZ), m_dim.depth - 2);
+  const f32 fx = cellX - x0;
+  const f32 fy = cellY - y0;
+  const f32 fz = cellZ - z0;
+
+  // Interpolate along x, then y, then z
+  const Vec3F c00 = sampleCell(x0, y0, z0) * (1 - fx) +
+                    sampleCell(x0 + 1, y0, z0) * fx;
+  const Vec3F c10 = sampleCell(x0, y0 + 1, z0) * (1 - fx) +
+                    sampleCell(x0 + 1, y0 + 1, z0) * fx;
+  const Vec3F c01 = sampleCell(x0, y0, z0 + 1) * (1 - fx) +
+                    sampleCell(x0 + 1, y0, z0 + 1) * fx;
+  const Vec3F c11 = sampleCell(x0, y0 + 1, z0 + 1) * (1 - fx) +
+                    sampleCell(x0 + 1, y0 + 1, z0 + 1) * fx;
+  const Vec3F c0 = c00 * (1 - fy) + c10 * fy;
+  const Vec3F c1 = c01 * (1 - fy) + c11 * fy;
+  return c0 * (1 - fz) + c1 * fz;
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F PodModel::sampleWorld(const Vec3F &point) const {
+  // Outside of the interior
+  const Vec3F local = point - m_origin;
+  const Vec3F size = Vec3F(f32(m_dim.width - 2), f32(m_dim.height - 2),
+                           f32(m_dim.depth - 2)) *
+                     m_cellSize;
+  if (!isValid() || local.x < 0.0f || local.y < 0.0f || local.z < 0.0f ||
+      local.x > size.x || local.y > size.y || local.z > size.z) {
+    return Vec3F::ZERO;
+  }
+
+  // The center of interior cell 'i' lies at (i - 0.5) cells from the origin
+  return sample(local + Vec3F::ONE * (0.5f * m_cellSize));
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F PodModel::sampleCell(u32 x, u32 y, u32 z) const {
+  const u64 cell = x + u64(m_dim.width) * (y + u64(m_dim.height) * z);
+  const f32 *mean = m_mean.data() + cell * 3;
+  const s16 *modes = m_modes.data() + cell * 3 * m_modeCount;
+
+  f32 vx = mean[0];
+  f32 vy = mean[1];
+  f32 vz = mean[2];
+  for (u32 k = 0; k < m_modeCount; k++) {
+    const f32 w = m_weights[k];
+    vx += w * modes[k * 3 + 0];
+    vy += w * modes[k * 3 + 1];
+    vz += w * modes[k * 3 + 2];
+  }
+  return Vec3F(vx, vy, vz);
+}
+
+// -------------------------------------------------------------------------- //
+
+void PodModel::reconstruct(VectorField &field) const {
+  assert(field.getDim() == m_dim && "Field must match model dimensions");
+  for (u32 z = 0; z < m_dim.depth; z++) {
+    for (u32 y = 0; y < m_dim.height; y++) {
+      for (u32 x = 0; x < m_dim.width; x++) {
+        field.set(s32(x), s32(y), s32(z), sampleCell(x, y, z));
+      }
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool PodModel::save(const std::string &path) const {
+  MICROPROFILE_SCOPEI("PodModel", "save", MP_ORANGE1);
+
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.width = m_dim.width;
+  header.height = m_dim.height;
+  header.depth = m_dim.depth;
+  header.cellSize = m_cellSize;
+  header.modeCount = m_modeCount;
+  header.snapshotCount = u32(m_trajectory.size()) / maxValue(m_modeCount, 1u);
+  header.interval = m_interval;
+  header.energy = m_energy;
+
+  std::vector<u8> buffer(sizeof(Header) + getSize());
+  u8 *out = buffer.data();
+  const auto append = [&out](const void *data, u64 size) {
+    std::memcpy(out, data, size);
+    out += size;
+  };
+  append(&header, sizeof(Header));
+  append(m_mean.data(), sizeof(f32) * m_mean.size());
+  append(m_scales.data(), sizeof(f32) * m_scales.size());
+  append(m_modes.data(), sizeof(s16) * m_modes.size());
+  append(m_trajectory.data(), sizeof(f32) * m_trajectory.size());
+
+  dutil::File file{};
+  dutil::File::Result res = file.Open(path, dutil::File::Mode::kWrite);
+  if (res == dutil::File::Result::kSuccess) {
+    res = file.Write(buffer);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to write wind model {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool PodModel::load(const std::string &path) {
+  MICROPROFILE_SCOPEI("PodModel", "load", MP_ORANGE1);
+
+  dutil::File file{};
+  dutil::File::Result res = file.Open(path, dutil::File::Mode::kRead);
+  std::vector<u8> buffer;
+  if (res == dutil::File::Result::kSuccess) {
+    res = file.Load(buffer);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to load wind model {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+
+  // Validate header
+  Header header;
+  if (buffer.size() < sizeof(Header)) {
+    DLOG_ERROR("wind model {} is too small to contain a header", path);
+    return false;
+  }
+  std::memcpy(&header, buffer.data(), sizeof(Header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    DLOG_ERROR("wind model {} has an invalid magic number or version", path);
+    return false;
+  }
+  const u64 cellCount = u64(header.width) * header.height * header.depth;
+  const u64 size =
+      sizeof(Header) + sizeof(f32) * cellCount * 3 +
+      sizeof(f32) * header.modeCount +
+      sizeof(s16) * cellCount * 3 * header.modeCount +
+      sizeof(f32) * u64(header.snapshotCount) * header.modeCount;
+  if (header.width < 2 || header.height < 2 || header.depth < 2 ||
+      buffer.size() < size) {
+    DLOG_ERROR("wind model {} is truncated", path);
+    return false;
+  }
+  if (!(header.cellSize > 0.0f) || !(header.interval > 0.0f)) {
+    DLOG_ERROR("wind model {} has an invalid cell size {} or interval {}",
+               path, header.cellSize, header.interval);
+    return false;
+  }
+
+  // Read data
+  m_dim = FieldBase::Dim{header.width, header.height, header.depth};
+  m_cellCount = u32(cellCount);
+  m_cellSize = header.cellSize;
+  m_modeCount = header.modeCount;
+  m_interval = header.interval;
+  m_energy = header.energy;
+  m_mean.resize(cellCount * 3);
+  m_scales.resize(m_modeCount);
+  m_modes.resize(cellCount * 3 * m_modeCount);
+  m_trajectory.resize(u64(header.snapshotCount) * m_modeCount);
+  const u8 *in = buffer.data() + sizeof(Header);
+  const auto read = [&in](void *data, u64 size) {
+    std::memcpy(data, in, size);
+    in += size;
+  };
+  read(m_mean.data(), sizeof(f32) * m_mean.size());
+  read(m_scales.data(), sizeof(f32) * m_scales.size());
+  read(m_modes.data(), sizeof(s16) * m_modes.size());
+  read(m_trajectory.data(), sizeof(f32) * m_trajectory.size());
+
+  m_time = 0.0f;
+  m_coefficients.assign(m_modeCount, 0.0f);
+  m_weights.assign(m_modeCount, 0.0f);
+  update(0.0f);
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+u64 PodModel::getSize() const {
+  return sizeof(f32) * (m_mean.size() + m_scales.size() + m_trajectory.size()) +
+         sizeof(s16) * m_modes.size();
+}
+
+// -------------------------------------------------------------------------- //
+
+void PodModel::updateWeights() {
+  for (u32 k = 0; k < m_modeCount; k++) {
+    m_weights[k] = m_coefficients[k] * m_scales[k];
+  }
+}
+
+} // namespace wind
+
+// ========================================================================== //
+// PodBuilder Implementation
+// ========================================================================== //
+
+namespace wind {
+
+PodBuilder::PodBuilder(const FieldBase::Dim &dim, f32 cellSize)
+    : m_dim(dim), m_cellSize(cellSize) {}
+
+// -------------------------------------------------------------------------- //
+
+void PodBuilder::addSnapshot(const VectorField &field) {
+  assert(field.getDim() == m_dim && "Field must match builder dimensions");
+
+  const u32 cellCount = field.getCellCount();
+  std::vector<f32> snapshot(u64(cellCount) * 3);
+  for (u32 i = 0; i < cellCount; i++) {
+    snapshot[i * 3 + 0] = field.getX()->get(i);
+    snapshot[i * 3 + 1] = field.getY()->get(i);
+    snapshot[i * 3 + 2] = field.getZ()->get(i);
+  }
+  m_snapshots.push_back(std::move(snapshot));
+}
+
+// -------------------------------------------------------------------------- //
+
+void PodBuilder::collect(WindSimulation &sim, f32 delta, u32 count,
+                         u32 stepsPerSnapshot) {
+  MICROPROFILE_SCOPEI("PodBuilder", "collect", MP_ORANGE1);
+
+  for (u32 i = 0; i < count; i++) {
+    for (u32 step = 0; step < stepsPerSnapshot; step++) {
+      sim.step(delta);
+    }
+    addSnapshot(sim.V());
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool PodBuilder::build(PodModel &model, f32 interval, u32 maxModes,
+                       f32 energy) const {
+  MICROPROFILE_SCOPEI("PodBuilder", "build", MP_ORANGE1);
+
+  const u32 snapshotCount = u32(m_snapshots.size());
+  if (snapshotCount == 0) {
+    DLOG_ERROR("cannot build wind model without snapshots");
+    return false;
+  }
+  if (!(interval > 0.0f)) {
+    DLOG_ERROR("cannot build wind model with snapshot interval {}", interval);
+    return false;
+  }
+  const u64 size = m_snapshots[0].size();
+
+  // Mean field and fluctuations around it
+  std::vector<f64> mean(size, 0.0);
+  for (const std::vector<f32> &snapshot : m_snapshots) {
+    for (u64 i = 0; i < size; i++) {
+      mean[i] += snapshot[i];
+    }
+  }
+  for (f64 &value : mean) {
+    value /= snapshotCount;
+  }
+
+  // Correlation matrix between the snapshots
+  const u32 n = snapshotCount;
+  std::vector<f64> correlation(u64(n) * n, 0.0);
+  for (u32 a = 0; a < n; a++) {
+    for (u32 b = a; b < n; b++) {
+      f64 sum = 0.0;
+      const std::vector<f32> &sa = m_snapshots[a];
+      const std::vector<f32> &sb = m_snapshots[b];
+      for (u64 i = 0; i < size; i++) {
+        sum += (sa[i] - mean[i]) * (sb[i] - mean[i]);
+      }
+      correlation[a * n + b] = sum;
+      correlation[b * n + a] = sum;
+    }
+  }
+
+  // Eigen decomposition, sorted by decreasing eigenvalue
+  std::vector<f64> vectors;
+  jacobiEigen(correlation, vectors, n);
+  std::vector<u32> order(n);
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+    return correlation[a * n + a] > correlation[b * n + b];
+  });
+  f64 totalEnergy = 0.0;
+  for (u32 i = 0; i < n; i++) {
+    totalEnergy += maxValue(correlation[i * n + i], 0.0);
+  }
+
+  // Select modes
+  u32 modeCount = 0;
+  f64 capturedEnergy = 0.0;
+  while (modeCount < minValue(maxModes, n)) {
+    const f64 lambda = correlation[order[modeCount] * n + order[modeCount]];
+    if (lambda <= 1e-12 * totalEnergy || totalEnergy <= 0.0 ||
+        capturedEnergy >= energy * totalEnergy) {
+      break;
+    }
+    capturedEnergy += lambda;
+    modeCount++;
+  }
+
+  // Setup model
+  model.m_dim = m_dim;
+  model.m_cellCount = m_dim.width * m_dim.height * m_dim.depth;
+  model.m_cellSize = m_cellSize;
+  model.m_modeCount = modeCount;
+  model.m_interval = interval;
+  model.m_energy =
+      totalEnergy > 0.0 ? f32(capturedEnergy / totalEnergy) : 1.0f;
+  model.m_mean.assign(mean.begin(), mean.end());
+  model.m_scales.assign(modeCount, 0.0f);
+  model.m_modes.assign(size * modeCount, 0);
+  model.m_trajectory.assign(u64(n) * modeCount, 0.0f);
+
+  // Modes are combinations of the snapshots, normalised to unit length. The
+  // coefficient of a snapshot for a mode is then sqrt(lambda) * v.
+  std::vector<f64> mode(size);
+  for (u32 k = 0; k < modeCount; k++) {
+    const u32 column = order[k];
+    const f64 lambda = correlation[column * n + column];
+    const f64 norm = 1.0 / std::sqrt(lambda);
+    std::fill(mode.begin(), mode.end(), 0.0);
+    for (u32 s = 0; s < n; s++) {
+      const f64 weight = vectors[s * n + column] * norm;
+      const std::vector<f32> &snapshot = m_snapshots[s];
+      for (u64 i = 0; i < size; i++) {
+        mode[i] += weight * (snapshot[i] - mean[i]);
+      }
+      model.m_trajectory[u64(s) * modeCount + k] =
+          f32(vectors[s * n + column] * std::sqrt(lambda));
+    }
+
+    // Quantise
+    f64 maxAbs = 0.0;
+    for (u64 i = 0; i < size; i++) {
+      maxAbs = maxValue(maxAbs, std::abs(mode[i]));
+    }
+    const f64 scale = maxAbs > 0.0 ? maxAbs / 32767.0 : 1.0;
+    model.m_scales[k] = f32(scale);
+    for (u64 cell = 0; cell < size / 3; cell++) {
+      for (u32 c = 0; c < 3; c++) {
+        model.m_modes[(cell * modeCount + k) * 3 + c] =
+            s16(std::lround(mode[cell * 3 + c] / scale));
+      }
+    }
+  }
+
+  model.m_time = 0.0f;
+  model.m_coefficients.assign(modeCount, 0.0f);
+  model.m_weights.assign(modeCount, 0.0f);
+  model.update(0.0f);
+
+  DLOG_INFO("built wind model with {} modes from {} snapshots ({}% energy, "
+            "{} bytes)",
+            modeCount, n, model.m_energy * 100.0f, model.getSize());
+  return true;
+}
+
+} // namespace wind
@@ -0,0 +1,245 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/math/field.hpp"
+#include "shared/types.hpp"
+
+#include <string>
+#include <vector>
+
+// ========================================================================== //
+// PodModel Declaration
+// ========================================================================== //
+
+namespace wind {
+
+WIND_FORWARD_DECLARE(VectorField);
+WIND_FORWARD_DECLARE(WindSimulation);
+
+/// Reduced-order wind model built from a proper orthogonal decomposition (POD)
+/// of velocity snapshots.
+///
+/// The velocity field is represented as a mean field plus a weighted sum of a
+/// few modes. The modes are stored interleaved per cell and quantised to 16
+/// bits, with a scale for each mode. At runtime only the modal coefficients
+/// change, which means that the cost of a query only depends on the number of
+/// modes and not on the size of the grid.
+///
+/// The coefficients are evolved by playing back the coefficients of the
+/// snapshots that the model was built from, interpolating between them and
+/// looping at the end. They can also be set directly.
+///
+/// A model can be placed in the world and sampled by the wind system with
+/// 'WindSystem::setPodSource'. The coefficients must then only be changed
+/// from the thread that queries the wind system.
+class PodModel {
+  friend class PodBuilder;
+
+public:
+  /// Magic number at the start of each model file ("WPOD")
+  static constexpr u32 kMagic = 0x444F5057u;
+  /// Current version of the model format
+  static constexpr u32 kVersion = 1u;
+
+  /// Header of a model file. The header is followed by the mean field (3 f32
+  /// per cell), the mode scales (f32 per mode), the quantised modes (3 s16 per
+  /// mode and cell) and the coefficients of each snapshot (f32 per mode).
+  struct Header {
+    /// Magic number, must be 'kMagic'
+    u32 magic;
+    /// Version of the format, must be 'kVersion'
+    u32 version;
+    /// Width of the field in cells, including boundary cells
+    u32 width;
+    /// Height of the field in cells, including boundary cells
+    u32 height;
+    /// Depth of the field in cells, including boundary cells
+    u32 depth;
+    /// Size of a cell in meters
+    f32 cellSize;
+    /// Number of modes
+    u32 modeCount;
+    /// Number of snapshots in the coefficient trajectory
+    u32 snapshotCount;
+    /// Time between snapshots in seconds
+    f32 interval;
+    /// Fraction of the snapshot energy captured by the modes
+    f32 energy;
+  };
+
+public:
+  /// Construct empty model
+  PodModel() = default;
+
+  /// Advance time by 'delta' along the coefficient trajectory. The trajectory
+  /// loops in both directions, so 'delta' may be negative.
+  void update(f32 delta);
+
+  /// Set the modal coefficients directly. 'coefficients' must contain one
+  /// value per mode.
+  void setCoefficients(const f32 *coefficients);
+
+  /// Sample the wind at a point in local meters. The point is clamped to the
+  /// field, like for 'VectorField::sampleTrilinear'.
+  Vec3F sample(const Vec3F &point) const;
+
+  /// Sample the wind at a point in world space, in the same way as
+  /// 'WindSnapshots::sample' samples a simulation. Returns zero outside of the
+  /// interior of the field.
+  Vec3F sampleWorld(const Vec3F &point) const;
+
+  /// Reconstruct the velocity of a single cell
+  Vec3F sampleCell(u32 x, u32 y, u32 z) const;
+
+  /// Reconstruct the entire field into a vector field of the same dimensions
+  void reconstruct(VectorField &field) const;
+
+  /// Save the model to a file
+  bool save(const std::string &path) const;
+
+  /// Load the model from a file
+  bool load(const std::string &path);
+
+  /// Returns whether the model has been built or loaded
+  bool isValid() const { return m_cellCount > 0; }
+
+  /// Returns the number of modes
+  u32 getModeCount() const { return m_modeCount; }
+
+  /// Returns the fraction of the snapshot energy captured by the modes
+  f32 getEnergy() const { return m_energy; }
+
+  /// Returns the dimensions of the field
+  const FieldBase::Dim &getDim() const { return m_dim; }
+
+  /// Set the world position of the minimum corner of the interior of the
+  /// field, which is where the simulation that the model was built from was
+  /// placed. Defaults to zero.
+  void setOrigin(const Vec3F &origin) { m_origin = origin; }
+
+  /// Returns the world position of the minimum corner of the interior of the
+  /// field
+  const Vec3F &getOrigin() const { return m_origin; }
+
+  /// Returns the size of the model data in bytes
+  u64 getSize() const;
+
+private:
+  /// Recompute the weights that the quantised modes are multiplied with
+  void updateWeights();
+
+private:
+  /// Dimensions of the field
+  FieldBase::Dim m_dim{0, 0, 0};
+  /// Number of cells in the field
+  u32 m_cellCount = 0;
+  /// Size of a cell in meters
+  f32 m_cellSize = 1.0f;
+  /// Number of modes
+  u32 m_modeCount = 0;
+  /// Time between snapshots in the trajectory
+  f32 m_interval = 1.0f;
+  /// Fraction of the snapshot energy captured by the modes
+  f32 m_energy = 0.0f;
+  /// World position of the minimum corner of the interior of the field
+  Vec3F m_origin = Vec3F::ZERO;
+
+  /// Mean field, 3 components per cell
+  std::vector<f32> m_mean;
+  /// Scale of each quantised mode
+  std::vector<f32> m_scales;
+  /// Quantised modes, 3 components per mode for each cell
+  std::vector<s16> m_modes;
+  /// Coefficients of each snapshot, one per mode
+  std::vector<f32> m_trajectory;
+
+  /// Current time along the trajectory
+  f32 m_time = 0.0f;
+  /// Current coefficients
+  std::vector<f32> m_coefficients;
+  /// Current coefficients multiplied by the mode scales
+  std::vector<f32> m_weights;
+};
+
+} // namespace wind
+
+// ========================================================================== //
+// PodBuilder Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Offline builder of reduced-order wind models.
+///
+/// Velocity snapshots are collected from a simulation and the modes are then
+/// computed with the method of snapshots, which only requires an eigen
+/// decomposition of the (snapshots x snapshots) correlation matrix. The number
+/// of snapshots should therefore be kept in the order of tens to a few
+/// hundred.
+class PodBuilder {
+public:
+  /// Default maximum number of modes
+  static constexpr u32 kDefaultMaxModes = 16u;
+  /// Default fraction of the snapshot energy to capture
+  static constexpr f32 kDefaultEnergy = 0.99f;
+
+public:
+  /// Construct builder for fields of the specified dimensions
+  PodBuilder(const FieldBase::Dim &dim, f32 cellSize);
+
+  /// Add a snapshot of a velocity field
+  /// \pre Field must have the dimensions of the builder.
+  void addSnapshot(const VectorField &field);
+
+  /// Step a simulation and collect 'count' snapshots of it, stepping
+  /// 'stepsPerSnapshot' times between each snapshot.
+  void collect(WindSimulation &sim, f32 delta, u32 count,
+               u32 stepsPerSnapshot = 1);
+
+  /// Build a model from the collected snapshots. The smallest number of modes
+  /// that captures 'energy' of the snapshot energy is used, up to 'maxModes'.
+  /// 'interval' is the time between snapshots when playing back the model.
+  /// \return True if the model could be built.
+  bool build(PodModel &model, f32 interval, u32 maxModes = kDefaultMaxModes,
+             f32 energy = kDefaultEnergy) const;
+
+  /// Returns the number of collected snapshots
+  u32 getSnapshotCount() const { return u32(m_snapshots.size()); }
+
+private:
+  /// Dimensions of the fields
+  FieldBase::Dim m_dim;
+  /// Size of a cell in meters
+  f32 m_cellSize;
+  /// Snapshots, 3 components per cell
+  std::vector<std::vector<f32>> m_snapshots;
+};
+
+} // namespace wind
@@ -0,0 +1,534 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "shared/sim/recording.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/math/math.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <dlog/dlog.hpp>
+
+#include <cmath>
+#include <cstring>
+
+// ========================================================================== //
+// Recording Implementation
+// ========================================================================== //
+
+namespace wind {
+
+namespace {
+
+/// Visit each brick of a field, with the cell range of the brick
+template <typename F> void forEachBrick(const FieldBase::Dim &dim, F fn) {
+  constexpr u32 kSize = Recording::kBrickSize;
+  for (u32 z = 0; z < dim.depth; z += kSize) {
+    for (u32 y = 0; y < dim.height; y += kSize) {
+      for (u32 x = 0; x < dim.width; x += kSize) {
+        fn(x, y, z, minValue(x + kSize, dim.width),
+           minValue(y + kSize, dim.height), minValue(z + kSize, dim.depth));
+      }
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Visit the offset of each cell in a brick
+template <typename F>
+void forEachCell(const FieldBase::Dim &dim, u32 x0, u32 y0, u32 z0, u32 x1,
+                 u32 y1, u32 z1, F fn) {
+  for (u32 z = z0; z < z1; z++) {
+    for (u32 y = y0; y < y1; y++) {
+      u32 offset = x0 + dim.width * (y + dim.height * z);
+      for (u32 x = x0; x < x1; x++) {
+        fn(offset++);
+      }
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Map signed to unsigned so that small magnitudes have few bits
+u32 zigzag(s32 value) { return (u32(value) << 1u) ^ u32(value >> 31); }
+
+// -------------------------------------------------------------------------- //
+
+/// Inverse of 'zigzag'
+s32 unzigzag(u32 value) { return s32(value >> 1u) ^ -s32(value & 1u); }
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the number of bits required to store a value
+u32 bitWidth(u32 value) {
+  u32 bits = 0;
+  while (value != 0) {
+    value >>= 1u;
+    bits++;
+  }
+  return bits;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Packs values with a fixed number of bits into a buffer
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<u8> &buffer) : m_buffer(buffer) {}
+
+  /// Write the lowest 'bits' bits of a value
+  void write(u32 value, u32 bits) {
+    m_bits |= u64(value) << m_count;
+    m_count += bits;
+    while (m_count >= 8) {
+      m_buffer.push_back(u8(m_bits));
+      m_bits >>= 8u;
+      m_count -= 8;
+    }
+  }
+
+  /// Write remaining bits padded to a full byte
+  void flush() {
+    if (m_count > 0) {
+      m_buffer.push_back(u8(m_bits));
+    }
+    m_bits = 0;
+    m_count = 0;
+  }
+
+private:
+  std::vector<u8> &m_buffer;
+  u64 m_bits = 0;
+  u32 m_count = 0;
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Unpacks values with a fixed number of bits from data
+class BitReader {
+public:
+  explicit BitReader(const u8 *data) : m_data(data) {}
+
+  /// Read a value of 'bits' bits
+  u32 read(u32 bits) {
+    while (m_count < bits) {
+      m_bits |= u64(*m_data++) << m_count;
+      m_count += 8;
+    }
+    const u32 value = u32(m_bits & ((u64(1) << bits) - 1u));
+    m_bits >>= bits;
+    m_count -= bits;
+    return value;
+  }
+
+  /// Discard remaining bits of the current byte
+  void flush() {
+    m_bits = 0;
+    m_count = 0;
+  }
+
+  /// Returns the current read position
+  const u8 *getData() const { return m_data; }
+
+private:
+  const u8 *m_data;
+  u64 m_bits = 0;
+  u32 m_count = 0;
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the number of bricks of a field
+u32 brickCount(const FieldBase::Dim &dim) {
+  constexpr u32 kSize = Recording::kBrickSize;
+  return ((dim.width + kSize - 1) / kSize) *
+         ((dim.height + kSize - 1) / kSize) * ((dim.depth + kSize - 1) / kSize);
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns whether the data of a frame holds exactly the time, the keyframe
+/// flag and the packed bits of each component of each brick
+bool frameFits(const FieldBase::Dim &dim, const std::vector<u8> &frame) {
+  u64 size = sizeof(f32) + sizeof(u32);
+  bool fits = true;
+  forEachBrick(dim, [&](u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) {
+    const u64 cells = u64(x1 - x0) * (y1 - y0) * (z1 - z0);
+    for (u32 c = 0; c < 3 && fits; c++) {
+      if (size >= frame.size() || frame[size] > 32u) {
+        fits = false;
+        break;
+      }
+      size += 1u + (cells * frame[size] + 7u) / 8u;
+    }
+  });
+  return fits && size == frame.size();
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Append a value to a buffer
+template <typename T> void append(std::vector<u8> &buffer, const T &value) {
+  const u8 *bytes = reinterpret_cast<const u8 *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+} // namespace
+
+} // namespace wind
+
+// ========================================================================== //
+// RecordingWriter Implementation
+// ========================================================================== //
+
+namespace wind {
+
+RecordingWriter::~RecordingWriter() {
+  if (m_open) {
+    close();
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingWriter::open(const std::string &path, const FieldBase::Dim &dim,
+                           f32 cellSize, f32 quantum, u32 keyframeInterval) {
+  if (m_open) {
+    close();
+  }
+
+  const dutil::File::Result res = m_file.Open(path, dutil::File::Mode::kWrite);
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to open recording {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  m_open = true;
+  m_offset = 0;
+  m_index.clear();
+  m_previous.assign(3u * dim.width * dim.height * dim.depth, 0);
+
+  m_header.magic = Recording::kMagic;
+  m_header.version = Recording::kVersion;
+  m_header.width = dim.width;
+  m_header.height = dim.height;
+  m_header.depth = dim.depth;
+  m_header.keyframeInterval = maxValue(keyframeInterval, 1u);
+  m_header.cellSize = cellSize;
+  m_header.quantum = quantum;
+
+  m_buffer.clear();
+  append(m_buffer, m_header);
+  return writeBuffer();
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingWriter::write(const VectorField &field, f32 time) {
+  MICROPROFILE_SCOPEI("Recording", "write", MP_ORANGE1);
+
+  const FieldBase::Dim &dim = field.getDim();
+  assert(m_open && "Recording must be open to write frames");
+  assert(dim == FieldBase::Dim({m_header.width, m_header.height,
+                                m_header.depth}) &&
+         "Field dimensions must match the recording");
+
+  const bool keyframe = m_index.size() % m_header.keyframeInterval == 0;
+  m_index.push_back(Recording::IndexEntry{m_offset, time, 0});
+
+  m_buffer.clear();
+  append(m_buffer, time);
+  append(m_buffer, u32(keyframe));
+
+  // Quantise and delta-encode each component of each brick
+  const Field<f32> *comps[3] = {field.getX(), field.getY(), field.getZ()};
+  const f32 invQuantum = 1.0f / m_header.quantum;
+  BitWriter writer(m_buffer);
+  forEachBrick(dim, [&](u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) {
+    for (u32 c = 0; c < 3; c++) {
+      // Largest difference determines the bit width of the brick
+      u32 maxDelta = 0;
+      forEachCell(dim, x0, y0, z0, x1, y1, z1, [&](u32 offset) {
+        const s32 q = s32(std::lround(comps[c]->get(offset) * invQuantum));
+        const s32 previous = keyframe ? 0 : m_previous[offset * 3 + c];
+        maxDelta = maxValue(maxDelta, zigzag(q - previous));
+      });
+      const u32 bits = bitWidth(maxDelta);
+      m_buffer.push_back(u8(bits));
+
+      forEachCell(dim, x0, y0, z0, x1, y1, z1, [&](u32 offset) {
+        const s32 q = s32(std::lround(comps[c]->get(offset) * invQuantum));
+        s32 &previous = m_previous[offset * 3 + c];
+        if (bits > 0) {
+          writer.write(zigzag(q - (keyframe ? 0 : previous)), bits);
+        }
+        previous = q;
+      });
+      writer.flush();
+    }
+  });
+
+  return writeBuffer();
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingWriter::close() {
+  if (!m_open) {
+    return false;
+  }
+
+  Recording::Footer footer{};
+  footer.indexOffset = m_offset;
+  footer.frameCount = u32(m_index.size());
+  footer.magic = Recording::kMagic;
+
+  m_buffer.clear();
+  for (const Recording::IndexEntry &entry : m_index) {
+    append(m_buffer, entry);
+  }
+  append(m_buffer, footer);
+  const bool success = writeBuffer();
+
+  m_file.Close();
+  m_open = false;
+  return success;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingWriter::writeBuffer() {
+  const dutil::File::Result res = m_file.Write(m_buffer);
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to write recording: {}",
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  m_offset += m_buffer.size();
+  return true;
+}
+
+} // namespace wind
+
+// ========================================================================== //
+// RecordingReader Implementation
+// ========================================================================== //
+
+namespace wind {
+
+RecordingReader::~RecordingReader() { delete m_field; }
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingReader::open(const std::string &path) {
+  m_index.clear();
+  m_file.close();
+  m_file.clear();
+  m_file.open(path, std::ios::binary);
+  if (!m_file) {
+    DLOG_ERROR("failed to open recording {}", path);
+    return false;
+  }
+  m_file.seekg(0, std::ios::end);
+  const u64 size = u64(m_file.tellg());
+
+  // Validate header and footer
+  Recording::Footer footer{};
+  if (size < sizeof(Recording::Header) + sizeof(Recording::Footer)) {
+    DLOG_ERROR("recording {} is too small", path);
+    return false;
+  }
+  m_file.seekg(0, std::ios::beg);
+  m_file.read(reinterpret_cast<char *>(&m_header), sizeof(Recording::Header));
+  m_file.seekg(std::streamoff(size - sizeof(footer)), std::ios::beg);
+  m_file.read(reinterpret_cast<char *>(&footer), sizeof(footer));
+  if (!m_file) {
+    DLOG_ERROR("failed to read recording {}", path);
+    return false;
+  }
+  if (m_header.magic != Recording::kMagic ||
+      footer.magic != Recording::kMagic) {
+    DLOG_ERROR("recording {} is invalid or was not closed", path);
+    return false;
+  }
+  if (m_header.version != Recording::kVersion) {
+    DLOG_ERROR("recording {} has version {}, expected version {}", path,
+               m_header.version, Recording::kVersion);
+    return false;
+  }
+  if (m_header.width == 0 || m_header.height == 0 || m_header.depth == 0 ||
+      m_header.keyframeInterval == 0 || !(m_header.cellSize > 0.0f) ||
+      !(m_header.quantum > 0.0f)) {
+    DLOG_ERROR("recording {} has an invalid header", path);
+    return false;
+  }
+  const u64 indexSize = u64(footer.frameCount) * sizeof(Recording::IndexEntry);
+  if (footer.frameCount == 0 ||
+      footer.indexOffset < sizeof(Recording::Header) ||
+      footer.indexOffset + indexSize + sizeof(footer) != size) {
+    DLOG_ERROR("recording {} has an invalid index", path);
+    return false;
+  }
+
+  // Index
+  std::vector<Recording::IndexEntry> index(footer.frameCount);
+  m_file.seekg(std::streamoff(footer.indexOffset), std::ios::beg);
+  if (!m_file.read(reinterpret_cast<char *>(index.data()),
+                   std::streamsize(indexSize))) {
+    DLOG_ERROR("failed to read the index of recording {}", path);
+    return false;
+  }
+
+  // Frames must follow each other between the header and the index, and each
+  // must at least hold the time, the keyframe flag and the bit width of each
+  // component of each brick
+  const u64 minFrameSize =
+      sizeof(f32) + sizeof(u32) +
+      3u * brickCount(FieldBase::Dim{m_header.width, m_header.height,
+                                     m_header.depth});
+  for (u32 i = 0; i < footer.frameCount; i++) {
+    const u64 offset = index[i].offset;
+    const u64 end =
+        i + 1 < footer.frameCount ? index[i + 1].offset : footer.indexOffset;
+    if (offset < sizeof(Recording::Header) || end < offset ||
+        end - offset < minFrameSize) {
+      DLOG_ERROR("recording {} has an invalid index entry for frame {}", path,
+                 i);
+      return false;
+    }
+  }
+  m_indexOffset = footer.indexOffset;
+
+  // Decode first frame
+  delete m_field;
+  m_field = new VectorField(m_header.width, m_header.height, m_header.depth,
+                            m_header.cellSize);
+  m_current.assign(3u * m_field->getCellCount(), 0);
+  m_index = std::move(index);
+  if (!decode(0)) {
+    m_index.clear();
+    return false;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingReader::seek(u32 frame) {
+  assert(frame < getFrameCount() && "Frame must be in recording");
+
+  // Start from the keyframe unless the current frame can be decoded from
+  const u32 keyframe = frame - frame % m_header.keyframeInterval;
+  u32 start = keyframe;
+  if (m_frame >= keyframe && m_frame < frame) {
+    start = m_frame + 1;
+  } else if (m_frame == frame) {
+    return true;
+  }
+  for (u32 i = start; i <= frame; i++) {
+    if (!decode(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingReader::seekTime(f32 time) {
+  u32 frame = 0;
+  while (frame + 1 < getFrameCount() && m_index[frame + 1].time <= time) {
+    frame++;
+  }
+  return seek(frame);
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingReader::next() {
+  if (m_frame + 1 >= getFrameCount()) {
+    return false;
+  }
+  return decode(m_frame + 1);
+}
+
+// -------------------------------------------------------------------------- //
+
+bool RecordingReader::decode(u32 frame) {
+  MICROPROFILE_SCOPEI("Recording", "decode", MP_ORANGE1);
+
+  // Read the frame, and check that its bricks fit before decoding anything so
+  // that a corrupt frame leaves the current frame intact
+  const u64 offset = m_index[frame].offset;
+  const u64 end =
+      frame + 1 < getFrameCount() ? m_index[frame + 1].offset : m_indexOffset;
+  m_frameData.resize(end - offset);
+  m_file.seekg(std::streamoff(offset), std::ios::beg);
+  if (!m_file.read(reinterpret_cast<char *>(m_frameData.data()),
+                   std::streamsize(m_frameData.size()))) {
+    m_file.clear();
+    DLOG_ERROR("failed to read frame {} of recording", frame);
+    return false;
+  }
+  if (!frameFits(m_field->getDim(), m_frameData)) {
+    DLOG_ERROR("frame {} of recording is corrupt", frame);
+    return false;
+  }
+
+  const u8 *data = m_frameData.data();
+  u32 keyframe;
+  std::memcpy(&keyframe, data + sizeof(f32), sizeof(u32));
+  data += sizeof(f32) + sizeof(u32);
+
+  // Apply the difference of each component of each brick
+  const FieldBase::Dim &dim = m_field->getDim();
+  Field<f32> *comps[3] = {m_field->getX(), m_field->getY(), m_field->getZ()};
+  const f32 quantum = m_header.quantum;
+  forEachBrick(dim, [&](u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) {
+    for (u32 c = 0; c < 3; c++) {
+      const u32 bits = *data++;
+      BitReader reader(data);
+      forEachCell(dim, x0, y0, z0, x1, y1, z1, [&](u32 offset) {
+        s32 &q = m_current[offset * 3 + c];
+        if (keyframe) {
+          q = 0;
+        }
+        if (bits > 0) {
+          q += unzigzag(reader.read(bits));
+        }
+        comps[c]->get(offset) = q * quantum;
+      });
+      data = reader.getData();
+    }
+  });
+
+  m_frame = frame;
+  return true;
+}
+
+} // namespace wind
@@ -0,0 +1,254 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/sim/vector_field.hpp"
+#include "shared/types.hpp"
+#include "thirdparty/dutil/file.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// ========================================================================== //
+// Recording Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Format of a recording of a series of velocity fields.
+///
+/// A recording starts with a header followed by the frames, an index of the
+/// frames and a footer. The fields are split into bricks of 'kBrickSize' cells
+/// along each axis. The velocity of each cell is quantised to a multiple of
+/// the quantum of the recording. Each component of each brick is then stored
+/// as the difference from the previous frame, packed with the number of bits
+/// required by the largest difference in the brick. Bricks that did not change
+/// take up a single byte per component. Every 'keyframeInterval' frames is a
+/// keyframe, which is stored as the difference from zero, so that seeking
+/// only has to decode from the closest keyframe.
+///
+/// Data is stored in the native byte order.
+class Recording {
+public:
+  /// Magic number at the start and end of each recording ("WREC")
+  static constexpr u32 kMagic = 0x43455257u;
+  /// Current version of the recording format
+  static constexpr u32 kVersion = 1u;
+  /// Number of cells along each axis of a brick
+  static constexpr u32 kBrickSize = 8u;
+
+  /// Default quantum of velocities (m/s)
+  static constexpr f32 kDefaultQuantum = 0.001f;
+  /// Default number of frames between keyframes
+  static constexpr u32 kDefaultKeyframeInterval = 32u;
+
+  /// Header at the start of a recording
+  struct Header {
+    /// Magic number, must be 'kMagic'
+    u32 magic;
+    /// Version of the format, must be 'kVersion'
+    u32 version;
+    /// Width of the fields in cells
+    u32 width;
+    /// Height of the fields in cells
+    u32 height;
+    /// Depth of the fields in cells
+    u32 depth;
+    /// Number of frames between keyframes
+    u32 keyframeInterval;
+    /// Size of a cell in meters
+    f32 cellSize;
+    /// Quantum that velocities are quantised to
+    f32 quantum;
+  };
+
+  /// Entry in the index of a recording
+  struct IndexEntry {
+    /// Offset of the frame from the start of the recording
+    u64 offset;
+    /// Time of the frame
+    f32 time;
+    /// Padding
+    u32 padding;
+  };
+
+  /// Footer at the end of a recording
+  struct Footer {
+    /// Offset of the index from the start of the recording
+    u64 indexOffset;
+    /// Number of frames in the recording
+    u32 frameCount;
+    /// Magic number, must be 'kMagic'
+    u32 magic;
+  };
+};
+
+} // namespace wind
+
+// ========================================================================== //
+// RecordingWriter Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Writer that streams velocity fields to a recording file. Each frame is
+/// encoded and written to file as it is added.
+class RecordingWriter {
+public:
+  /// Construct writer that is not yet open
+  RecordingWriter() = default;
+
+  /// Destruct writer. The recording is closed if it is still open.
+  ~RecordingWriter();
+
+  RecordingWriter(const RecordingWriter &other) = delete;
+  RecordingWriter &operator=(const RecordingWriter &other) = delete;
+
+  /// Open a recording file for fields with the specified dimensions
+  bool open(const std::string &path, const FieldBase::Dim &dim, f32 cellSize,
+            f32 quantum = Recording::kDefaultQuantum,
+            u32 keyframeInterval = Recording::kDefaultKeyframeInterval);
+
+  /// Encode and write a frame to the recording
+  /// \pre Field must have the dimensions that the recording was opened with.
+  bool write(const VectorField &field, f32 time);
+
+  /// Write the index and close the recording
+  bool close();
+
+  /// Returns whether the writer is open
+  bool isOpen() const { return m_open; }
+
+  /// Returns the number of frames that has been written
+  u32 getFrameCount() const { return u32(m_index.size()); }
+
+private:
+  /// Write the buffer to file
+  bool writeBuffer();
+
+private:
+  /// File
+  dutil::File m_file;
+  /// Whether the file is open
+  bool m_open = false;
+  /// Number of bytes written to file
+  u64 m_offset = 0;
+  /// Header
+  Recording::Header m_header{};
+  /// Index of the written frames
+  std::vector<Recording::IndexEntry> m_index;
+  /// Quantised velocities of the previous frame (x, y and z interleaved)
+  std::vector<s32> m_previous;
+  /// Buffer that frames are encoded to
+  std::vector<u8> m_buffer;
+};
+
+} // namespace wind
+
+// ========================================================================== //
+// RecordingReader Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Reader that plays back the velocity fields of a recording. The decoded
+/// field of the current frame can be sampled directly, which means that wind
+/// can be queried without running the simulation. Only the index is kept in
+/// memory, frames are read from file as they are decoded.
+class RecordingReader {
+public:
+  /// Construct reader that is not yet open
+  RecordingReader() = default;
+
+  /// Destruct reader
+  ~RecordingReader();
+
+  RecordingReader(const RecordingReader &other) = delete;
+  RecordingReader &operator=(const RecordingReader &other) = delete;
+
+  /// Open a recording file. The header and index are validated against the
+  /// size of the file and the first frame is decoded.
+  bool open(const std::string &path);
+
+  /// Seek to a frame. Decoding starts at the closest keyframe unless the
+  /// frame comes after the current frame in the same keyframe interval.
+  /// Returns false if a frame could not be read.
+  bool seek(u32 frame);
+
+  /// Seek to the last frame at or before the specified time. Returns false if
+  /// a frame could not be read.
+  bool seekTime(f32 time);
+
+  /// Step to the next frame. Returns false if there are no more frames or the
+  /// frame could not be read.
+  bool next();
+
+  /// Returns the number of frames in the recording
+  u32 getFrameCount() const { return u32(m_index.size()); }
+
+  /// Returns the current frame
+  u32 getFrame() const { return m_frame; }
+
+  /// Returns the time of the current frame
+  f32 getTime() const { return m_index[m_frame].time; }
+
+  /// Returns the velocity field of the current frame
+  const VectorField &getField() const { return *m_field; }
+
+  /// Sample the velocity of the current frame at a point in local meters
+  Vec3F sampleNear(const Vec3F &point) const {
+    return m_field->sampleNear(point);
+  }
+
+private:
+  /// Read and decode a frame on top of the current quantised velocities.
+  /// Returns false if the frame could not be read or is corrupt.
+  bool decode(u32 frame);
+
+private:
+  /// File of the recording
+  std::ifstream m_file;
+  /// Data of the frame that is being decoded
+  std::vector<u8> m_frameData;
+  /// Header
+  Recording::Header m_header{};
+  /// Index of the frames
+  std::vector<Recording::IndexEntry> m_index;
+  /// Offset of the index from the start of the recording, which is where the
+  /// last frame ends
+  u64 m_indexOffset = 0;
+  /// Current frame
+  u32 m_frame = 0;
+  /// Quantised velocities of the current frame (x, y and z interleaved)
+  std::vector<s32> m_current;
+  /// Decoded velocity field of the current frame
+  VectorField *m_field = nullptr;
+};
+
+} // namespace wind
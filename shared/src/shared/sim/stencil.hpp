@@ -0,0 +1,455 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/math/field.hpp"
+#include "shared/sim/obstruction_field.hpp"
+#include "shared/types.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// ========================================================================== //
+// Stencil Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Enumeration that specifies what a scalar field in the simulation represents.
+/// This determines how the boundaries of the field are handled.
+enum class FieldSubKind { kDens, kVelX, kVelY, kVelZ, kPressure };
+
+// -------------------------------------------------------------------------- //
+
+/// Compile-time boundary policy for a field of the specified kind. Velocity
+/// components are mirrored (negated) across the faces that are perpendicular
+/// to them and blocked by obstructions along their own axis. Scalar fields are
+/// simply copied out to the faces, except for the pressure at outflow faces.
+template <FieldSubKind kKind> struct BoundaryPolicy {
+  /// Whether the field is a velocity component along the x-axis
+  static constexpr bool kX = kKind == FieldSubKind::kVelX;
+  /// Whether the field is a velocity component along the y-axis
+  static constexpr bool kY = kKind == FieldSubKind::kVelY;
+  /// Whether the field is a velocity component along the z-axis
+  static constexpr bool kZ = kKind == FieldSubKind::kVelZ;
+  /// Whether the field is the pressure of the projection
+  static constexpr bool kPressure = kKind == FieldSubKind::kPressure;
+  /// Whether the field is affected by obstructions
+  static constexpr bool kObstructed = kX || kY || kZ;
+
+  /// Returns the component of a vector that the field represents, or
+  /// 'fallback' if the field is a scalar field
+  static f32 component(const Vec3F &v, f32 fallback) {
+    return kX ? v.x : kY ? v.y : kZ ? v.z : fallback;
+  }
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Enumeration of the conditions at a face of the simulation domain.
+enum class DomainCondition {
+  /// Solid wall. Velocity perpendicular to the wall is reflected.
+  kWall,
+  /// Velocity is prescribed. Scalar fields have zero gradient.
+  kInflow,
+  /// Pressure is zero and all other fields have zero gradient, so flow can
+  /// leave the domain. Flow back into the domain is blocked.
+  kOutflow,
+  /// The face wraps around to the opposite face of the domain.
+  kPeriodic
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Conditions at the six faces of the simulation domain.
+struct DomainBoundary {
+  /// Faces of the domain
+  enum Face : u32 { kMinX, kMaxX, kMinY, kMaxY, kMinZ, kMaxZ, kFaceCount };
+
+  /// Condition at each face
+  DomainCondition conditions[kFaceCount] = {
+      DomainCondition::kWall, DomainCondition::kWall, DomainCondition::kWall,
+      DomainCondition::kWall, DomainCondition::kWall, DomainCondition::kWall};
+  /// Velocity at each face that has an inflow condition
+  Vec3F inflow[kFaceCount] = {};
+
+  /// Returns the value of a ghost cell at a face of a field of the specified
+  /// kind, given the value of the interior cell next to it, and the value of
+  /// the interior cell at the opposite face of the domain.
+  template <FieldSubKind kKind>
+  f32 ghost(Face face, f32 sign, f32 interior, f32 opposite) const {
+    switch (conditions[face]) {
+    case DomainCondition::kInflow:
+      return BoundaryPolicy<kKind>::component(inflow[face], interior);
+    case DomainCondition::kOutflow:
+      if constexpr (BoundaryPolicy<kKind>::kPressure) {
+        // Pressure is zero at the face, halfway between ghost and interior
+        return -interior;
+      }
+      // Velocity normal to the face may only point out of the domain
+      if (sign < 0.0f) {
+        return face & 1u ? maxValue(interior, 0.0f)
+                         : minValue(interior, 0.0f);
+      }
+      return interior;
+    case DomainCondition::kPeriodic:
+      return opposite;
+    case DomainCondition::kWall:
+      [[fallthrough]];
+    default:
+      return sign * interior;
+    }
+  }
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Data offsets between neighboring cells in a field. The 7-point stencil of a
+/// cell can be addressed directly from its offset with these.
+struct Stride {
+  /// Offset between neighbors along the y-axis
+  u32 y;
+  /// Offset between neighbors along the z-axis
+  u32 z;
+
+  /// Construct strides for a field
+  explicit Stride(const FieldBase &field)
+      : y(field.getDim().width),
+        z(field.getDim().width * field.getDim().height) {}
+};
+
+// -------------------------------------------------------------------------- //
+
+/// Namespace of stencil kernels. Fields are assumed to be padded by one cell
+/// on each side, which makes the interior range [1, dim - 2] on each axis.
+namespace stencil {
+
+/// Call 'fn(i, j, k, offset)' for each interior cell on plane 'k' of a field
+template <typename Fn>
+inline void forEachInteriorPlane(const FieldBase &field, s32 k, Fn &&fn) {
+  const FieldBase::Dim &dim = field.getDim();
+  const s32 width = s32(dim.width) - 2;
+  const s32 height = s32(dim.height) - 2;
+  for (s32 j = 1; j <= height; j++) {
+    u32 offset = field.fromPos(1, j, k);
+    for (s32 i = 1; i <= width; i++, offset++) {
+      fn(i, j, k, offset);
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Call 'fn(i, j, k, offset)' for each interior cell of a field. Cells are
+/// visited in data order.
+template <typename Fn>
+inline void forEachInterior(const FieldBase &field, Fn &&fn) {
+  const s32 depth = s32(field.getDim().depth) - 2;
+  for (s32 k = 1; k <= depth; k++) {
+    forEachInteriorPlane(field, k, fn);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the sum of the 6 face neighbors of the cell at 'offset'
+inline f32 neighborSum(const Field<f32> &f, const Stride &stride, u32 offset) {
+  return f.get(offset - 1) + f.get(offset + 1) + f.get(offset - stride.y) +
+         f.get(offset + stride.y) + f.get(offset - stride.z) +
+         f.get(offset + stride.z);
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the central difference of a field along the x-axis
+inline f32 diffX(const Field<f32> &f, u32 offset) {
+  return f.get(offset + 1) - f.get(offset - 1);
+}
+
+/// Returns the central difference of a field along the y-axis
+inline f32 diffY(const Field<f32> &f, const Stride &stride, u32 offset) {
+  return f.get(offset + stride.y) - f.get(offset - stride.y);
+}
+
+/// Returns the central difference of a field along the z-axis
+inline f32 diffZ(const Field<f32> &f, const Stride &stride, u32 offset) {
+  return f.get(offset + stride.z) - f.get(offset - stride.z);
+}
+
+/// Returns the difference of the flux through the faces of a cell along an
+/// axis, weighted by the open fraction of each face. The axis is given by
+/// 'axis' and the data offset between neighbors along it by 'step'. Equals the
+/// central difference when both faces are fully open.
+inline f32 openDiff(const Field<f32> &f, const ObstructionField &o, u32 axis,
+                    u32 step, u32 offset) {
+  const f32 curr = f.get(offset);
+  return o.getOpen(axis, step, offset) * (f.get(offset + step) + curr) -
+         o.getOpen(axis, step, offset - step) * (curr + f.get(offset - step));
+}
+
+/// Returns the gradient of a field along an axis, with the one-sided
+/// differences weighted by the open fraction of each face. Equals the central
+/// difference when both faces are fully open.
+inline f32 openGrad(const Field<f32> &f, const ObstructionField &o, u32 axis,
+                    u32 step, u32 offset) {
+  const f32 curr = f.get(offset);
+  return o.getOpen(axis, step, offset) * (f.get(offset + step) - curr) +
+         o.getOpen(axis, step, offset - step) * (curr - f.get(offset - step));
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Run one in-place Gauss-Seidel relaxation of 'f = (f0 + a * neighbors) / c'
+/// over the interior of plane 'k'.
+inline void relaxPlane(Field<f32> &f, const Field<f32> &f0, s32 k, f32 a,
+                       f32 c) {
+  const Stride stride(f);
+  forEachInteriorPlane(f, k, [&](s32, s32, s32, u32 offset) {
+    f.get(offset) = (f0.get(offset) + a * neighborSum(f, stride, offset)) / c;
+  });
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Run one in-place Gauss-Seidel relaxation of the pressure equation for the
+/// cell at 'offset', where each neighbor is weighted by the open fraction of
+/// the face to it. Cells that are closed on all sides are set to zero.
+inline void relaxCellOpen(Field<f32> &f, const Field<f32> &f0,
+                          const ObstructionField &o, const Stride &stride,
+                          u32 offset) {
+  const u32 steps[3] = {1u, stride.y, stride.z};
+  f32 sum = f0.get(offset);
+  f32 weight = 0.0f;
+  for (u32 axis = 0; axis < 3; axis++) {
+    const u32 step = steps[axis];
+    const f32 aMax = o.getOpen(axis, step, offset);
+    const f32 aMin = o.getOpen(axis, step, offset - step);
+    sum += aMax * f.get(offset + step) + aMin * f.get(offset - step);
+    weight += aMax + aMin;
+  }
+  f.get(offset) = weight > 0.0f ? sum / weight : 0.0f;
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Call 'fn(offset)' for each interior cell on plane 'k' of an obstruction
+/// field that has at least one partially open face
+template <typename Fn>
+inline void forEachPartialPlane(const ObstructionField &o, s32 k, Fn &&fn) {
+  const FieldBase::Dim &dim = o.getDim();
+  const u32 plane = dim.width * dim.height;
+  const std::vector<u32> &cells = o.getPartialCells();
+  auto it = std::lower_bound(cells.begin(), cells.end(), u32(k) * plane);
+  const auto end = std::lower_bound(it, cells.end(), u32(k + 1) * plane);
+  for (; it != end; ++it) {
+    const u32 i = *it % dim.width;
+    const u32 j = *it / dim.width % dim.height;
+    if (i >= 1 && i + 1 < dim.width && j >= 1 && j + 1 < dim.height) {
+      fn(*it);
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Call 'fn(cell)' for each cell on plane 'k' of an obstruction field that is
+/// currently obstructed by a moving body
+template <typename Fn>
+inline void forEachMovingPlane(const ObstructionField &o, s32 k, Fn &&fn) {
+  using MovingCell = ObstructionField::MovingCell;
+  const FieldBase::Dim &dim = o.getDim();
+  const u32 plane = dim.width * dim.height;
+  const std::vector<MovingCell> &cells = o.getMovingCells();
+  const auto before = [](const MovingCell &cell, u32 offset) {
+    return cell.offset < offset;
+  };
+  auto it = std::lower_bound(cells.begin(), cells.end(), u32(k) * plane,
+                             before);
+  const auto end =
+      std::lower_bound(it, cells.end(), u32(k + 1) * plane, before);
+  for (; it != end; ++it) {
+    if (o.get(it->offset)) {
+      fn(*it);
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Fill the boundary of plane 'k'. Interior cells next to obstructions are
+/// blocked and the ghost cells on the faces touching the plane are set from
+/// the interior, according to the conditions of the domain boundary.
+template <FieldSubKind kKind>
+inline void fillBoundaryPlane(Field<f32> &f, const ObstructionField &o,
+                              const DomainBoundary &b, s32 k) {
+  using Face = DomainBoundary::Face;
+  using Policy = BoundaryPolicy<kKind>;
+  const FieldBase::Dim &dim = f.getDim();
+  const s32 width = s32(dim.width) - 2;
+  const s32 height = s32(dim.height) - 2;
+  const s32 depth = s32(dim.depth) - 2;
+  const Stride stride(f);
+
+  // Obstructions. Flow towards an obstructed neighbor or through a closed
+  // face is blocked. Partially open faces are instead weighted by their open
+  // fraction in the projection. That keeps the fill idempotent, as it is run
+  // many times per step.
+  if constexpr (Policy::kObstructed) {
+    const u32 step = Policy::kX ? 1u : Policy::kY ? stride.y : stride.z;
+    const u32 axis = Policy::kX ? 0u : Policy::kY ? 1u : 2u;
+    forEachInteriorPlane(f, k, [&](s32, s32, s32, u32 offset) {
+      const f32 curr = f.get(offset);
+      const bool closedMin =
+          o.get(offset - step) || o.isFaceClosed(axis, offset - step);
+      const bool closedMax =
+          o.get(offset + step) || o.isFaceClosed(axis, offset);
+      const f32 vMin = closedMin ? 0.0f : curr;
+      const f32 vMax = closedMax ? 0.0f : curr;
+      f.get(offset) = wind::clamp(curr, vMin, vMax);
+    });
+
+    // Cells of moving bodies carry the velocity of the body
+    forEachMovingPlane(o, k, [&](const ObstructionField::MovingCell &cell) {
+      f.get(cell.offset) = Policy::component(cell.velocity, 0.0f);
+    });
+  }
+
+  // X-Y faces
+  constexpr f32 kSignZ = Policy::kZ ? -1.0f : 1.0f;
+  if (k == 1) {
+    for (s32 j = 1; j <= height; j++) {
+      for (s32 i = 1; i <= width; i++) {
+        f.get(i, j, 0) = b.ghost<kKind>(Face::kMinZ, kSignZ, f.get(i, j, 1),
+                                        f.get(i, j, depth));
+      }
+    }
+  }
+  if (k == depth) {
+    for (s32 j = 1; j <= height; j++) {
+      for (s32 i = 1; i <= width; i++) {
+        f.get(i, j, depth + 1) = b.ghost<kKind>(
+            Face::kMaxZ, kSignZ, f.get(i, j, depth), f.get(i, j, 1));
+      }
+    }
+  }
+
+  // Y-Z faces
+  constexpr f32 kSignX = Policy::kX ? -1.0f : 1.0f;
+  for (s32 j = 1; j <= height; j++) {
+    const f32 min = f.get(1, j, k);
+    const f32 max = f.get(width, j, k);
+    f.get(0, j, k) = b.ghost<kKind>(Face::kMinX, kSignX, min, max);
+    f.get(width + 1, j, k) = b.ghost<kKind>(Face::kMaxX, kSignX, max, min);
+  }
+
+  // X-Z faces
+  constexpr f32 kSignY = Policy::kY ? -1.0f : 1.0f;
+  for (s32 i = 1; i <= width; i++) {
+    const f32 min = f.get(i, 1, k);
+    const f32 max = f.get(i, height, k);
+    f.get(i, 0, k) = b.ghost<kKind>(Face::kMinY, kSignY, min, max);
+    f.get(i, height + 1, k) = b.ghost<kKind>(Face::kMaxY, kSignY, max, min);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Fill the edges and corners of a field by averaging the neighboring face
+/// cells. The faces must therefore already be filled.
+inline void fillBoundaryEdges(Field<f32> &f) {
+  const FieldBase::Dim &dim = f.getDim();
+  const s32 w = s32(dim.width) - 2;
+  const s32 h = s32(dim.height) - 2;
+  const s32 d = s32(dim.depth) - 2;
+
+  // X edges
+  for (s32 i = 1; i <= w; i++) {
+    f.get(i, 0, 0) = 1.0f / 2.0f * (f.get(i, 1, 0) + f.get(i, 0, 1));
+    f.get(i, h + 1, 0) = 1.0f / 2.0f * (f.get(i, h, 0) + f.get(i, h + 1, 1));
+    f.get(i, 0, d + 1) = 1.0f / 2.0f * (f.get(i, 0, d) + f.get(i, 1, d + 1));
+    f.get(i, h + 1, d + 1) =
+        1.0f / 2.0f * (f.get(i, h, d + 1) + f.get(i, h + 1, d));
+  }
+
+  // Y edges
+  for (s32 j = 1; j <= h; j++) {
+    f.get(0, j, 0) = 1.0f / 2.0f * (f.get(1, j, 0) + f.get(0, j, 1));
+    f.get(w + 1, j, 0) = 1.0f / 2.0f * (f.get(w, j, 0) + f.get(w + 1, j, 1));
+    f.get(0, j, d + 1) = 1.0f / 2.0f * (f.get(0, j, d) + f.get(1, j, d + 1));
+    f.get(w + 1, j, d + 1) =
+        1.0f / 2.0f * (f.get(w, j, d + 1) + f.get(w + 1, j, d));
+  }
+
+  // Z edges
+  for (s32 k = 1; k <= d; k++) {
+    f.get(0, 0, k) = 1.0f / 2.0f * (f.get(0, 1, k) + f.get(1, 0, k));
+    f.get(0, h + 1, k) = 1.0f / 2.0f * (f.get(0, h, k) + f.get(1, h + 1, k));
+    f.get(w + 1, 0, k) = 1.0f / 2.0f * (f.get(w, 0, k) + f.get(w + 1, 1, k));
+    f.get(w + 1, h + 1, k) =
+        1.0f / 2.0f * (f.get(w + 1, h, k) + f.get(w, h + 1, k));
+  }
+
+  // Corners
+  f.get(0, 0, 0) =
+      1.0f / 3.0f * (f.get(1, 0, 0) + f.get(0, 1, 0) + f.get(0, 0, 1));
+  f.get(0, h + 1, 0) = 1.0f / 3.0f * (f.get(1, h + 1, 0) + f.get(0, h, 0) +
+                                      f.get(0, h + 1, 1));
+  f.get(w + 1, 0, 0) = 1.0f / 3.0f * (f.get(w, 0, 0) + f.get(w + 1, 1, 0) +
+                                      f.get(w + 1, 0, 1));
+  f.get(w + 1, h + 1, 0) =
+      1.0f / 3.0f *
+      (f.get(w, h + 1, 0) + f.get(w + 1, h, 0) + f.get(w + 1, h + 1, 1));
+  f.get(0, 0, d + 1) = 1.0f / 3.0f * (f.get(1, 0, d + 1) + f.get(0, 1, d + 1) +
+                                      f.get(0, 0, d));
+  f.get(0, h + 1, d + 1) =
+      1.0f / 3.0f *
+      (f.get(1, h + 1, d + 1) + f.get(0, h, d + 1) + f.get(0, h + 1, d));
+  f.get(w + 1, 0, d + 1) =
+      1.0f / 3.0f *
+      (f.get(w, 0, d + 1) + f.get(w + 1, 1, d + 1) + f.get(w + 1, 0, d));
+  f.get(w + 1, h + 1, d + 1) =
+      1.0f / 3.0f *
+      (f.get(w, h + 1, d + 1) + f.get(w + 1, h, d + 1) +
+       f.get(w + 1, h + 1, d));
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Fill the entire boundary of a field
+template <FieldSubKind kKind>
+inline void fillBoundary(Field<f32> &f, const ObstructionField &o,
+                         const DomainBoundary &b) {
+  const s32 depth = s32(f.getDim().depth) - 2;
+  for (s32 k = 1; k <= depth; k++) {
+    fillBoundaryPlane<kKind>(f, o, b, k);
+  }
+  fillBoundaryEdges(f);
+}
+
+} // namespace stencil
+
+} // namespace wind
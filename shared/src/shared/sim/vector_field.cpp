@@ -182,4 +182,31 @@ Vec3F VectorField::sampleNear(Vec3F point) const {
   return force;
 }
 
+// -------------------------------------------------------------------------- //
+
+Vec3F VectorField::sampleTrilinear(Vec3F point) const {
+  // Lower cell and fraction along each axis
+  const f32 cellX = clamp(point.x / m_cellSize, 0.0f, f32(m_dim.width - 1));
+  const f32 cellY = clamp(point.y / m_cellSize, 0.0f, f32(m_dim.height - 1));
+  const f32 cellZ = clamp(point.z / m_cellSize, 0.0f, f32(m_dim.depth - 1));
+  const s32 x0 = minValue(s32(cellX), s32(m_dim.width) - 2);
+  const s32 y0 = minValue(s32(cellY), s32(m_dim.height) - 2);
+  const s32 z0 = minValue(s32(cellZ), s32(m_dim.depth) - 2);
+  const f32 fx = cellX - x0;
+  const f32 fy = cellY - y0;
+  const f32 fz = cellZ - z0;
+
+  // Interpolate along x, then y, then z
+  const Vec3F c00 = get(x0, y0, z0) * (1 - fx) + get(x0 + 1, y0, z0) * fx;
+  const Vec3F c10 =
+      get(x0, y0 + 1, z0) * (1 - fx) + get(x0 + 1, y0 + 1, z0) * fx;
+  const Vec3F c01 =
+      get(x0, y0, z0 + 1) * (1 - fx) + get(x0 + 1, y0, z0 + 1) * fx;
+  const Vec3F c11 =
+      get(x0, y0 + 1, z0 + 1) * (1 - fx) + get(x0 + 1, y0 + 1, z0 + 1) * fx;
+  const Vec3F c0 = c00 * (1 - fy) + c10 * fy;
+  const Vec3F c1 = c01 * (1 - fy) + c11 * fy;
+  return c0 * (1 - fz) + c1 * fz;
+}
+
 } // namespace wind
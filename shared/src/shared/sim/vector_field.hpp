@@ -128,6 +128,12 @@ public:
   /// \note If point is out of bounds, Vec3F::ZERO is returned.
   Vec3F sampleNear(Vec3F point) const;
 
+  /// Sample the vector field with trilinear interpolation between the eight
+  /// cells around a point.
+  /// \param point Position in local meters. Positions outside of the field are
+  /// clamped to the edge cells.
+  Vec3F sampleTrilinear(Vec3F point) const;
+
   /// Set the vector at the specified location in the vector field.
   void set(u32 offset, Vec3F vec) {
     m_x->get(offset) = vec.x;
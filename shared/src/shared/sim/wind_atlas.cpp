@@ -0,0 +1,317 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "shared/sim/wind_atlas.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/sim/wind_sim.hpp"
+#include "thirdparty/dutil/file.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <dlog/dlog.hpp>
+
+#include <cmath>
+#include <cstring>
+
+// ========================================================================== //
+// WindAtlas Implementation
+// ========================================================================== //
+
+namespace wind {
+
+namespace {
+
+/// Pi
+constexpr f32 kPi = 3.14159265f;
+
+/// Magnitude below which a direction component is considered to be zero
+constexpr f32 kDirectionEpsilon = 0.001f;
+
+// -------------------------------------------------------------------------- //
+
+/// Set the conditions of the two faces along an axis for inflow with the
+/// specified velocity component. Faces are set to outflow when the component
+/// is close to zero so that the flow can pass along the axis.
+void setAxisConditions(WindSimulation &sim, DomainBoundary::Face minFace,
+                       f32 component, const Vec3F &velocity) {
+  const auto maxFace = DomainBoundary::Face(minFace + 1u);
+  if (component > kDirectionEpsilon) {
+    sim.setDomainCondition(minFace, DomainCondition::kInflow, velocity);
+    sim.setDomainCondition(maxFace, DomainCondition::kOutflow);
+  } else if (component < -kDirectionEpsilon) {
+    sim.setDomainCondition(minFace, DomainCondition::kOutflow);
+    sim.setDomainCondition(maxFace, DomainCondition::kInflow, velocity);
+  } else {
+    sim.setDomainCondition(minFace, DomainCondition::kOutflow);
+    sim.setDomainCondition(maxFace, DomainCondition::kOutflow);
+  }
+}
+
+} // namespace
+
+// -------------------------------------------------------------------------- //
+
+void WindAtlas::build(WindSimulation &sim, u32 directionCount, f32 strength,
+                      f32 delta) {
+  MICROPROFILE_SCOPEI("WindAtlas", "build", MP_ORANGE1);
+
+  const VectorField &v = sim.V();
+  m_dim = v.getDim();
+  m_cellCount = v.getCellCount();
+  m_cellSize = v.getCellSize();
+  m_strength = strength;
+  m_scales.assign(directionCount, 1.0f);
+  m_entries.assign(u64(directionCount) * m_cellCount * 3, 0);
+
+  const DomainBoundary boundary = sim.getDomainBoundary();
+  for (u32 entry = 0; entry < directionCount; entry++) {
+    // Run to steady state with inflow from the upwind faces
+    const Vec3F velocity = getDirection(entry) * strength;
+    setAxisConditions(sim, DomainBoundary::kMinX, velocity.x, velocity);
+    setAxisConditions(sim, DomainBoundary::kMinZ, velocity.z, velocity);
+    sim.setAsVec(velocity);
+    const WindSimulation::SteadyState state = sim.solveSteadyState(delta);
+    if (!state.converged) {
+      DLOG_WARNING("wind atlas entry {} did not converge (change {})", entry,
+                   state.change);
+    }
+
+    // Quantise
+    f32 maxAbs = 0.0f;
+    for (u32 i = 0; i < m_cellCount; i++) {
+      maxAbs = maxValue(maxAbs, std::abs(v.getX()->get(i)),
+                        std::abs(v.getY()->get(i)));
+      maxAbs = maxValue(maxAbs, std::abs(v.getZ()->get(i)));
+    }
+    const f32 scale = maxAbs > 0.0f ? maxAbs / 32767.0f : 1.0f;
+    m_scales[entry] = scale;
+    s16 *out = m_entries.data() + u64(entry) * m_cellCount * 3;
+    for (u32 i = 0; i < m_cellCount; i++) {
+      out[i * 3 + 0] = s16(std::lround(v.getX()->get(i) / scale));
+      out[i * 3 + 1] = s16(std::lround(v.getY()->get(i) / scale));
+      out[i * 3 + 2] = s16(std::lround(v.getZ()->get(i) / scale));
+    }
+    DLOG_VERBOSE("wind atlas entry {} reached steady state in {} steps",
+                 entry, state.steps);
+  }
+
+  // Restore domain conditions
+  for (u32 face = 0; face < DomainBoundary::kFaceCount; face++) {
+    sim.setDomainCondition(DomainBoundary::Face(face),
+                           boundary.conditions[face], boundary.inflow[face]);
+  }
+
+  setWind(getDirection(0), strength);
+  DLOG_INFO("built wind atlas with {} directions ({} bytes)", directionCount,
+            sizeof(s16) * m_entries.size());
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindAtlas::setWind(const Vec3F &direction, f32 strength) {
+  const u32 entryCount = getEntryCount();
+  if (entryCount == 0) {
+    return;
+  }
+
+  // Find the two entries around the direction
+  f32 angle = std::atan2(direction.z, direction.x);
+  if (angle < 0.0f) {
+    angle += 2.0f * kPi;
+  }
+  const f32 position = angle / (2.0f * kPi) * entryCount;
+  const u32 entry0 = minValue(u32(position), entryCount - 1);
+  const u32 entry1 = (entry0 + 1) % entryCount;
+  const f32 t = clamp(position - entry0, 0.0f, 1.0f);
+
+  const f32 factor = m_strength > 0.0f ? strength / m_strength : 0.0f;
+  m_blendEntries[0] = entry0;
+  m_blendEntries[1] = entry1;
+  m_blendWeights[0] = (1.0f - t) * factor * m_scales[entry0];
+  m_blendWeights[1] = t * factor * m_scales[entry1];
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F WindAtlas::sample(const Vec3F &point) const {
+  if (getEntryCount() == 0) {
+    return Vec3F::ZERO;
+  }
+
+  // Lower cell and fraction along each axis
+  const f32 cellX = clamp(point.x / m_cellSize, 0.0f, f32(m_dim.width - 1));
+  const f32 cellY = clamp(point.y / m_cellSize, 0.0f, f32(m_dim.height - 1));
+  const f32 cellZ = clamp(point.z / m_cellSize, 0.0f, f32(m_dim.depth - 1));
+  const u32 x0 = minValue(u32(cellX), m_dim.width - 2);
+  const u32 y0 = minValue(u32(cellY), m_dim.height - 2);
+  const u32 z0 = minValue(u32(cellZ), m_dim.depth - 2);
+  const f32 fx = cellX - x0;
+  const f32 fy = cellY - y0;
+  const f32 fz = cellZ - z0;
+
+  // Interpolate along x, then y, then z
+  const Vec3F c00 = sampleCell(x0, y0, z0) * (1 - fx) +
+                    sampleCell(x0 + 1, y0, z0) * fx;
+  const Vec3F c10 = sampleCell(x0, y0 + 1, z0) * (1 - fx) +
+                    sampleCell(x0 + 1, y0 + 1, z0) * fx;
+  const Vec3F c01 = sampleCell(x0, y0, z0 + 1) * (1 - fx) +
+                    sampleCell(x0 + 1, y0, z0 + 1) * fx;
+  const Vec3F c11 = sampleCell(x0, y0 + 1, z0 + 1) * (1 - fx) +
+                    sampleCell(x0 + 1, y0 + 1, z0 + 1) * fx;
+  const Vec3F c0 = c00 * (1 - fy) + c10 * fy;
+  const Vec3F c1 = c01 * (1 - fy) + c11 * fy;
+  return c0 * (1 - fz) + c1 * fz;
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F WindAtlas::sampleWorld(const Vec3F &point) const {
+  // Outside of the interior
+  const Vec3F local = point - m_origin;
+  const Vec3F size = Vec3F(f32(m_dim.width - 2), f32(m_dim.height - 2),
+                           f32(m_dim.depth - 2)) *
+                     m_cellSize;
+  if (getEntryCount() == 0 || local.x < 0.0f || local.y < 0.0f ||
+      local.z < 0.0f || local.x > size.x || local.y > size.y ||
+      local.z > size.z) {
+    return Vec3F::ZERO;
+  }
+
+  // The center of interior cell 'i' lies at (i - 0.5) cells from the origin
+  return sample(local + Vec3F::ONE * (0.5f * m_cellSize));
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F WindAtlas::sampleCell(u32 x, u32 y, u32 z) const {
+  const u64 cell = x + u64(m_dim.width) * (y + u64(m_dim.height) * z);
+  const s16 *e0 =
+      m_entries.data() + (u64(m_blendEntries[0]) * m_cellCount + cell) * 3;
+  const s16 *e1 =
+      m_entries.data() + (u64(m_blendEntries[1]) * m_cellCount + cell) * 3;
+  const f32 w0 = m_blendWeights[0];
+  const f32 w1 = m_blendWeights[1];
+  return Vec3F(w0 * e0[0] + w1 * e1[0], w0 * e0[1] + w1 * e1[1],
+               w0 * e0[2] + w1 * e1[2]);
+}
+
+// -------------------------------------------------------------------------- //
+
+bool WindAtlas::save(const std::string &path) const {
+  MICROPROFILE_SCOPEI("WindAtlas", "save", MP_ORANGE1);
+
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.width = m_dim.width;
+  header.height = m_dim.height;
+  header.depth = m_dim.depth;
+  header.cellSize = m_cellSize;
+  header.entryCount = getEntryCount();
+  header.strength = m_strength;
+
+  const u64 scalesSize = sizeof(f32) * m_scales.size();
+  const u64 entriesSize = sizeof(s16) * m_entries.size();
+  std::vector<u8> buffer(sizeof(Header) + scalesSize + entriesSize);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  std::memcpy(buffer.data() + sizeof(Header), m_scales.data(), scalesSize);
+  std::memcpy(buffer.data() + sizeof(Header) + scalesSize, m_entries.data(),
+              entriesSize);
+
+  dutil::File file{};
+  dutil::File::Result res = file.Open(path, dutil::File::Mode::kWrite);
+  if (res == dutil::File::Result::kSuccess) {
+    res = file.Write(buffer);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to write wind atlas {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool WindAtlas::load(const std::string &path) {
+  MICROPROFILE_SCOPEI("WindAtlas", "load", MP_ORANGE1);
+
+  dutil::File file{};
+  dutil::File::Result res = file.Open(path, dutil::File::Mode::kRead);
+  std::vector<u8> buffer;
+  if (res == dutil::File::Result::kSuccess) {
+    res = file.Load(buffer);
+  }
+  if (res != dutil::File::Result::kSuccess) {
+    DLOG_ERROR("failed to load wind atlas {}: {}", path,
+               dutil::File::ResultToString(res));
+    return false;
+  }
+
+  // Validate header
+  Header header;
+  if (buffer.size() < sizeof(Header)) {
+    DLOG_ERROR("wind atlas {} is too small to contain a header", path);
+    return false;
+  }
+  std::memcpy(&header, buffer.data(), sizeof(Header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    DLOG_ERROR("wind atlas {} has an invalid magic number or version", path);
+    return false;
+  }
+  const u64 cellCount = u64(header.width) * header.height * header.depth;
+  const u64 scalesSize = sizeof(f32) * header.entryCount;
+  const u64 entriesSize = sizeof(s16) * cellCount * 3 * header.entryCount;
+  if (header.width < 2 || header.height < 2 || header.depth < 2 ||
+      buffer.size() < sizeof(Header) + scalesSize + entriesSize) {
+    DLOG_ERROR("wind atlas {} is truncated", path);
+    return false;
+  }
+
+  // Read data
+  m_dim = FieldBase::Dim{header.width, header.height, header.depth};
+  m_cellCount = u32(cellCount);
+  m_cellSize = header.cellSize;
+  m_strength = header.strength;
+  m_scales.resize(header.entryCount);
+  m_entries.resize(cellCount * 3 * header.entryCount);
+  std::memcpy(m_scales.data(), buffer.data() + sizeof(Header), scalesSize);
+  std::memcpy(m_entries.data(), buffer.data() + sizeof(Header) + scalesSize,
+              entriesSize);
+
+  setWind(getDirection(0), m_strength);
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F WindAtlas::getDirection(u32 entry) const {
+  const f32 angle = 2.0f * kPi * entry / maxValue(getEntryCount(), 1u);
+  return Vec3F(std::cos(angle), 0.0f, std::sin(angle));
+}
+
+} // namespace wind
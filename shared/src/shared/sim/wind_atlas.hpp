@@ -0,0 +1,163 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/math/field.hpp"
+#include "shared/types.hpp"
+
+#include <string>
+#include <vector>
+
+// ========================================================================== //
+// WindAtlas Declaration
+// ========================================================================== //
+
+namespace wind {
+
+WIND_FORWARD_DECLARE(WindSimulation);
+
+/// Atlas of precomputed steady-state wind fields for a set of prevailing
+/// directions.
+///
+/// Each entry is built by running the simulation to steady state with inflow
+/// from one direction in the horizontal plane. The fields are quantised to 16
+/// bits with a scale per entry, both in memory and on disk.
+///
+/// At runtime the global wind is set as a direction and a strength. The two
+/// entries closest to the direction are blended by their angular distance and
+/// scaled by the strength relative to the strength that the atlas was built
+/// with, so that a query costs two lookups per cell.
+///
+/// An atlas can be placed in the world and sampled by the wind system with
+/// 'WindSystem::setAtlasSource'. The wind must then only be set from the
+/// thread that queries the wind system.
+class WindAtlas {
+public:
+  /// Magic number at the start of each atlas file ("WATL")
+  static constexpr u32 kMagic = 0x4C544157u;
+  /// Current version of the atlas format
+  static constexpr u32 kVersion = 1u;
+  /// Default number of directions
+  static constexpr u32 kDefaultDirectionCount = 8u;
+
+  /// Header of an atlas file. The header is followed by the scale of each
+  /// entry (f32) and then the quantised fields (3 s16 per cell) of each entry.
+  struct Header {
+    /// Magic number, must be 'kMagic'
+    u32 magic;
+    /// Version of the format, must be 'kVersion'
+    u32 version;
+    /// Width of the fields in cells, including boundary cells
+    u32 width;
+    /// Height of the fields in cells, including boundary cells
+    u32 height;
+    /// Depth of the fields in cells, including boundary cells
+    u32 depth;
+    /// Size of a cell in meters
+    f32 cellSize;
+    /// Number of entries (directions)
+    u32 entryCount;
+    /// Inflow strength that the entries were built with (m/s)
+    f32 strength;
+  };
+
+public:
+  /// Construct empty atlas
+  WindAtlas() = default;
+
+  /// Build the atlas by running a simulation to steady state for
+  /// 'directionCount' directions that are evenly spread around the up axis.
+  /// The domain conditions of the simulation are restored afterwards, while
+  /// the velocity is left as the steady state of the last direction.
+  void build(WindSimulation &sim, u32 directionCount, f32 strength,
+             f32 delta);
+
+  /// Set the global wind. Only the horizontal part of the direction is used.
+  void setWind(const Vec3F &direction, f32 strength);
+
+  /// Sample the wind at a point in local meters. The point is clamped to the
+  /// fields, like for 'VectorField::sampleTrilinear'.
+  Vec3F sample(const Vec3F &point) const;
+
+  /// Sample the wind at a point in world space, in the same way as
+  /// 'WindSnapshots::sample' samples a simulation. Returns zero outside of the
+  /// interior of the fields.
+  Vec3F sampleWorld(const Vec3F &point) const;
+
+  /// Sample the blended wind of a single cell
+  Vec3F sampleCell(u32 x, u32 y, u32 z) const;
+
+  /// Save the atlas to a file
+  bool save(const std::string &path) const;
+
+  /// Load the atlas from a file
+  bool load(const std::string &path);
+
+  /// Returns the number of entries
+  u32 getEntryCount() const { return u32(m_scales.size()); }
+
+  /// Returns the direction of an entry
+  Vec3F getDirection(u32 entry) const;
+
+  /// Returns the dimensions of the fields
+  const FieldBase::Dim &getDim() const { return m_dim; }
+
+  /// Set the world position of the minimum corner of the interior of the
+  /// fields, which is where the simulation that the atlas was built from was
+  /// placed. Defaults to zero.
+  void setOrigin(const Vec3F &origin) { m_origin = origin; }
+
+  /// Returns the world position of the minimum corner of the interior of the
+  /// fields
+  const Vec3F &getOrigin() const { return m_origin; }
+
+private:
+  /// Dimensions of the fields
+  FieldBase::Dim m_dim{0, 0, 0};
+  /// Number of cells in each field
+  u32 m_cellCount = 0;
+  /// Size of a cell in meters
+  f32 m_cellSize = 1.0f;
+  /// Inflow strength that the entries were built with
+  f32 m_strength = 1.0f;
+  /// World position of the minimum corner of the interior of the fields
+  Vec3F m_origin = Vec3F::ZERO;
+
+  /// Scale of each entry
+  std::vector<f32> m_scales;
+  /// Quantised fields of each entry, 3 components per cell
+  std::vector<s16> m_entries;
+
+  /// Entries that are currently blended
+  u32 m_blendEntries[2] = {0, 0};
+  /// Weight of the blended entries, including scale and strength
+  f32 m_blendWeights[2] = {0.0f, 0.0f};
+};
+
+} // namespace wind
@@ -0,0 +1,66 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "shared/sim/wind_history.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/sim/wind_sim.hpp"
+#include "shared/sim/wind_snapshots.hpp"
+
+#include "microprofile/microprofile.h"
+
+// ========================================================================== //
+// WindHistory Implementation
+// ========================================================================== //
+
+namespace wind {
+
+WindHistory::WindHistory(WindSimulation *sim, WindSnapshots *snapshots,
+                         const Vec3F &origin, f32 stepDelta)
+    : m_sim(sim), m_snapshots(snapshots), m_origin(origin),
+      m_stepDelta(stepDelta) {
+  assert(sim && snapshots && "History requires a simulation and snapshots");
+  assert(stepDelta > 0.0f && "Step delta must be positive");
+
+  m_snapshots->publish(m_sim->V(), m_origin, -m_stepDelta);
+  m_snapshots->publish(m_sim->V(), m_origin, m_stepTime);
+  m_snapshots->setTime(getTime());
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindHistory::update(f32 delta) {
+  MICROPROFILE_SCOPEI("WindHistory", "update", MP_ORANGE1);
+
+  m_time += delta;
+  while (m_time >= m_stepTime + m_stepDelta) {
+    m_sim->step(m_stepDelta);
+    m_stepTime += m_stepDelta;
+    m_snapshots->publish(m_sim->V(), m_origin, m_stepTime);
+  }
+  m_snapshots->setTime(getTime());
+}
+
+} // namespace wind
@@ -0,0 +1,94 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/math/math.hpp"
+#include "shared/types.hpp"
+
+// ========================================================================== //
+// WindHistory Declaration
+// ========================================================================== //
+
+namespace wind {
+
+WIND_FORWARD_DECLARE(WindSimulation);
+WIND_FORWARD_DECLARE(WindSnapshots);
+
+/// Layer on top of a wind simulation that lets the simulation run at a lower
+/// rate than the wind is queried at.
+///
+/// The simulation is stepped with a fixed step delta and each completed step
+/// is published to wind snapshots together with its time. The snapshots are
+/// then sampled between the last two steps in time, and trilinearly in space,
+/// which means that the wind that is returned lags behind the simulation by
+/// one step.
+class WindHistory {
+public:
+  /// Default step delta of the simulation (10 Hz)
+  static constexpr f32 kDefaultStepDelta = 0.1f;
+
+public:
+  /// Construct history for a simulation that publishes to 'snapshots'.
+  /// 'origin' is the world position of the minimum corner of the interior of
+  /// the simulation. The current velocity field of the simulation is
+  /// published as both the previous and the latest step.
+  WindHistory(WindSimulation *sim, WindSnapshots *snapshots,
+              const Vec3F &origin, f32 stepDelta = kDefaultStepDelta);
+
+  WindHistory(const WindHistory &other) = delete;
+  WindHistory &operator=(const WindHistory &other) = delete;
+
+  /// Advance time by 'delta'. The simulation is stepped once for each full
+  /// step delta that has passed.
+  void update(f32 delta);
+
+  /// Returns the time that queries are currently answered for
+  f32 getTime() const { return m_time - m_stepDelta; }
+
+  /// Returns the step delta of the simulation
+  f32 getStepDelta() const { return m_stepDelta; }
+
+  /// Returns the simulation
+  WindSimulation *getSim() const { return m_sim; }
+
+private:
+  /// Simulation
+  WindSimulation *m_sim;
+  /// Snapshots that the steps are published to
+  WindSnapshots *m_snapshots;
+  /// World position of the minimum corner of the interior of the simulation
+  Vec3F m_origin;
+  /// Step delta of the simulation
+  f32 m_stepDelta;
+  /// Current time
+  f32 m_time = 0.0f;
+  /// Time of the latest step
+  f32 m_stepTime = 0.0f;
+};
+
+} // namespace wind
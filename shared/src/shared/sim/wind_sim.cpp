@@ -28,11 +28,16 @@
 
 #include "shared/debug/debug_manager.hpp"
 #include "shared/math/math.hpp"
+#include "shared/utility/task_graph.hpp"
 
 #include "microprofile/microprofile.h"
 
 #include <dlog/dlog.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 // ========================================================================== //
 // Editor Declaration
 // ========================================================================== //
@@ -43,8 +48,6 @@ WindSimulation::WindSimulation(s32 width, s32 height, s32 depth, f32 cellSize)
     : m_width(width * u32(1.0f / cellSize)),
       m_height(height * u32(1.0f / cellSize)),
       m_depth(depth * u32(1.0f / cellSize)), m_cellSize(cellSize),
-      m_d(m_width + 2, m_height + 2, m_depth + 2, cellSize),
-      m_d0(m_width + 2, m_height + 2, m_depth + 2, cellSize),
       m_v(m_width + 2, m_height + 2, m_depth + 2, cellSize),
       m_v0(m_width + 2, m_height + 2, m_depth + 2, cellSize),
       m_o(m_width + 2, m_height + 2, m_depth + 2, cellSize) {
@@ -53,30 +56,58 @@ WindSimulation::WindSimulation(s32 width, s32 height, s32 depth, f32 cellSize)
          "Extent of wind simulation must not be zero in any dimension");
 
   // Clear
-  for (u32 i = 0; i < m_d.getCellCount(); i++) {
-    m_d.get(i) = 0.0f;
-    m_d0.get(i) = 0.0f;
+  for (u32 i = 0; i < m_v.getCellCount(); i++) {
     m_v.set(i, Vec3F());
     m_v0.set(i, Vec3F());
     m_o.get(i) = false;
   }
 
-  // Initialize
-  for (u32 i = 0; i < m_d.getCellCount(); i++) {
-    m_d.get(i) = 0.0f;
-    m_d0.get(i) = 0.0f;
-  }
-
   DebugManager::setF32(kDebugRunSpeed, 1.0f);
 
   // setAsTornado();
   setAsVec(Vec3F{0.0f, 0.0f, 1.0f});
 
   // Post-conditions
-  assert(m_d.getDim() == m_v.getDim() &&
-         "Density and vector field must have the same dimensions");
-  assert(m_d.getDim() == m_o.getDim() &&
-         "Density and obstruction field must have the same dimensions");
+  assert(m_v.getDim() == m_o.getDim() &&
+         "Vector and obstruction field must have the same dimensions");
+}
+
+// -------------------------------------------------------------------------- //
+
+WindSimulation::~WindSimulation() {
+  delete m_d;
+  delete m_d0;
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::addDensityConsumer() {
+  if (m_densityConsumers++ > 0) {
+    return;
+  }
+
+  const FieldBase::Dim dim = m_v.getDim();
+  m_d = new DensityField(dim.width, dim.height, dim.depth, m_cellSize);
+  m_d0 = new DensityField(dim.width, dim.height, dim.depth, m_cellSize);
+  for (u32 i = 0; i < m_d->getCellCount(); i++) {
+    m_d->get(i) = 0.0f;
+    m_d0->get(i) = 0.0f;
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::removeDensityConsumer() {
+  assert(m_densityConsumers > 0 &&
+         "Density consumer removed without having been added");
+  if (--m_densityConsumers > 0) {
+    return;
+  }
+
+  delete m_d;
+  delete m_d0;
+  m_d = nullptr;
+  m_d0 = nullptr;
 }
 
 // -------------------------------------------------------------------------- //
@@ -103,101 +134,405 @@ void WindSimulation::buildForScene(const bs::SPtr<bs::SceneInstance> &scene,
 void WindSimulation::step(f32 delta) {
   MICROPROFILE_SCOPEI("Sim", "step", MP_ORANGE1);
   delta *= DebugManager::getF32(kDebugRunSpeed);
-  stepDensity(delta);
-  stepVelocity(delta);
+  stepConcurrent(delta);
 }
 
 // -------------------------------------------------------------------------- //
 
 void WindSimulation::stepN(f32 delta, u32 steps) {
   for (u32 i = 0; i < steps; i++) {
-    stepDensity(delta);
-    stepVelocity(delta);
+    stepConcurrent(delta);
   }
 }
 
 // -------------------------------------------------------------------------- //
 
+WindSimulation::SteadyState
+WindSimulation::solveSteadyState(f32 delta, f32 tolerance, u32 maxSteps) {
+  MICROPROFILE_SCOPEI("Sim", "solveSteadyState", MP_ORANGE1);
+
+  // Velocity of the previous step
+  std::vector<Vec3F> previous(m_v.getCellCount());
+  for (u32 i = 0; i < m_v.getCellCount(); i++) {
+    previous[i] = m_v.get(i);
+  }
+
+  SteadyState state;
+  while (state.steps < maxSteps) {
+    stepConcurrent(delta);
+    state.steps++;
+
+    // Largest change of any component in any cell
+    state.change = 0.0f;
+    for (u32 i = 0; i < m_v.getCellCount(); i++) {
+      const Vec3F v = m_v.get(i);
+      const Vec3F d = v - previous[i];
+      state.change = maxValue(
+          state.change, maxValue(std::abs(d.x), std::abs(d.y), std::abs(d.z)));
+      previous[i] = v;
+    }
+
+    if (state.change <= tolerance) {
+      state.converged = true;
+      break;
+    }
+    if (state.steps % kSteadyStateReportInterval == 0) {
+      DLOG_VERBOSE("steady state step {}, velocity change {} (tolerance {})",
+                   state.steps, state.change, tolerance);
+    }
+  }
+
+  if (state.converged) {
+    DLOG_INFO("steady state reached after {} steps (velocity change {})",
+              state.steps, state.change);
+  } else {
+    DLOG_WARNING("steady state not reached after {} steps (velocity change "
+                 "{}, tolerance {})",
+                 state.steps, state.change, tolerance);
+  }
+  return state;
+}
+
+// -------------------------------------------------------------------------- //
+
 void WindSimulation::stepDensity(f32 delta) {
-  // Source/Sink
-  for (u32 i = 0; i < m_d.getCellCount(); i++) {
-    m_d.get(i) += delta * m_d0.get(i);
+  if (!hasDensity()) {
+    return;
+  }
+
+  sourceDensity(delta);
+  if (m_densityDiffusionActive) {
+    diffuseDensity(delta);
+  }
+  if (m_densityAdvectionActive) {
+    advectDensity(delta);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::stepVelocity(f32 delta) {
+  sourceVelocity(FieldSubKind::kVelX, delta);
+  sourceVelocity(FieldSubKind::kVelY, delta);
+  sourceVelocity(FieldSubKind::kVelZ, delta);
+  if (DebugManager::getBool(kDebugVelocitySource)) {
+    DebugManager::setBool(kDebugVelocitySource, false);
+    addDebugVelocitySource();
+  }
+  const bool bodies = !m_bodies.empty() || !m_o.getMovingCells().empty();
+  if (bodies) {
+    splatBodies();
+  }
+
+  if (m_velocityDiffusionActive) {
+    diffuseVelocity(FieldSubKind::kVelX, delta);
+    diffuseVelocity(FieldSubKind::kVelY, delta);
+    diffuseVelocity(FieldSubKind::kVelZ, delta);
+    projectVelocity();
+  }
+
+  if (m_velocityAdvectionActive) {
+    swapVelocity();
+    advectVelocity(FieldSubKind::kVelX, delta);
+    advectVelocity(FieldSubKind::kVelY, delta);
+    advectVelocity(FieldSubKind::kVelZ, delta);
+    projectVelocity();
+  }
+
+  if (bodies) {
+    releaseBodies();
+  }
+  clearVelocitySource();
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::stepSerial(f32 delta) {
+  TaskGraph graph;
+  buildStep(graph, delta);
+  graph.runSerial();
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::stepConcurrent(f32 delta) {
+  TaskGraph graph;
+  buildStep(graph, delta);
+  graph.run();
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::buildStep(TaskGraph &graph, f32 delta) {
+  using TaskId = TaskGraph::TaskId;
+
+  // Debug variables are not thread-safe, read them before starting
+  const bool debugVelocitySource = DebugManager::getBool(kDebugVelocitySource);
+  if (debugVelocitySource) {
+    DebugManager::setBool(kDebugVelocitySource, false);
+  }
+
+  // Density source and diffusion do not depend on the velocity
+  const bool density = hasDensity();
+  TaskId d = 0;
+  if (density) {
+    d = graph.add([this, delta]() { sourceDensity(delta); });
+    if (m_densityDiffusionActive) {
+      d = graph.add([this, delta]() { diffuseDensity(delta); }, {d});
+    }
+  }
+
+  // Velocity components are independent until they are projected
+  TaskId vx = graph.add(
+      [this, delta]() { sourceVelocity(FieldSubKind::kVelX, delta); });
+  TaskId vy = graph.add(
+      [this, delta]() { sourceVelocity(FieldSubKind::kVelY, delta); });
+  TaskId vz = graph.add(
+      [this, delta]() { sourceVelocity(FieldSubKind::kVelZ, delta); });
+  if (debugVelocitySource) {
+    vx = vy = vz =
+        graph.add([this]() { addDebugVelocitySource(); }, {vx, vy, vz});
+  }
+  const bool bodies = !m_bodies.empty() || !m_o.getMovingCells().empty();
+  if (bodies) {
+    vx = vy = vz = graph.add([this]() { splatBodies(); }, {vx, vy, vz});
+  }
+
+  if (m_velocityDiffusionActive) {
+    vx = graph.add(
+        [this, delta]() { diffuseVelocity(FieldSubKind::kVelX, delta); },
+        {vx});
+    vy = graph.add(
+        [this, delta]() { diffuseVelocity(FieldSubKind::kVelY, delta); },
+        {vy});
+    vz = graph.add(
+        [this, delta]() { diffuseVelocity(FieldSubKind::kVelZ, delta); },
+        {vz});
+    vx = vy = vz = graph.add([this]() { projectVelocity(); }, {vx, vy, vz});
+  }
+
+  if (m_velocityAdvectionActive) {
+    const TaskId swap = graph.add([this]() { swapVelocity(); }, {vx, vy, vz});
+    vx = graph.add(
+        [this, delta]() { advectVelocity(FieldSubKind::kVelX, delta); },
+        {swap});
+    vy = graph.add(
+        [this, delta]() { advectVelocity(FieldSubKind::kVelY, delta); },
+        {swap});
+    vz = graph.add(
+        [this, delta]() { advectVelocity(FieldSubKind::kVelZ, delta); },
+        {swap});
+    vx = vy = vz = graph.add([this]() { projectVelocity(); }, {vx, vy, vz});
+  }
+
+  // Density is not affected by obstructions, so it can be advected while the
+  // obstructions of the bodies are removed
+  if (bodies) {
+    graph.add([this]() { releaseBodies(); }, {vx, vy, vz});
+  }
+  graph.add([this]() { clearVelocitySource(); }, {vx, vy, vz});
+
+  // Density is advected by the velocity of this step
+  if (density && m_densityAdvectionActive) {
+    graph.add([this, delta]() { advectDensity(delta); }, {d, vx, vy, vz});
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::sourceDensity(f32 delta) {
+  DensityField &d = *m_d;
+  const DensityField &d0 = *m_d0;
+  for (u32 i = 0; i < d.getCellCount(); i++) {
+    d.get(i) += delta * d0.get(i);
   }
   if (m_addDensitySource) {
     m_addDensitySource = false;
-    m_d.get(1, 1, 1) = 0.5f;
-    m_d.get(1, 2, 1) = 0.5f;
-    m_d.get(1, 3, 1) = 0.5f;
-    m_d.get(1, 4, 1) = 0.5f;
-    m_d.get(1, 5, 1) = 0.5f;
+    d.get(1, 1, 1) = 0.5f;
+    d.get(1, 2, 1) = 0.5f;
+    d.get(1, 3, 1) = 0.5f;
+    d.get(1, 4, 1) = 0.5f;
+    d.get(1, 5, 1) = 0.5f;
   }
   if (m_addDensitySink) {
     m_addDensitySink = false;
-    m_d.get(m_width - 3, 1, m_depth - 3) = 0.0f;
-    m_d.get(m_width - 3, 2, m_depth - 3) = 0.0f;
-    m_d.get(m_width - 3, 3, m_depth - 3) = 0.0f;
-    m_d.get(m_width - 3, 4, m_depth - 3) = 0.0f;
-    m_d.get(m_width - 3, 5, m_depth - 3) = 0.0f;
+    d.get(m_width - 3, 1, m_depth - 3) = 0.0f;
+    d.get(m_width - 3, 2, m_depth - 3) = 0.0f;
+    d.get(m_width - 3, 3, m_depth - 3) = 0.0f;
+    d.get(m_width - 3, 4, m_depth - 3) = 0.0f;
+    d.get(m_width - 3, 5, m_depth - 3) = 0.0f;
   }
+}
 
-  // Diffusion
-  if (m_densityDiffusionActive) {
-    DensityField::swap(m_d, m_d0);
-    diffuse(&m_d, &m_d0, FieldSubKind::kDens, m_diffusion, delta);
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::diffuseDensity(f32 delta) {
+  DensityField::swap(*m_d, *m_d0);
+  diffuse(m_d, m_d0, FieldSubKind::kDens, m_diffusion, delta);
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::advectDensity(f32 delta) {
+  DensityField::swap(*m_d, *m_d0);
+  advect(m_d, m_d0, &m_v, FieldSubKind::kDens, delta);
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::sourceVelocity(FieldSubKind comp, f32 delta) {
+  Field<f32> *f = velocityComp(m_v, comp);
+  const Field<f32> *f0 = velocityComp(m_v0, comp);
+  for (u32 i = 0; i < f->getCellCount(); i++) {
+    f->get(i) += delta * f0->get(i);
   }
+}
 
-  // Advection
-  if (m_densityAdvectionActive) {
-    DensityField::swap(m_d, m_d0);
-    advect(&m_d, &m_d0, &m_v, FieldSubKind::kDens, delta);
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::clearVelocitySource() {
+  for (Field<f32> *f0 : {m_v0.getX(), m_v0.getY(), m_v0.getZ()}) {
+    std::fill(f0->data(), f0->data() + f0->getCellCount(), 0.0f);
   }
 }
 
 // -------------------------------------------------------------------------- //
 
-void WindSimulation::stepVelocity(f32 delta) {
-  // Source/Sink
-  for (u32 i = 0; i < m_v.getCellCount(); i++) {
-    Vec3F oldValue = m_v.get(i);
-    const Vec3F newValue = oldValue += delta * m_v0.get(i);
-    m_v.set(i, newValue);
+void WindSimulation::addDebugVelocitySource() {
+  for (s32 x = 11; x < 16; x++) {
+    for (s32 y = 3; y < 7; y++) {
+      for (s32 z = 4; z < 6; z++) {
+        m_v.set(x, y, z, Vec3F(0.0f, 0.0f, 50.0f));
+        m_v0.set(x, y, z, Vec3F(0.0f, 0.0f, 50.0f));
+      }
+      // for (s32 z = 2; z < 4; z++) {
+      //  m_v.set(x, y, z, Vec3F(0.0f, 0.0f, 0.0f));
+      //  m_v0.set(x, y, z, Vec3F(0.0f, 0.0f, 0.0f));
+      //}
+    }
   }
-  if (DebugManager::getBool(kDebugVelocitySource)) {
-    DebugManager::setBool(kDebugVelocitySource, false);
-    for (s32 x = 11; x < 16; x++) {
-      for (s32 y = 3; y < 7; y++) {
-        for (s32 z = 4; z < 6; z++) {
-          m_v.set(x, y, z, Vec3F(0.0f, 0.0f, 50.0f));
-          m_v0.set(x, y, z, Vec3F(0.0f, 0.0f, 50.0f));
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::splatBodies() {
+  MICROPROFILE_SCOPEI("Sim", "splatBodies", MP_ORANGE2);
+
+  // Air moves into the cells that the bodies obstructed during the last step
+  // with the velocity of the body that left them. Cells that are still
+  // covered are overwritten below.
+  std::vector<ObstructionField::MovingCell> &cells = m_o.getMovingCells();
+  for (const ObstructionField::MovingCell &cell : cells) {
+    if (!m_o.get(cell.offset)) {
+      m_v.set(cell.offset, cell.velocity);
+    }
+  }
+  cells.clear();
+
+  const f32 cellSize = m_cellSize;
+  for (const Body &body : m_bodies) {
+    // Range of interior cells that the bounds overlap. Interior cell 'i'
+    // covers [(i - 1), i] cells from the minimum corner.
+    const s32 x0 = maxValue(s32(std::floor(body.min.x / cellSize)) + 1, 1);
+    const s32 y0 = maxValue(s32(std::floor(body.min.y / cellSize)) + 1, 1);
+    const s32 z0 = maxValue(s32(std::floor(body.min.z / cellSize)) + 1, 1);
+    const s32 x1 = minValue(s32(std::ceil(body.max.x / cellSize)), m_width);
+    const s32 y1 = minValue(s32(std::ceil(body.max.y / cellSize)), m_height);
+    const s32 z1 = minValue(s32(std::ceil(body.max.z / cellSize)), m_depth);
+
+    // Fraction of a cell along an axis that is covered by the bounds
+    const auto coverage = [cellSize](s32 i, f32 min, f32 max) {
+      const f32 lo = maxValue((i - 1) * cellSize, min);
+      const f32 hi = minValue(i * cellSize, max);
+      return clamp((hi - lo) / cellSize, 0.0f, 1.0f);
+    };
+
+    for (s32 z = z0; z <= z1; z++) {
+      const f32 cz = coverage(z, body.min.z, body.max.z);
+      for (s32 y = y0; y <= y1; y++) {
+        const f32 cy = coverage(y, body.min.y, body.max.y);
+        for (s32 x = x0; x <= x1; x++) {
+          const u32 offset = m_o.fromPos(x, y, z);
+          if (m_o.get(offset)) {
+            continue;
+          }
+          const f32 c = coverage(x, body.min.x, body.max.x) * cy * cz;
+          if (c < 0.5f) {
+            m_v.set(offset, m_v.get(offset) * (1.0f - c) + body.velocity * c);
+            continue;
+          }
+
+          // Obstruct cells that are at least half covered. The faces of an
+          // obstructed cell are closed, and the boundary fill keeps the
+          // velocity of the body in it.
+          m_o.get(offset) = true;
+          m_v.set(offset, body.velocity);
+          cells.push_back(ObstructionField::MovingCell{offset, body.velocity});
         }
-        // for (s32 z = 2; z < 4; z++) {
-        //  m_v.set(x, y, z, Vec3F(0.0f, 0.0f, 0.0f));
-        //  m_v0.set(x, y, z, Vec3F(0.0f, 0.0f, 0.0f));
-        //}
       }
     }
   }
+  std::sort(cells.begin(), cells.end(),
+            [](const ObstructionField::MovingCell &a,
+               const ObstructionField::MovingCell &b) {
+              return a.offset < b.offset;
+            });
+}
 
-  // Diffusion
-  if (m_velocityDiffusionActive) {
-    VectorField::Comp::swap(m_v0.getX(), m_v.getX());
-    diffuse(m_v.getX(), m_v0.getX(), FieldSubKind::kVelX, m_viscosity, delta);
-    VectorField::Comp::swap(m_v0.getY(), m_v.getY());
-    diffuse(m_v.getY(), m_v0.getY(), FieldSubKind::kVelY, m_viscosity, delta);
-    VectorField::Comp::swap(m_v0.getZ(), m_v.getZ());
-    diffuse(m_v.getZ(), m_v0.getZ(), FieldSubKind::kVelZ, m_viscosity, delta);
-    project(m_v.getX(), m_v.getY(), m_v.getZ(), m_v0.getX(), m_v0.getY());
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::releaseBodies() {
+  MICROPROFILE_SCOPEI("Sim", "releaseBodies", MP_ORANGE2);
+
+  // The cells are kept so that air moves into them on the next step
+  for (const ObstructionField::MovingCell &cell : m_o.getMovingCells()) {
+    m_o.get(cell.offset) = false;
   }
+}
 
-  // Advection
-  if (m_velocityAdvectionActive) {
-    VectorField::Comp::swap(m_v0.getX(), m_v.getX());
-    VectorField::Comp::swap(m_v0.getY(), m_v.getY());
-    VectorField::Comp::swap(m_v0.getZ(), m_v.getZ());
-    advect(m_v.getX(), m_v0.getX(), &m_v0, FieldSubKind::kVelX, delta);
-    advect(m_v.getY(), m_v0.getY(), &m_v0, FieldSubKind::kVelY, delta);
-    advect(m_v.getZ(), m_v0.getZ(), &m_v0, FieldSubKind::kVelZ, delta);
-    project(m_v.getX(), m_v.getY(), m_v.getZ(), m_v0.getX(), m_v0.getY());
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::diffuseVelocity(FieldSubKind comp, f32 delta) {
+  Field<f32> *f = velocityComp(m_v, comp);
+  Field<f32> *f0 = velocityComp(m_v0, comp);
+  Field<f32>::swap(f0, f);
+  diffuse(f, f0, comp, m_viscosity, delta);
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::swapVelocity() {
+  VectorField::Comp::swap(m_v0.getX(), m_v.getX());
+  VectorField::Comp::swap(m_v0.getY(), m_v.getY());
+  VectorField::Comp::swap(m_v0.getZ(), m_v.getZ());
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::advectVelocity(FieldSubKind comp, f32 delta) {
+  advect(velocityComp(m_v, comp), velocityComp(m_v0, comp), &m_v0, comp,
+         delta);
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::projectVelocity() {
+  project(m_v.getX(), m_v.getY(), m_v.getZ(), m_v0.getX(), m_v0.getY());
+}
+
+// -------------------------------------------------------------------------- //
+
+Field<f32> *WindSimulation::velocityComp(VectorField &field,
+                                         FieldSubKind comp) {
+  switch (comp) {
+  case FieldSubKind::kVelY:
+    return field.getY();
+  case FieldSubKind::kVelZ:
+    return field.getZ();
+  case FieldSubKind::kVelX:
+    [[fallthrough]];
+  default:
+    return field.getX();
   }
 }
 
@@ -214,7 +549,9 @@ void WindSimulation::paint(Painter &painter, const bs::Vector3 &offset) const {
       static_cast<FieldKind>(DebugManager::getS32(kDebugFieldTypeKey));
   switch (kind) {
   case FieldKind::kDens: {
-    m_d.paint(painter, offset, Vec3F(1, 1, 1));
+    if (hasDensity()) {
+      m_d->paint(painter, offset, Vec3F(1, 1, 1));
+    }
     break;
   }
   case FieldKind::kVel: {
@@ -231,7 +568,7 @@ void WindSimulation::paint(Painter &painter, const bs::Vector3 &offset) const {
 
   // Draw frame
   if (DebugManager::getBool(kDebugPaintFrameKey)) {
-    m_d.paintFrame(painter, offset);
+    m_v.paintFrame(painter, offset);
   }
 }
 
@@ -240,39 +577,65 @@ void WindSimulation::paint(Painter &painter, const bs::Vector3 &offset) const {
 void WindSimulation::setAsTornado() {
   const Vec3F posCenter(m_width / 2.0f, 0.0f, m_depth / 2.0f);
 
-  for (s32 k = 1; k <= m_depth; k++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      for (s32 i = 1; i <= m_width; i++) {
-        const Vec3F pos(f32(i), 0.0f, f32(k));
-        Vec3F vec = (pos - posCenter);
-        const f32 dist = vec.normalize();
-        const f32 tmp = vec.x;
-        vec.x = vec.z;
-        vec.z = -tmp;
-        vec.y = 0.1f;
-
-        Vec3F res = vec * f32(j) / clamp(dist, 1.0f, 10.0f);
-        res.y = clamp(res.y, -5.0f, 5.0f);
-        res.x = clamp(res.x, -5.0f, 5.0f);
-        res.z = clamp(res.z, -5.0f, 5.0f);
-
-        m_v.set(i, j, k, res);
-        m_v0.set(i, j, k, res);
-      }
-    }
-  }
+  stencil::forEachInterior(m_v, [&](s32 i, s32 j, s32 k, u32 offset) {
+    const Vec3F pos(f32(i), 0.0f, f32(k));
+    Vec3F vec = (pos - posCenter);
+    const f32 dist = vec.normalize();
+    const f32 tmp = vec.x;
+    vec.x = vec.z;
+    vec.z = -tmp;
+    vec.y = 0.1f;
+
+    Vec3F res = vec * f32(j) / clamp(dist, 1.0f, 10.0f);
+    res.y = clamp(res.y, -5.0f, 5.0f);
+    res.x = clamp(res.x, -5.0f, 5.0f);
+    res.z = clamp(res.z, -5.0f, 5.0f);
+
+    m_v.set(offset, res);
+    m_v0.set(offset, res);
+  });
 }
 
 // -------------------------------------------------------------------------- //
 
 void WindSimulation::setAsVec(Vec3F v) {
-  for (s32 k = 1; k <= m_depth; k++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      for (s32 i = 1; i <= m_width; i++) {
-        m_v.set(i, j, k, v);
-        m_v0.set(i, j, k, v);
-      }
-    }
+  stencil::forEachInterior(m_v, [&](s32, s32, s32, u32 offset) {
+    m_v.set(offset, v);
+    m_v0.set(offset, v);
+  });
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSimulation::setDomainCondition(DomainBoundary::Face face,
+                                        DomainCondition condition,
+                                        const Vec3F &inflow) {
+  // Faces come in pairs of min and max along each axis
+  const auto opposite = DomainBoundary::Face(face ^ 1u);
+  if (condition == DomainCondition::kPeriodic) {
+    m_boundary.conditions[opposite] = DomainCondition::kPeriodic;
+  } else if (m_boundary.conditions[opposite] == DomainCondition::kPeriodic) {
+    m_boundary.conditions[opposite] = DomainCondition::kWall;
+  }
+  m_boundary.conditions[face] = condition;
+  m_boundary.inflow[face] = inflow;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool WindSimulation::isPeriodic(FieldSubKind comp) const {
+  switch (comp) {
+  case FieldSubKind::kVelX:
+    return m_boundary.conditions[DomainBoundary::kMinX] ==
+           DomainCondition::kPeriodic;
+  case FieldSubKind::kVelY:
+    return m_boundary.conditions[DomainBoundary::kMinY] ==
+           DomainCondition::kPeriodic;
+  case FieldSubKind::kVelZ:
+    return m_boundary.conditions[DomainBoundary::kMinZ] ==
+           DomainCondition::kPeriodic;
+  default:
+    return false;
   }
 }
 
@@ -280,21 +643,65 @@ void WindSimulation::setAsVec(Vec3F v) {
 
 void WindSimulation::gaussSeidel(Field<f32> *f, Field<f32> *f0,
                                  FieldSubKind edge, f32 a, f32 c) {
-  // Gauss-Seidel relaxation
-  for (u32 l = 0; l < GAUSS_SEIDEL_STEPS; l++) {
-    // Diffuse with neighbors
-    for (s32 k = 1; k <= m_depth; k++) {
-      for (s32 j = 1; j <= m_height; j++) {
-        for (s32 i = 1; i <= m_width; i++) {
-          const f32 comb = f->get(i - 1, j, k) + f->get(i + 1, j, k) +
-                           f->get(i, j - 1, k) + f->get(i, j + 1, k) +
-                           f->get(i, j, k - 1) + f->get(i, j, k + 1);
-          f->get(i, j, k) = (f0->get(i, j, k) + a * comb) / c;
+  MICROPROFILE_SCOPEI("Sim", "gaussSeidel", MP_ORANGE2);
+  relaxBlocked(f, edge,
+               [&](s32 k) { stencil::relaxPlane(*f, *f0, k, a, c); });
+}
+
+// -------------------------------------------------------------------------- //
+
+template <typename Relax>
+void WindSimulation::relaxBlocked(Field<f32> *f, FieldSubKind edge,
+                                  Relax &&relax) {
+  // Number of relaxation iterations that are run back-to-back on a slab of
+  // planes. Each iteration 'l' trails the iteration before it by two planes,
+  // which is exactly the distance required for the plane to see the same
+  // neighbor values as it would with one full sweep per iteration. The depth
+  // is chosen so that the planes in flight stay resident in the cache.
+  //
+  // The planes are not tiled in x and y. An in-place sweep over a tile would
+  // overwrite values that the neighboring tile still needs, unless the tiles
+  // are skewed per iteration, and the boundary fill works on whole planes.
+  // For planes of more than about 90x90 cells the depth is therefore one,
+  // which runs plain full sweeps.
+  const u32 planeBytes = u32((m_width + 2) * (m_height + 2) * sizeof(f32));
+  const u32 planesInCache = GAUSS_SEIDEL_CACHE_BUDGET / planeBytes;
+  // Periodic z-faces read the far end of the domain, which is only up to
+  // date once an iteration has finished, so iterations are not blocked.
+  const bool periodicZ = m_boundary.conditions[DomainBoundary::kMinZ] ==
+                         DomainCondition::kPeriodic;
+  const u32 blockDepth =
+      periodicZ ? 1u
+                : clamp(planesInCache > 2 ? (planesInCache - 2) / 3 : 1u, 1u,
+                        GAUSS_SEIDEL_STEPS);
+
+  for (u32 l0 = 0; l0 < GAUSS_SEIDEL_STEPS; l0 += blockDepth) {
+    const s32 iterations = s32(minValue(blockDepth, GAUSS_SEIDEL_STEPS - l0));
+    const s32 tEnd = m_depth + 2 * (iterations - 1);
+    for (s32 t = 1; t <= tEnd; t++) {
+      // Older iterations are further ahead, process them first so that the
+      // plane behind them is finished before the next iteration reads it.
+      for (s32 l = 0; l < iterations; l++) {
+        const s32 k = t - 2 * l;
+        if (k < 1 || k > m_depth) {
+          continue;
+        }
+        relax(k);
+        if (k > 1) {
+          setBoundaryPlane(f, edge, k - 1);
+        }
+        if (k == m_depth) {
+          setBoundaryPlane(f, edge, k);
         }
       }
     }
-    setBoundary(f, edge);
+    // The ghost plane in front of the first plane was filled before the last
+    // plane was relaxed. Refill it from the relaxed plane when it wraps.
+    if (periodicZ) {
+      setBoundaryPlane(f, edge, 1);
+    }
   }
+  stencil::fillBoundaryEdges(*f);
 }
 
 // -------------------------------------------------------------------------- //
@@ -318,40 +725,50 @@ void WindSimulation::advect(Field<f32> *f, Field<f32> *f0,
   const f32 deltaY = delta * maxDim;
   const f32 deltaZ = delta * maxDim;
 
-  for (s32 k = 1; k <= m_depth; k++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      for (s32 i = 1; i <= m_width; i++) {
-        const Vec3F vec = vecField->get(i, j, k);
-
-        const f32 x = clamp(i - deltaX * vec.x, 0.5f, m_width + 0.5f);
-        const s32 i0 = s32(x);
-        const s32 i1 = i0 + 1;
-        const f32 s1 = x - i0;
-        const f32 s0 = 1 - s1;
-
-        const f32 y = clamp(j - deltaY * vec.y, 0.5f, m_height + 0.5f);
-        const s32 j0 = s32(y);
-        const s32 j1 = j0 + 1;
-        const f32 t1 = y - j0;
-        const f32 t0 = 1 - t1;
-
-        const f32 z = clamp(k - deltaZ * vec.z, 0.5f, m_depth + 0.5f);
-        const s32 k0 = s32(z);
-        const s32 k1 = k0 + 1;
-        const f32 u1 = z - k0;
-        const f32 u0 = 1 - u1;
-
-        // Interpolate between cells
-        const f32 tu0 =
-            t0 * u0 * f0->get(i0, j0, k0) + t1 * u0 * f0->get(i0, j1, k0) +
-            t0 * u1 * f0->get(i0, j0, k1) + t1 * u1 * f0->get(i0, j1, k1);
-        const f32 tu1 =
-            t0 * u0 * f0->get(i1, j0, k0) + t1 * u0 * f0->get(i1, j1, k0) +
-            t0 * u1 * f0->get(i1, j0, k1) + t1 * u1 * f0->get(i1, j1, k1);
-        f->get(i, j, k) = s0 * tu0 + s1 * tu1;
-      }
+  // Back-traced positions are clamped to the domain, or wrapped around along
+  // periodic axes. The ghost cells of a periodic axis hold the cells at the
+  // opposite face, so any position in [0.5, n + 0.5) can be interpolated.
+  const bool periodic[3] = {isPeriodic(FieldSubKind::kVelX),
+                            isPeriodic(FieldSubKind::kVelY),
+                            isPeriodic(FieldSubKind::kVelZ)};
+  const auto trace = [&periodic](u32 axis, f32 pos, s32 n) {
+    if (!periodic[axis]) {
+      return clamp(pos, 0.5f, n + 0.5f);
     }
-  }
+    const f32 wrapped = std::fmod(pos - 0.5f, f32(n));
+    return (wrapped < 0.0f ? wrapped + n : wrapped) + 0.5f;
+  };
+
+  stencil::forEachInterior(*f, [&](s32 i, s32 j, s32 k, u32 offset) {
+    const Vec3F vec = vecField->get(offset);
+
+    const f32 x = trace(0, i - deltaX * vec.x, m_width);
+    const s32 i0 = s32(x);
+    const s32 i1 = i0 + 1;
+    const f32 s1 = x - i0;
+    const f32 s0 = 1 - s1;
+
+    const f32 y = trace(1, j - deltaY * vec.y, m_height);
+    const s32 j0 = s32(y);
+    const s32 j1 = j0 + 1;
+    const f32 t1 = y - j0;
+    const f32 t0 = 1 - t1;
+
+    const f32 z = trace(2, k - deltaZ * vec.z, m_depth);
+    const s32 k0 = s32(z);
+    const s32 k1 = k0 + 1;
+    const f32 u1 = z - k0;
+    const f32 u0 = 1 - u1;
+
+    // Interpolate between cells
+    const f32 tu0 =
+        t0 * u0 * f0->get(i0, j0, k0) + t1 * u0 * f0->get(i0, j1, k0) +
+        t0 * u1 * f0->get(i0, j0, k1) + t1 * u1 * f0->get(i0, j1, k1);
+    const f32 tu1 =
+        t0 * u0 * f0->get(i1, j0, k0) + t1 * u0 * f0->get(i1, j1, k0) +
+        t0 * u1 * f0->get(i1, j0, k1) + t1 * u1 * f0->get(i1, j1, k1);
+    f->get(offset) = s0 * tu0 + s1 * tu1;
+  });
 
   setBoundary(f, edge);
 }
@@ -360,35 +777,73 @@ void WindSimulation::advect(Field<f32> *f, Field<f32> *f0,
 
 void WindSimulation::project(Field<f32> *u, Field<f32> *v, Field<f32> *w,
                              Field<f32> *prj, Field<f32> *div) {
+  const Stride stride(*u);
 
-  for (s32 k = 1; k <= m_depth; k++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      for (s32 i = 1; i <= m_width; i++) {
-        const f32 comb = (u->get(i + 1, j, k) - u->get(i - 1, j, k)) / m_width +
-                         (v->get(i, j + 1, k) - v->get(i, j - 1, k)) / m_width +
-                         (w->get(i, j, k + 1) - w->get(i, j, k - 1)) / m_width;
-        div->get(i, j, k) = -1.0f / 3.0f * comb;
-        prj->get(i, j, k) = 0;
-      }
+  // Cells next to partially open faces weight the flux through each face by
+  // its open fraction. All other cells use the plain stencils, which the
+  // weighted ones reduce to when the faces are fully open.
+  const bool partial = m_o.hasPartialCoverage();
+  const auto forEachPartial = [&](auto &&fn) {
+    for (s32 k = 1; k <= m_depth; k++) {
+      stencil::forEachPartialPlane(m_o, k, fn);
     }
+  };
+
+  stencil::forEachInterior(*u, [&](s32, s32, s32, u32 offset) {
+    const f32 comb = stencil::diffX(*u, offset) / m_width +
+                     stencil::diffY(*v, stride, offset) / m_width +
+                     stencil::diffZ(*w, stride, offset) / m_width;
+    div->get(offset) = -1.0f / 3.0f * comb;
+    prj->get(offset) = 0;
+  });
+  if (partial) {
+    forEachPartial([&](u32 offset) {
+      const f32 comb =
+          stencil::openDiff(*u, m_o, 0, 1, offset) / m_width +
+          stencil::openDiff(*v, m_o, 1, stride.y, offset) / m_width +
+          stencil::openDiff(*w, m_o, 2, stride.z, offset) / m_width;
+      div->get(offset) = -1.0f / 3.0f * comb;
+    });
   }
 
   setBoundary(div, FieldSubKind::kDens);
-  setBoundary(prj, FieldSubKind::kDens);
-
-  gaussSeidel(prj, div, FieldSubKind::kDens, 1.0f, 6.0f);
-
-  for (s32 k = 1; k <= m_depth; k++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      for (s32 i = 1; i <= m_width; i++) {
-        u->get(i, j, k) -=
-            0.5f * m_width * (prj->get(i + 1, j, k) - prj->get(i - 1, j, k));
-        v->get(i, j, k) -=
-            0.5f * m_width * (prj->get(i, j + 1, k) - prj->get(i, j - 1, k));
-        w->get(i, j, k) -=
-            0.5f * m_width * (prj->get(i, j, k + 1) - prj->get(i, j, k - 1));
-      }
-    }
+  setBoundary(prj, FieldSubKind::kPressure);
+
+  if (partial) {
+    // Partial cells are relaxed right after the rest of their plane, which
+    // keeps the relaxation temporally blocked like 'gaussSeidel'
+    MICROPROFILE_SCOPEI("Sim", "gaussSeidel", MP_ORANGE2);
+    relaxBlocked(prj, FieldSubKind::kPressure, [&](s32 k) {
+      stencil::relaxPlane(*prj, *div, k, 1.0f, 6.0f);
+      stencil::forEachPartialPlane(m_o, k, [&](u32 offset) {
+        stencil::relaxCellOpen(*prj, *div, m_o, stride, offset);
+      });
+    });
+  } else {
+    gaussSeidel(prj, div, FieldSubKind::kPressure, 1.0f, 6.0f);
+  }
+
+  stencil::forEachInterior(*u, [&](s32, s32, s32, u32 offset) {
+    u->get(offset) -= 0.5f * m_width * stencil::diffX(*prj, offset);
+    v->get(offset) -= 0.5f * m_width * stencil::diffY(*prj, stride, offset);
+    w->get(offset) -= 0.5f * m_width * stencil::diffZ(*prj, stride, offset);
+  });
+  if (partial) {
+    // Replace the plain gradient of the partial cells by the weighted one
+    forEachPartial([&](u32 offset) {
+      u->get(offset) -=
+          0.5f * m_width *
+          (stencil::openGrad(*prj, m_o, 0, 1, offset) -
+           stencil::diffX(*prj, offset));
+      v->get(offset) -=
+          0.5f * m_width *
+          (stencil::openGrad(*prj, m_o, 1, stride.y, offset) -
+           stencil::diffY(*prj, stride, offset));
+      w->get(offset) -=
+          0.5f * m_width *
+          (stencil::openGrad(*prj, m_o, 2, stride.z, offset) -
+           stencil::diffZ(*prj, stride, offset));
+    });
   }
 
   setBoundary(u, FieldSubKind::kVelX);
@@ -399,130 +854,51 @@ void WindSimulation::project(Field<f32> *u, Field<f32> *v, Field<f32> *w,
 // -------------------------------------------------------------------------- //
 
 void WindSimulation::setBoundary(Field<f32> *f, FieldSubKind edge) {
-  const bool isX = edge == FieldSubKind::kVelX;
-  const bool isY = edge == FieldSubKind::kVelY;
-  const bool isZ = edge == FieldSubKind::kVelZ;
-
-  for (s32 i = 1; i <= m_width; i++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      for (s32 k = 1; k <= m_depth; k++) {
-        const f32 curr = f->get(i, j, k);
-
-        if (isX) {
-          const f32 vMin = m_o.get(i - 1, j, k) ? 0.0f : curr;
-          const f32 vMax = m_o.get(i + 1, j, k) ? 0.0f : curr;
-          f->get(i, j, k) = wind::clamp(curr, vMin, vMax);
-        }
-        if (isY) {
-          const f32 vMin = m_o.get(i, j - 1, k) ? 0.0f : curr;
-          const f32 vMax = m_o.get(i, j + 1, k) ? 0.0f : curr;
-          f->get(i, j, k) = wind::clamp(curr, vMin, vMax);
-        }
-        if (isZ) {
-          const f32 vMin = m_o.get(i, j, k - 1) ? 0.0f : curr;
-          const f32 vMax = m_o.get(i, j, k + 1) ? 0.0f : curr;
-          f->get(i, j, k) = wind::clamp(curr, vMin, vMax);
-        }
-      }
-    }
-  }
-
-  // X-Y faces
-  for (s32 i = 1; i <= m_width; i++) {
-    for (s32 j = 1; j <= m_height; j++) {
-      f->get(i, j, 0) = isZ ? -f->get(i, j, 1) : f->get(i, j, 1);
-      f->get(i, j, m_depth + 1) =
-          isZ ? -f->get(i, j, m_depth) : f->get(i, j, m_depth);
-    }
+  switch (edge) {
+  case FieldSubKind::kVelX:
+    stencil::fillBoundary<FieldSubKind::kVelX>(*f, m_o, m_boundary);
+    break;
+  case FieldSubKind::kVelY:
+    stencil::fillBoundary<FieldSubKind::kVelY>(*f, m_o, m_boundary);
+    break;
+  case FieldSubKind::kVelZ:
+    stencil::fillBoundary<FieldSubKind::kVelZ>(*f, m_o, m_boundary);
+    break;
+  case FieldSubKind::kPressure:
+    stencil::fillBoundary<FieldSubKind::kPressure>(*f, m_o, m_boundary);
+    break;
+  case FieldSubKind::kDens:
+    [[fallthrough]];
+  default:
+    stencil::fillBoundary<FieldSubKind::kDens>(*f, m_o, m_boundary);
+    break;
   }
+}
 
-  // Y-Z faces
-  for (s32 i = 1; i <= m_height; i++) {
-    for (s32 j = 1; j <= m_depth; j++) {
-      f->get(0, i, j) = isX ? -f->get(1, i, j) : f->get(1, i, j);
-      f->get(m_width + 1, i, j) =
-          isX ? -f->get(m_width, i, j) : f->get(m_width, i, j);
-    }
-  }
+// -------------------------------------------------------------------------- //
 
-  // X-Z faces
-  for (s32 i = 1; i <= m_width; i++) {
-    for (s32 j = 1; j <= m_depth; j++) {
-      f->get(i, 0, j) = isY ? -f->get(i, 1, j) : f->get(i, 1, j);
-      f->get(i, m_height + 1, j) =
-          isY ? -f->get(i, m_height, j) : f->get(i, m_height, j);
-    }
+void WindSimulation::setBoundaryPlane(Field<f32> *f, FieldSubKind edge,
+                                      s32 k) {
+  switch (edge) {
+  case FieldSubKind::kVelX:
+    stencil::fillBoundaryPlane<FieldSubKind::kVelX>(*f, m_o, m_boundary, k);
+    break;
+  case FieldSubKind::kVelY:
+    stencil::fillBoundaryPlane<FieldSubKind::kVelY>(*f, m_o, m_boundary, k);
+    break;
+  case FieldSubKind::kVelZ:
+    stencil::fillBoundaryPlane<FieldSubKind::kVelZ>(*f, m_o, m_boundary, k);
+    break;
+  case FieldSubKind::kPressure:
+    stencil::fillBoundaryPlane<FieldSubKind::kPressure>(*f, m_o, m_boundary,
+                                                        k);
+    break;
+  case FieldSubKind::kDens:
+    [[fallthrough]];
+  default:
+    stencil::fillBoundaryPlane<FieldSubKind::kDens>(*f, m_o, m_boundary, k);
+    break;
   }
-
-  // X edges
-  for (s32 i = 1; i <= m_width; i++) {
-    f->get(i, 0, 0) = 1.0f / 2.0f * (f->get(i, 1, 0) + f->get(i, 0, 1));
-    f->get(i, m_height + 1, 0) =
-        1.0f / 2.0f * (f->get(i, m_height, 0) + f->get(i, m_height + 1, 1));
-    f->get(i, 0, m_depth + 1) =
-        1.0f / 2.0f * (f->get(i, 0, m_depth) + f->get(i, 1, m_depth + 1));
-    f->get(i, m_height + 1, m_depth + 1) =
-        1.0f / 2.0f *
-        (f->get(i, m_height, m_depth + 1) + f->get(i, m_height + 1, m_depth));
-  }
-
-  // Y edges
-  for (s32 i = 1; i <= m_height; i++) {
-    f->get(0, i, 0) = 1.0f / 2.0f * (f->get(1, i, 0) + f->get(0, i, 1));
-    f->get(m_width + 1, i, 0) =
-        1.0f / 2.0f * (f->get(m_width, i, 0) + f->get(m_width + 1, i, 1));
-    f->get(0, i, m_depth + 1) =
-        1.0f / 2.0f * (f->get(0, i, m_depth) + f->get(1, i, m_depth + 1));
-    f->get(m_width + 1, i, m_depth + 1) =
-        1.0f / 2.0f *
-        (f->get(m_width, i, m_depth + 1) + f->get(m_width + 1, i, m_depth));
-  }
-
-  // Z edges
-  for (s32 i = 1; i <= m_depth; i++) {
-    f->get(0, 0, i) = 1.0f / 2.0f * (f->get(0, 1, i) + f->get(1, 0, i));
-    f->get(0, m_height + 1, i) =
-        1.0f / 2.0f * (f->get(0, m_height, i) + f->get(1, m_height + 1, i));
-    f->get(m_width + 1, 0, i) =
-        1.0f / 2.0f * (f->get(m_width, 0, i) + f->get(m_width + 1, 1, i));
-    f->get(m_width + 1, m_height + 1, i) =
-        1.0f / 2.0f *
-        (f->get(m_width + 1, m_height, i) + f->get(m_width, m_height + 1, i));
-  }
-
-  // Corners
-  f->get(0, 0, 0) =
-      1.0f / 3.0f * (f->get(1, 0, 0) + f->get(0, 1, 0) + f->get(0, 0, 1));
-  f->get(0, m_height + 1, 0) =
-      1.0f / 3.0f *
-      (f->get(1, m_height + 1, 0) + f->get(0, m_height, 0) +
-       f->get(0, m_height + 1, 1));
-
-  f->get(m_width + 1, 0, 0) =
-      1.0f / 3.0f *
-      (f->get(m_width, 0, 0) + f->get(m_width + 1, 1, 0) +
-       f->get(m_width + 1, 0, 1));
-  f->get(m_width + 1, m_height + 1, 0) =
-      1.0f / 3.0f *
-      (f->get(m_width, m_height + 1, 0) + f->get(m_width + 1, m_height, 0) +
-       f->get(m_width + 1, m_height + 1, 1));
-  f->get(0, 0, m_depth + 1) =
-      1.0f / 3.0f *
-      (f->get(1, 0, m_depth + 1) + f->get(0, 1, m_depth + 1) +
-       f->get(0, 0, m_depth));
-  f->get(0, m_height + 1, m_depth + 1) =
-      1.0f / 3.0f *
-      (f->get(1, m_height + 1, m_depth + 1) + f->get(0, m_height, m_depth + 1) +
-       f->get(0, m_height + 1, m_depth));
-  f->get(m_width + 1, 0, m_depth + 1) =
-      1.0f / 3.0f *
-      (f->get(m_width, 0, m_depth + 1) + f->get(m_width + 1, 1, m_depth + 1) +
-       f->get(m_width + 1, 0, m_depth));
-  f->get(m_width + 1, m_height + 1, m_depth + 1) =
-      1.0f / 3.0f *
-      (f->get(m_width, m_height + 1, m_depth + 1) +
-       f->get(m_width + 1, m_height, m_depth + 1) +
-       f->get(m_width + 1, m_height + 1, m_depth));
 }
 
 } // namespace wind
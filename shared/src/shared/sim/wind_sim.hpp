@@ -29,8 +29,12 @@
 #include "shared/macros.hpp"
 #include "shared/sim/density_field.hpp"
 #include "shared/sim/obstruction_field.hpp"
+#include "shared/sim/stencil.hpp"
 #include "shared/sim/vector_field.hpp"
 
+#include <utility>
+#include <vector>
+
 // ========================================================================== //
 // Editor Declaration
 // ========================================================================== //
@@ -38,6 +42,7 @@
 namespace wind {
 
 WIND_FORWARD_DECLARE(Painter);
+WIND_FORWARD_DECLARE(TaskGraph);
 
 // -------------------------------------------------------------------------- //
 
@@ -47,7 +52,9 @@ WIND_FORWARD_DECLARE(Painter);
 /// to in the current timestep will be read from in a coming timestep.
 ///
 /// The first buffer is the density buffer. This buffer contains the densities
-/// of "fluid" (air) at the different positions.
+/// of "fluid" (air) at the different positions. The density buffer is optional
+/// and is only allocated and simulated while it has registered consumers (see
+/// 'addDensityConsumer').
 ///
 /// The second buffer is the velocity field. This contains the wind direction
 /// and strength at the different positions.
@@ -77,6 +84,8 @@ WIND_FORWARD_DECLARE(Painter);
 /// presented in chapter 5.6 "Implementing the simplified 3d model".
 ///
 class WindSimulation {
+  friend class Checkpoint;
+
 public:
   /// Key for debug variable used to determine whether to run simulation.
   static constexpr char kDebugRun[] = "SimDebugRun";
@@ -92,11 +101,42 @@ public:
 
   static constexpr char kDebugVelocitySource[] = "SimDebugVS";
 
+  /// Default largest change in velocity (m/s) of any cell between two steps
+  /// for the simulation to be considered to be in a steady state.
+  static constexpr f32 kSteadyStateTolerance = 0.001f;
+  /// Default maximum number of steps to take while solving for steady state.
+  static constexpr u32 kSteadyStateMaxSteps = 1000u;
+  /// Number of steps between each convergence report while solving for a
+  /// steady state.
+  static constexpr u32 kSteadyStateReportInterval = 50u;
+
   /// Enumeration of the different fields that make up the simulation.
   enum class FieldKind { kDens, kVel, kObstr };
 
+  /// Result of solving for the steady state of the simulation.
+  struct SteadyState {
+    /// Whether the change in velocity fell below the tolerance
+    bool converged = false;
+    /// Number of steps that was taken
+    u32 steps = 0;
+    /// Largest change in velocity (m/s) of any cell during the last step
+    f32 change = 0.0f;
+  };
+
+  /// Bounds and velocity of a rigid body that is splatted into the velocity
+  /// field. Bounds are in meters from the minimum corner of the interior of
+  /// the domain.
+  struct Body {
+    /// Minimum corner of the bounds
+    Vec3F min;
+    /// Maximum corner of the bounds
+    Vec3F max;
+    /// Velocity of the body (m/s)
+    Vec3F velocity;
+  };
+
   /// Enumeration that specifies edges of the simulation
-  enum class FieldSubKind { kDens, kVelX, kVelY, kVelZ };
+  using FieldSubKind = wind::FieldSubKind;
 
 public:
   /// Construct wind simulation of given dimensions
@@ -107,7 +147,7 @@ public:
       : WindSimulation(dim.x, dim.y, dim.z, cellSize) {}
 
   /// Destruct wind simulation along with data
-  ~WindSimulation() = default;
+  ~WindSimulation();
 
   /// Build the obstruction field of the simulation for the specified scene. The
   /// position is used to specify at what position the simulation should check
@@ -117,34 +157,84 @@ public:
 
   /// Step the simulation with the specified delta time (dt). Stepping the
   /// delta-time with the real frame-time means that the simulation should run
-  /// in real-time
+  /// in real-time.
+  ///
+  /// The step is run as a graph of tasks on the shared task pool. Density
+  /// source and diffusion run alongside the velocity, and the three velocity
+  /// components are diffused and advected concurrently. Density is advected by
+  /// the velocity of the step.
   void step(f32 delta);
 
   /// Run the simulation for 'steps' number of steps. For each step the
   /// simulation is run with the specified delta time.
   void stepN(f32 delta, u32 steps);
 
-  /// Step density simulation
+  /// Step the simulation with the specified delta time on the calling thread.
+  /// The tasks of the step are run in the same order as they are added to the
+  /// graph of 'step', which gives the same result.
+  void stepSerial(f32 delta);
+
+  /// Step the simulation with the specified delta time until it reaches a
+  /// steady state, or until 'maxSteps' steps have been taken. The simulation
+  /// is in a steady state when no component of the velocity in any cell
+  /// changes by more than 'tolerance' during a single step.
+  ///
+  /// The largest change is logged every 'kSteadyStateReportInterval' steps.
+  SteadyState solveSteadyState(f32 delta,
+                               f32 tolerance = kSteadyStateTolerance,
+                               u32 maxSteps = kSteadyStateMaxSteps);
+
+  /// Step density simulation on the calling thread. Density is advected by
+  /// the current velocity, so to match 'step' the velocity must be stepped
+  /// first.
   void stepDensity(f32 delta);
 
-  /// Step velocity simulation
+  /// Step velocity simulation on the calling thread
   void stepVelocity(f32 delta);
 
   /// Paint simulation
   void paint(Painter &painter,
              const bs::Vector3 &offset = bs::Vector3(0, 0, 0)) const;
 
+  /// Register a consumer of the density field. The density field is allocated
+  /// when the first consumer is registered. It is only simulated while there
+  /// are consumers.
+  void addDensityConsumer();
+
+  /// Unregister a consumer of the density field. The density field is freed
+  /// when the last consumer is unregistered.
+  void removeDensityConsumer();
+
+  /// Returns whether the density field is allocated and simulated
+  bool hasDensity() const { return m_d != nullptr; }
+
   /// Returns the density field for the current step in the simulation
-  DensityField &D() { return m_d; }
+  /// \pre Density field must have a consumer
+  DensityField &D() {
+    assert(hasDensity() && "Density field requires a consumer");
+    return *m_d;
+  }
 
   /// Returns the density field for the current step in the simulation
-  const DensityField &D() const { return m_d; }
+  /// \pre Density field must have a consumer
+  const DensityField &D() const {
+    assert(hasDensity() && "Density field requires a consumer");
+    return *m_d;
+  }
 
   /// Returns the density field for the previous step in the simulation
-  DensityField &D0() { return m_d0; }
+  /// \pre Density field must have a consumer
+  DensityField &D0() {
+    assert(hasDensity() && "Density field requires a consumer");
+    return *m_d0;
+  }
 
   /// Returns the density field for the previous step in the simulation
-  const DensityField &D0() const { return m_d0; }
+  /// \pre Density field must have a consumer
+  const DensityField &D0() const {
+    assert(hasDensity() && "Density field requires a consumer");
+    return *m_d0;
+  }
 
   /// Returns the velocity field for the current step in the simulation
   VectorField &V() { return m_v; }
@@ -152,10 +242,13 @@ public:
   /// Returns the velocity field for the current step in the simulation
   const VectorField &V() const { return m_v; }
 
-  /// Returns the velocity field for the previous step in the simulation
+  /// Returns the velocity sources, which are added once at the start of the
+  /// next step. The field is used as scratch during a step and is cleared
+  /// after it.
   VectorField &V0() { return m_v0; }
 
-  /// Returns the velocity field for the previous step in the simulation
+  /// Returns the velocity sources, which are added once at the start of the
+  /// next step
   const VectorField &V0() const { return m_v0; }
 
   /// Returns the obstruction field
@@ -203,6 +296,27 @@ public:
   /// Set all vector fields to v.
   void setAsVec(Vec3F v);
 
+  /// Set the condition at a face of the domain. The inflow velocity is only
+  /// used for inflow conditions. Periodic conditions always apply to both of
+  /// the opposite faces, so they are set or cleared together.
+  void setDomainCondition(DomainBoundary::Face face, DomainCondition condition,
+                          const Vec3F &inflow = Vec3F::ZERO);
+
+  /// Returns the conditions at the faces of the domain
+  const DomainBoundary &getDomainBoundary() const { return m_boundary; }
+
+  /// Set the rigid bodies that are splatted into the velocity field at the
+  /// start of each step. Cells that are at least half covered by a body are
+  /// obstructed for the rest of the step and move with the body. Other cells
+  /// that a body overlaps are pushed towards the velocity of the body by the
+  /// fraction of the cell that is covered. The obstructions of the bodies are
+  /// removed at the end of each step, and cells that a body leaves take on its
+  /// velocity.
+  void setBodies(std::vector<Body> bodies) { m_bodies = std::move(bodies); }
+
+  /// Returns the rigid bodies that are splatted into the velocity field
+  const std::vector<Body> &getBodies() const { return m_bodies; }
+
   /// Retrieve the dimension of the simulation in cells
   FieldBase::Dim getDim() const {
     return FieldBase::Dim{u32(m_width), u32(m_height), u32(m_depth)};
@@ -215,10 +329,75 @@ public:
   f32 getCellSize() const { return m_v.getCellSize(); }
 
 private:
-  /// Gauss-Seidel relaxation
+  /// Step density and velocity concurrently as a task graph
+  void stepConcurrent(f32 delta);
+
+  /// Add the tasks of a step to a graph. Tasks are added in a valid serial
+  /// order, with the density advected after the velocity of the step.
+  void buildStep(TaskGraph &graph, f32 delta);
+
+  /// Add density sources and sinks
+  void sourceDensity(f32 delta);
+
+  /// Diffuse the density field
+  void diffuseDensity(f32 delta);
+
+  /// Advect the density field along the current velocity field
+  void advectDensity(f32 delta);
+
+  /// Add velocity sources for one of the velocity components
+  void sourceVelocity(FieldSubKind comp, f32 delta);
+
+  /// Clear the velocity sources at the end of a step, as the source field
+  /// holds the scratch data of the step
+  void clearVelocitySource();
+
+  /// Add the debug velocity source
+  void addDebugVelocitySource();
+
+  /// Splat the rigid bodies into the velocity and obstruction fields. Only the
+  /// cells that the bodies overlap, and those that they obstructed during the
+  /// previous step, are touched.
+  void splatBodies();
+
+  /// Remove the obstructions that were added by 'splatBodies'
+  void releaseBodies();
+
+  /// Diffuse one of the velocity components
+  void diffuseVelocity(FieldSubKind comp, f32 delta);
+
+  /// Swap current and previous velocity fields, ahead of advection
+  void swapVelocity();
+
+  /// Advect one of the velocity components along the previous velocity field
+  void advectVelocity(FieldSubKind comp, f32 delta);
+
+  /// Project the velocity field, using the previous field as scratch space
+  void projectVelocity();
+
+  /// Returns whether the axis of a velocity component is periodic
+  bool isPeriodic(FieldSubKind comp) const;
+
+  /// Returns the component of a vector field that the sub-kind represents
+  static Field<f32> *velocityComp(VectorField &field, FieldSubKind comp);
+
+  /// Gauss-Seidel relaxation. The iterations are temporally blocked, running
+  /// several of them as a wavefront over a slab of planes that fits in cache.
+  /// The result is identical to running each iteration as a full sweep. With
+  /// periodic z-faces each iteration is run as a full sweep on its own.
+  ///
+  /// Only the z-axis is blocked. Once a plane is larger than a third of
+  /// 'GAUSS_SEIDEL_CACHE_BUDGET' (about 90x90 cells), only one iteration fits,
+  /// and each iteration is a full sweep again.
   void gaussSeidel(Field<f32> *f, Field<f32> *f0, FieldSubKind edge, f32 a,
                    f32 c);
 
+  /// Run 'GAUSS_SEIDEL_STEPS' iterations of 'relax(k)', which relaxes plane
+  /// 'k' of 'f' in place, as a temporally blocked wavefront. The boundary of
+  /// each plane is filled once the plane after it has been relaxed.
+  template <typename Relax>
+  void relaxBlocked(Field<f32> *f, FieldSubKind edge, Relax &&relax);
+
   /// Run diffusion
   void diffuse(Field<f32> *f, Field<f32> *f0, FieldSubKind edge, f32 coeff,
                f32 delta);
@@ -227,16 +406,24 @@ private:
   void advect(Field<f32> *f, Field<f32> *f0, VectorField *vecField,
               FieldSubKind edge, f32 delta);
 
-  /// Project velocity
+  /// Project velocity. In cells next to partially open faces of the
+  /// obstruction field the divergence, pressure and gradient are weighted by
+  /// the open fraction of the faces.
   void project(Field<f32> *u, Field<f32> *v, Field<f32> *w, Field<f32> *prj,
                Field<f32> *div);
 
   /// Set boundary condition
   void setBoundary(Field<f32> *field, FieldSubKind edge);
 
+  /// Set boundary condition for the interior and faces of plane 'k'
+  void setBoundaryPlane(Field<f32> *field, FieldSubKind edge, s32 k);
+
 private:
   /// Number of iterations in the Gauss-Seidel method
   static constexpr u32 GAUSS_SEIDEL_STEPS = 10u;
+  /// Number of bytes that the planes of a blocked Gauss-Seidel relaxation
+  /// should fit in. Roughly sized after the L2 cache.
+  static constexpr u32 GAUSS_SEIDEL_CACHE_BUDGET = 256u * 1024u;
 
 private:
   /// Dimensions
@@ -254,16 +441,23 @@ private:
   /// Viscosity
   f32 m_viscosity = 0.0f;
 
-  /// Density fields (current)
-  DensityField m_d;
-  /// Density fields (previous )
-  DensityField m_d0;
+  /// Density fields (current). Only allocated while there are consumers.
+  DensityField *m_d = nullptr;
+  /// Density fields (previous). Only allocated while there are consumers.
+  DensityField *m_d0 = nullptr;
+  /// Number of registered consumers of the density field
+  u32 m_densityConsumers = 0;
   /// Velocity field (current)
   VectorField m_v;
   /// Velocity field (previous)
   VectorField m_v0;
   /* Obstruction field */
   ObstructionField m_o;
+  /// Conditions at the faces of the domain
+  DomainBoundary m_boundary;
+  /// Rigid bodies that are splatted into the velocity field. The cells that
+  /// they obstructed during the last step are the moving cells of 'm_o'.
+  std::vector<Body> m_bodies;
 
   /// Whether to add density sources
   bool m_addDensitySource = false;
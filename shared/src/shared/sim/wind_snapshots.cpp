@@ -0,0 +1,119 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "shared/sim/wind_snapshots.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/math/math.hpp"
+#include "shared/sim/vector_field.hpp"
+
+#include "microprofile/microprofile.h"
+
+#include <cstring>
+#include <limits>
+
+// ========================================================================== //
+// WindSnapshots Implementation
+// ========================================================================== //
+
+namespace wind {
+
+WindSnapshots::WindSnapshots(const FieldBase::Dim &dim, f32 cellSize)
+    : m_size(Vec3F(f32(dim.width - 2), f32(dim.height - 2),
+                   f32(dim.depth - 2)) *
+             cellSize),
+      m_cellSize(cellSize) {
+  for (u32 i = 0; i < kSlotCount; i++) {
+    m_slots[i] = new VectorField(dim.width, dim.height, dim.depth, cellSize);
+    m_origins[i] = Vec3F::ZERO;
+    m_times[i] = std::numeric_limits<f32>::max();
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+WindSnapshots::~WindSnapshots() {
+  for (VectorField *slot : m_slots) {
+    delete slot;
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void WindSnapshots::publish(const VectorField &field, const Vec3F &origin,
+                            f32 time) {
+  MICROPROFILE_SCOPEI("WindSnapshots", "publish", MP_ORANGE1);
+  assert(field.getDim() == m_slots[0]->getDim() &&
+         "Field must match snapshot dimensions");
+
+  const u32 latest = m_latest.load(std::memory_order_relaxed);
+  const u32 slot = latest < kSlotCount ? (latest + 1) % kSlotCount : 0;
+
+  const u32 size = field.getCellCount() * sizeof(f32);
+  std::memcpy(m_slots[slot]->getX()->data(), field.getX()->data(), size);
+  std::memcpy(m_slots[slot]->getY()->data(), field.getY()->data(), size);
+  std::memcpy(m_slots[slot]->getZ()->data(), field.getZ()->data(), size);
+  m_origins[slot] = origin;
+  m_times[slot] = time;
+  m_latest.store(slot, std::memory_order_release);
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F WindSnapshots::sample(const Vec3F &point, f32 time) const {
+  const u32 latest = m_latest.load(std::memory_order_acquire);
+  if (latest >= kSlotCount) {
+    return Vec3F::ZERO;
+  }
+
+  // Blend with the previous slot if it is older
+  const u32 previous = (latest + kSlotCount - 1) % kSlotCount;
+  const f32 span = m_times[latest] - m_times[previous];
+  if (!(span > 0.0f)) {
+    return sampleSlot(latest, point);
+  }
+  const f32 t = clamp((time - m_times[previous]) / span, 0.0f, 1.0f);
+  return sampleSlot(previous, point) * (1.0f - t) +
+         sampleSlot(latest, point) * t;
+}
+
+// -------------------------------------------------------------------------- //
+
+Vec3F WindSnapshots::sampleSlot(u32 slot, const Vec3F &point) const {
+  // Outside of the domain
+  const Vec3F local = point - m_origins[slot];
+  if (local.x < 0.0f || local.y < 0.0f || local.z < 0.0f ||
+      local.x > m_size.x || local.y > m_size.y || local.z > m_size.z) {
+    return Vec3F::ZERO;
+  }
+
+  // The center of interior cell 'i' lies at (i - 0.5) cells from the origin,
+  // while the trilinear sample expects cell 'i' at 'i' cells.
+  return m_slots[slot]->sampleTrilinear(local +
+                                        Vec3F::ONE * (0.5f * m_cellSize));
+}
+
+} // namespace wind
@@ -0,0 +1,120 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/macros.hpp"
+#include "shared/math/field.hpp"
+#include "shared/types.hpp"
+
+#include <atomic>
+
+// ========================================================================== //
+// WindSnapshots Declaration
+// ========================================================================== //
+
+namespace wind {
+
+WIND_FORWARD_DECLARE(VectorField);
+
+/// Published snapshots of the velocity field of a running simulation.
+///
+/// Snapshots are triple-buffered. The simulation publishes a new snapshot by
+/// copying its velocity field into the slot after the latest one and then
+/// atomically making it the latest. Readers load the index of the latest slot
+/// and sample it without taking any locks. A slot is only written to again two
+/// publishes after it was the latest, so a reader is safe as long as a sample
+/// completes within one simulation step.
+///
+/// Snapshots that are published with a time are blended in time between the
+/// latest and the previous snapshot, at the time that is set with 'setTime'.
+/// This lets a simulation step at a lower rate than the wind is queried at,
+/// see 'WindHistory'.
+class WindSnapshots {
+public:
+  /// Number of snapshot slots
+  static constexpr u32 kSlotCount = 3;
+
+public:
+  /// Construct snapshots for fields of the specified dimensions (including
+  /// boundary cells)
+  WindSnapshots(const FieldBase::Dim &dim, f32 cellSize);
+
+  /// Destruct snapshots
+  ~WindSnapshots();
+
+  WindSnapshots(const WindSnapshots &other) = delete;
+  WindSnapshots &operator=(const WindSnapshots &other) = delete;
+
+  /// Publish a velocity field. 'origin' is the world position of the minimum
+  /// corner of the interior of the field. 'time' is the simulation time of
+  /// the field, which must increase with each publish for the snapshots to
+  /// be blended in time.
+  /// \pre Field must have the dimensions of the snapshots.
+  void publish(const VectorField &field, const Vec3F &origin,
+               f32 time = 0.0f);
+
+  /// Set the time that 'sample' blends the snapshots for
+  void setTime(f32 time) { m_time.store(time, std::memory_order_relaxed); }
+
+  /// Sample the snapshots at a point in world space at the time that was set
+  /// with 'setTime'
+  Vec3F sample(const Vec3F &point) const {
+    return sample(point, m_time.load(std::memory_order_relaxed));
+  }
+
+  /// Sample the snapshots trilinearly at a point in world space, blended
+  /// between the previous and the latest snapshot at 'time'. The time is
+  /// clamped to the times of the two snapshots, and only the latest snapshot
+  /// is sampled if they were not published with increasing times. Returns
+  /// zero if nothing has been published or if the point is outside of the
+  /// domain.
+  Vec3F sample(const Vec3F &point, f32 time) const;
+
+private:
+  /// Sample a single slot at a point in world space
+  Vec3F sampleSlot(u32 slot, const Vec3F &point) const;
+
+private:
+  /// Snapshot slots
+  VectorField *m_slots[kSlotCount];
+  /// World position of the interior minimum corner of each slot
+  Vec3F m_origins[kSlotCount];
+  /// Time of each slot. Slots that have not been published are never
+  /// blended.
+  f32 m_times[kSlotCount];
+  /// Size of the interior of the domain in meters
+  Vec3F m_size;
+  /// Size of a cell in meters
+  f32 m_cellSize;
+  /// Index of the latest slot, or 'kSlotCount' if nothing is published
+  std::atomic<u32> m_latest{kSlotCount};
+  /// Time that the snapshots are sampled at
+  std::atomic<f32> m_time{0.0f};
+};
+
+} // namespace wind
@@ -0,0 +1,257 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "shared/utility/task_graph.hpp"
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include <alflib/core/assert.hpp>
+
+#include "microprofile/microprofile.h"
+
+// ========================================================================== //
+// TaskPool Implementation
+// ========================================================================== //
+
+namespace wind {
+
+/// Index of the worker in the pool that the current thread belongs to, or -1
+/// for threads outside of the pool.
+static thread_local s32 tWorkerIndex = -1;
+
+// -------------------------------------------------------------------------- //
+
+TaskPool::TaskPool(u32 workerCount) {
+  workerCount = workerCount == 0 ? 1 : workerCount;
+  for (u32 i = 0; i < workerCount; i++) {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  for (u32 i = 0; i < workerCount; i++) {
+    m_workers.emplace_back([this, i]() { workerMain(i); });
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_shutdown = true;
+  }
+  m_sleepCond.notify_all();
+  for (std::thread &worker : m_workers) {
+    worker.join();
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void TaskPool::push(Job job) {
+  // Workers push to their own queue to keep related jobs on the same thread
+  const u32 index = tWorkerIndex >= 0
+                        ? u32(tWorkerIndex)
+                        : m_nextQueue.fetch_add(1) % u32(m_queues.size());
+  {
+    Queue &queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_queued++;
+  }
+  m_sleepCond.notify_one();
+}
+
+// -------------------------------------------------------------------------- //
+
+bool TaskPool::tryRunOne() {
+  Job job;
+  const bool found = tWorkerIndex >= 0
+                         ? pop(u32(tWorkerIndex), job) ||
+                               steal(u32(tWorkerIndex), job)
+                         : steal(u32(m_queues.size()), job);
+  if (found) {
+    job();
+  }
+  return found;
+}
+
+// -------------------------------------------------------------------------- //
+
+TaskPool &TaskPool::instance() {
+  static TaskPool pool{std::thread::hardware_concurrency() > 1
+                           ? std::thread::hardware_concurrency() - 1
+                           : 1};
+  return pool;
+}
+
+// -------------------------------------------------------------------------- //
+
+void TaskPool::workerMain(u32 index) {
+  tWorkerIndex = s32(index);
+  while (true) {
+    if (tryRunOne()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_sleepCond.wait(lock, [this]() { return m_shutdown || m_queued > 0; });
+    if (m_shutdown) {
+      return;
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+bool TaskPool::pop(u32 index, Job &job) {
+  Queue &queue = *m_queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.jobs.empty()) {
+    return false;
+  }
+  job = std::move(queue.jobs.back());
+  queue.jobs.pop_back();
+  m_queued--;
+  return true;
+}
+
+// -------------------------------------------------------------------------- //
+
+bool TaskPool::steal(u32 index, Job &job) {
+  const u32 count = u32(m_queues.size());
+  for (u32 i = 1; i <= count; i++) {
+    const u32 victim = (index + i) % count;
+    if (victim == index) {
+      continue;
+    }
+    Queue &queue = *m_queues[victim];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+      m_queued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace wind
+
+// ========================================================================== //
+// TaskGraph Implementation
+// ========================================================================== //
+
+namespace wind {
+
+TaskGraph::TaskId TaskGraph::add(std::function<void()> fn,
+                                 std::initializer_list<TaskId> deps) {
+  const TaskId id = TaskId(m_tasks.size());
+  for (const TaskId dep : deps) {
+    AlfAssert(dep < id, "Tasks can only depend on previously added tasks");
+    m_tasks[dep].dependents.push_back(id);
+  }
+  m_tasks.push_back(Task{std::move(fn), u32(deps.size()), {}});
+  return id;
+}
+
+// -------------------------------------------------------------------------- //
+
+void TaskGraph::run(TaskPool &pool) {
+  const u32 count = getTaskCount();
+  if (count == 0) {
+    return;
+  }
+
+  Run run;
+  run.pending.reset(new std::atomic<u32>[count]);
+  run.remaining = count;
+  for (u32 i = 0; i < count; i++) {
+    run.pending[i] = m_tasks[i].depCount;
+  }
+
+  // Queue roots and help out until all tasks are done. Sleep while all queued
+  // tasks have been taken by the workers.
+  for (TaskId id = 0; id < count; id++) {
+    if (m_tasks[id].depCount == 0) {
+      queueTask(pool, id, run);
+    }
+  }
+  while (run.remaining > 0) {
+    if (pool.tryRunOne()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(run.mutex);
+    run.cond.wait(lock,
+                  [&run]() { return run.remaining == 0 || run.queued > 0; });
+  }
+
+  // Wait for the last task to release the run before it goes out of scope
+  std::lock_guard<std::mutex> lock(run.mutex);
+}
+
+// -------------------------------------------------------------------------- //
+
+void TaskGraph::runSerial() {
+  for (Task &task : m_tasks) {
+    task.fn();
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+void TaskGraph::queueTask(TaskPool &pool, TaskId id, Run &run) {
+  run.queued++;
+  pool.push([this, &pool, id, &run]() { runTask(pool, id, run); });
+  {
+    // Taking the lock orders the update before the calling thread checks it
+    std::lock_guard<std::mutex> lock(run.mutex);
+  }
+  run.cond.notify_one();
+}
+
+// -------------------------------------------------------------------------- //
+
+void TaskGraph::runTask(TaskPool &pool, TaskId id, Run &run) {
+  run.queued--;
+  Task &task = m_tasks[id];
+  {
+    MICROPROFILE_SCOPEI("TaskGraph", "runTask", MP_GREEN1);
+    task.fn();
+  }
+  for (const TaskId dependent : task.dependents) {
+    if (--run.pending[dependent] == 0) {
+      queueTask(pool, dependent, run);
+    }
+  }
+  // The calling thread may return as soon as the last task is done, so the
+  // run must not be touched after the lock is released
+  std::lock_guard<std::mutex> lock(run.mutex);
+  if (--run.remaining == 0) {
+    run.cond.notify_one();
+  }
+}
+
+} // namespace wind
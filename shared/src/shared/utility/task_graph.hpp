@@ -0,0 +1,186 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Björklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// ========================================================================== //
+// Headers
+// ========================================================================== //
+
+#include "shared/types.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ========================================================================== //
+// TaskPool Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Pool of worker threads that execute jobs. Each worker has its own queue of
+/// jobs that it pushes to and pops from at the back, while idle workers steal
+/// from the front of the other queues. Jobs pushed from threads outside of the
+/// pool are spread out over the queues.
+///
+/// Threads that wait for jobs to finish are expected to help out by calling
+/// 'tryRunOne' instead of blocking.
+class TaskPool {
+public:
+  /// Job type
+  using Job = std::function<void()>;
+
+  /// Construct a pool with the specified number of worker threads
+  explicit TaskPool(u32 workerCount);
+
+  /// Destruct pool. Jobs that are still queued are not run.
+  ~TaskPool();
+
+  TaskPool(const TaskPool &other) = delete;
+  TaskPool &operator=(const TaskPool &other) = delete;
+
+  /// Queue a job. Can be called from any thread.
+  void push(Job job);
+
+  /// Run a single queued job on the calling thread, if there is one. Returns
+  /// whether a job was run.
+  bool tryRunOne();
+
+  /// Returns the number of worker threads
+  u32 getWorkerCount() const { return u32(m_workers.size()); }
+
+  /// Returns the shared pool, which has one worker less than there are
+  /// hardware threads to leave room for the thread that is waiting.
+  static TaskPool &instance();
+
+private:
+  /// Queue of jobs owned by a worker
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  /// Main function of worker 'index'
+  void workerMain(u32 index);
+
+  /// Pop a job from the back of queue 'index'
+  bool pop(u32 index, Job &job);
+
+  /// Steal a job from the front of any queue except 'index'
+  bool steal(u32 index, Job &job);
+
+private:
+  /// Job queues, one per worker
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  /// Worker threads
+  std::vector<std::thread> m_workers;
+  /// Number of jobs that are queued but not yet taken
+  std::atomic<u32> m_queued{0};
+  /// Next queue to push external jobs to
+  std::atomic<u32> m_nextQueue{0};
+
+  /// Mutex and condition that idle workers sleep on
+  std::mutex m_sleepMutex;
+  std::condition_variable m_sleepCond;
+  /// Whether the pool is shutting down
+  bool m_shutdown = false;
+};
+
+} // namespace wind
+
+// ========================================================================== //
+// TaskGraph Declaration
+// ========================================================================== //
+
+namespace wind {
+
+/// Directed acyclic graph of tasks. Each task is run once all of the tasks
+/// that it depends on have finished. Tasks that do not depend on each other
+/// may run concurrently on the workers of a task pool.
+///
+/// Tasks can only depend on tasks that were added before them, which makes
+/// the order they are added in a valid serial order of the graph.
+class TaskGraph {
+public:
+  /// Identifier of a task in the graph
+  using TaskId = u32;
+
+  /// Add a task that depends on the tasks in 'deps'
+  TaskId add(std::function<void()> fn, std::initializer_list<TaskId> deps = {});
+
+  /// Run all tasks in the graph and wait for them to finish. The calling thread
+  /// runs tasks while waiting, and sleeps while there are none that it can
+  /// run.
+  void run(TaskPool &pool = TaskPool::instance());
+
+  /// Run all tasks in the graph, in order, on the calling thread
+  void runSerial();
+
+  /// Remove all tasks
+  void clear() { m_tasks.clear(); }
+
+  /// Returns the number of tasks in the graph
+  u32 getTaskCount() const { return u32(m_tasks.size()); }
+
+private:
+  /// Task in the graph
+  struct Task {
+    /// Function to run
+    std::function<void()> fn;
+    /// Number of tasks this task depends on
+    u32 depCount;
+    /// Tasks that depend on this task
+    std::vector<TaskId> dependents;
+  };
+
+  /// State of a single run of the graph
+  struct Run {
+    /// Number of unfinished dependencies of each task
+    std::unique_ptr<std::atomic<u32>[]> pending;
+    /// Number of tasks that have not finished
+    std::atomic<u32> remaining{0};
+    /// Number of tasks that are queued but not yet started
+    std::atomic<u32> queued{0};
+    /// Mutex and condition that the calling thread sleeps on
+    std::mutex mutex;
+    std::condition_variable cond;
+  };
+
+  /// Queue task 'id' on the pool and wake the calling thread
+  void queueTask(TaskPool &pool, TaskId id, Run &run);
+
+  /// Run task 'id' and queue the dependents that become ready
+  void runTask(TaskPool &pool, TaskId id, Run &run);
+
+private:
+  /// Tasks
+  std::vector<Task> m_tasks;
+};
+
+} // namespace wind
@@ -1,6 +1,7 @@
 ﻿#include "base_functions.hpp"
 
 #include "shared/scene/builder.hpp"
+#include "shared/sim/vector_field.hpp"
 #include "shared/utility/bsprinter.hpp"
 #include "shared/utility/json_util.hpp"
 
@@ -9,6 +10,10 @@
 #include <alflib/memory/raw_memory_writer.hpp>
 #include <dlog/dlog.hpp>
 
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 #include "shared/utility/util.hpp"
 
 namespace wind {
@@ -21,6 +26,8 @@ String typeToString(Type type) {
     return "polynomial";
   case Type::kSpline:
     return "spline";
+  case Type::kGrid:
+    return "grid";
   case Type::kConstant:
     [[fallthrough]];
   default:
@@ -35,6 +42,9 @@ Type stringToType(const String &type) {
   if (type == "spline") {
     return Type::kSpline;
   }
+  if (type == "grid") {
+    return Type::kGrid;
+  }
   return Type::kConstant;
 }
 
@@ -237,43 +247,192 @@ Vec3F SplineBase::getForce(u32 index) const {
   return force;
 }
 
-Vec3F Spline::operator()(const Vec3F point) const {
-  struct SplineMeta {
-    SplineBase::ClosestPoint cp;
-    Vec3F force;
-    f32 g;
+void SplineIndex::build(const std::vector<SplineBase> &splines) {
+  // Average number of points per grid cell
+  constexpr f32 kPointsPerCell = 4.0f;
+
+  entries.clear();
+  cellStart.clear();
+  dimX = dimY = dimZ = 0;
+
+  // Bounds of all points
+  u32 count = 0;
+  constexpr f32 kMax = std::numeric_limits<f32>::max();
+  Vec3F min{kMax, kMax, kMax};
+  Vec3F max{-kMax, -kMax, -kMax};
+  for (const SplineBase &spline : splines) {
+    for (const Vec3F &p : spline.points) {
+      min = Vec3F::min(min, p);
+      max = Vec3F::max(max, p);
+      count++;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+
+  // Pick a cell size that gives a few points per cell, and grow it if flat
+  // bounds would give too many cells
+  const Vec3F extent = max - min;
+  const f32 largest = maxValue(extent.x, extent.y, extent.z);
+  const f32 minExtent = maxValue(largest * 0.01f, 0.001f);
+  const f32 volume = maxValue(extent.x, minExtent) *
+                     maxValue(extent.y, minExtent) *
+                     maxValue(extent.z, minExtent);
+  origin = min;
+  cellSize = std::cbrt(volume * kPointsPerCell / count);
+  while (true) {
+    dimX = s32(extent.x / cellSize) + 1;
+    dimY = s32(extent.y / cellSize) + 1;
+    dimZ = s32(extent.z / cellSize) + 1;
+    if (u64(dimX) * dimY * dimZ <= u64(count) * 2 + 64) {
+      break;
+    }
+    cellSize *= 1.5f;
+  }
+
+  // Counting sort of the points into cells
+  const auto cellOf = [this](const Vec3F &p) {
+    const s32 x = minValue(s32((p.x - origin.x) / cellSize), dimX - 1);
+    const s32 y = minValue(s32((p.y - origin.y) / cellSize), dimY - 1);
+    const s32 z = minValue(s32((p.z - origin.z) / cellSize), dimZ - 1);
+    return u32(x + dimX * (y + dimY * z));
   };
-  std::vector<SplineMeta> splineMeta;
-  splineMeta.reserve(splines.size());
-
-  u32 closestSplineIdx = 0;
-  f32 closestSplineDist = std::numeric_limits<f32>::max();
-
-  for (u32 i = 0; i < splines.size(); ++i) {
-    SplineMeta meta = {splines[i].findClosestPoint(point), Vec3F::ZERO, 0.0f};
-    meta.force = splines[i].getForce(meta.cp.idx);
-    if (meta.cp.dist < closestSplineDist) {
-      closestSplineIdx = i;
-      closestSplineDist = meta.cp.dist;
+  cellStart.assign(u64(dimX) * dimY * dimZ + 1, 0);
+  for (const SplineBase &spline : splines) {
+    for (const Vec3F &p : spline.points) {
+      cellStart[cellOf(p) + 1]++;
+    }
+  }
+  for (u32 i = 1; i < cellStart.size(); i++) {
+    cellStart[i] += cellStart[i - 1];
+  }
+  entries.resize(count);
+  std::vector<u32> fill(cellStart.begin(), cellStart.end() - 1);
+  for (u32 i = 0; i < splines.size(); i++) {
+    for (u32 j = 0; j < splines[i].points.size(); j++) {
+      entries[fill[cellOf(splines[i].points[j])]++] = Entry{i, j};
     }
-    splineMeta.push_back(std::move(meta));
   }
+}
 
-  f32 gSum = 0.0f;
-  for (u32 i = 0; i < splines.size(); ++i) {
-    splineMeta[i].g =
-        gaussian(splineMeta[i].cp.dist, 1.0f, 0.0f, closestSplineDist);
-    gSum += splineMeta[i].g;
+// -------------------------------------------------------------------------- //
+
+Vec3F Spline::operator()(const Vec3F point) const {
+  if (index.empty()) {
+    return Vec3F::ZERO;
   }
 
+  // Cell of the point, clamped to the grid, and the distance from the point
+  // to the grid
+  const f32 cellSize = index.cellSize;
+  const Vec3F local = point - index.origin;
+  const s32 cx = clamp(s32(std::floor(local.x / cellSize)), 0, index.dimX - 1);
+  const s32 cy = clamp(s32(std::floor(local.y / cellSize)), 0, index.dimY - 1);
+  const s32 cz = clamp(s32(std::floor(local.z / cellSize)), 0, index.dimZ - 1);
+  const Vec3F size =
+      Vec3F(f32(index.dimX), f32(index.dimY), f32(index.dimZ)) * cellSize;
+  const Vec3F inside = Vec3F::min(Vec3F::max(local, Vec3F::ZERO), size);
+  const f32 outside2 = (local - inside).squaredLength();
+
+  // Visit the entries of the cells in a box of cells
+  const auto visit = [&](s32 x0, s32 y0, s32 z0, s32 x1, s32 y1, s32 z1,
+                         auto &&fn) {
+    for (s32 z = maxValue(z0, 0); z <= minValue(z1, index.dimZ - 1); z++) {
+      for (s32 y = maxValue(y0, 0); y <= minValue(y1, index.dimY - 1); y++) {
+        for (s32 x = maxValue(x0, 0); x <= minValue(x1, index.dimX - 1);
+             x++) {
+          const u32 cell = u32(x + index.dimX * (y + index.dimY * z));
+          for (u32 i = index.cellStart[cell]; i < index.cellStart[cell + 1];
+               i++) {
+            fn(index.entries[i]);
+          }
+        }
+      }
+    }
+  };
+
+  // Find the closest point of any spline by searching rings of cells around
+  // the cell of the point. Points outside ring 'r' are at least 'r' cells
+  // away from the point once it has been clamped to the grid.
+  SplineIndex::Entry closest{0, 0};
+  f32 closestDist2 = std::numeric_limits<f32>::max();
+  const s32 maxRing = maxValue(index.dimX, index.dimY, index.dimZ);
+  for (s32 r = 0; r <= maxRing; r++) {
+    const auto fn = [&](const SplineIndex::Entry &e) {
+      const f32 d2 =
+          (splines[e.spline].points[e.point] - point).squaredLength();
+      if (d2 < closestDist2) {
+        closestDist2 = d2;
+        closest = e;
+      }
+    };
+    if (r == 0) {
+      visit(cx, cy, cz, cx, cy, cz, fn);
+    } else {
+      // Faces of the ring, without visiting any cell twice
+      visit(cx - r, cy - r, cz - r, cx + r, cy + r, cz - r, fn);
+      visit(cx - r, cy - r, cz + r, cx + r, cy + r, cz + r, fn);
+      visit(cx - r, cy - r, cz - r + 1, cx + r, cy - r, cz + r - 1, fn);
+      visit(cx - r, cy + r, cz - r + 1, cx + r, cy + r, cz + r - 1, fn);
+      visit(cx - r, cy - r + 1, cz - r + 1, cx - r, cy + r - 1, cz + r - 1,
+            fn);
+      visit(cx + r, cy - r + 1, cz - r + 1, cx + r, cy + r - 1, cz + r - 1,
+            fn);
+    }
+    const f32 ring = r * cellSize;
+    if (closestDist2 <= outside2 + ring * ring) {
+      break;
+    }
+  }
+  const f32 closestDist = std::sqrt(closestDist2);
+  if (closestDist <= std::numeric_limits<f32>::epsilon()) {
+    return splines[closest.spline].getForce(closest.point);
+  }
+
+  // Closest point of each spline within the cutoff. The scratch buffers are
+  // per thread and only grow, so queries do not allocate once warmed up.
+  thread_local std::vector<f32> bestDist2;
+  thread_local std::vector<u32> bestPoint;
+  thread_local std::vector<u32> touched;
+  if (bestDist2.size() < splines.size()) {
+    bestDist2.resize(splines.size(), std::numeric_limits<f32>::max());
+    bestPoint.resize(splines.size(), 0);
+  }
+  const f32 radius = kCutoff * closestDist;
+  const f32 radius2 = radius * radius;
+  visit(s32(std::floor((local.x - radius) / cellSize)),
+        s32(std::floor((local.y - radius) / cellSize)),
+        s32(std::floor((local.z - radius) / cellSize)),
+        s32(std::floor((local.x + radius) / cellSize)),
+        s32(std::floor((local.y + radius) / cellSize)),
+        s32(std::floor((local.z + radius) / cellSize)),
+        [&](const SplineIndex::Entry &e) {
+          const f32 d2 =
+              (splines[e.spline].points[e.point] - point).squaredLength();
+          if (d2 > radius2) {
+            return;
+          }
+          if (bestDist2[e.spline] == std::numeric_limits<f32>::max()) {
+            touched.push_back(e.spline);
+          }
+          if (d2 < bestDist2[e.spline]) {
+            bestDist2[e.spline] = d2;
+            bestPoint[e.spline] = e.point;
+          }
+        });
+
+  // Blend the forces of the splines
+  f32 gSum = 0.0f;
   Vec3F force = Vec3F::ZERO;
-  // DLOG_INFO("-----------");
-  for (const auto &meta : splineMeta) {
-    force += meta.force * (meta.g / gSum);
-    // DLOG_RAW("{:.2f}/{:.2f}\n", meta.g, gSum);
+  for (const u32 i : touched) {
+    const f32 g = gaussian(std::sqrt(bestDist2[i]), 1.0f, 0.0f, closestDist);
+    force += splines[i].getForce(bestPoint[i]) * g;
+    gSum += g;
+    bestDist2[i] = std::numeric_limits<f32>::max();
   }
-  // DLOG_INFO("force: {}", force);
-  return force;
+  touched.clear();
+  return gSum > 0.0f ? force / gSum : force;
 }
 
 bool Spline::ToBytes(alflib::RawMemoryWriter &mw) const {
@@ -292,6 +451,7 @@ Spline Spline::FromBytes(alflib::RawMemoryReader &mr) {
   for (u32 i = 0; i < count; ++i) {
     s.splines.push_back(mr.Read<SplineBase>());
   }
+  s.buildIndex();
   return s;
 }
 
@@ -311,9 +471,258 @@ Spline Spline::fromJson(const nlohmann::json &value) {
   for (const auto jspline : jsplines) {
     s.splines.push_back(SplineBase::fromJson(jspline));
   }
+  s.buildIndex();
   return s;
 }
 
+// ============================================================ //
+
+namespace {
+
+constexpr char kBase64Chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/// Encode bytes as base64
+String base64Encode(const u8 *bytes, u32 size) {
+  String out;
+  out.reserve((size + 2) / 3 * 4);
+  for (u32 i = 0; i < size; i += 3) {
+    const u32 count = minValue(size - i, 3u);
+    u32 bits = u32(bytes[i]) << 16u;
+    bits |= count > 1 ? u32(bytes[i + 1]) << 8u : 0u;
+    bits |= count > 2 ? u32(bytes[i + 2]) : 0u;
+    out += kBase64Chars[(bits >> 18u) & 63u];
+    out += kBase64Chars[(bits >> 12u) & 63u];
+    out += count > 1 ? kBase64Chars[(bits >> 6u) & 63u] : '=';
+    out += count > 2 ? kBase64Chars[bits & 63u] : '=';
+  }
+  return out;
+}
+
+/// Decode base64, stopping at the first padding or invalid character
+std::vector<u8> base64Decode(const String &text) {
+  std::vector<u8> out;
+  out.reserve(text.size() / 4 * 3);
+  u32 bits = 0;
+  u32 bitCount = 0;
+  for (const char c : text) {
+    const char *found = std::strchr(kBase64Chars, c);
+    if (c == '\0' || found == nullptr) {
+      break;
+    }
+    bits = (bits << 6u) | u32(found - kBase64Chars);
+    bitCount += 6;
+    if (bitCount >= 8) {
+      bitCount -= 8;
+      out.push_back(u8((bits >> bitCount) & 0xFFu));
+    }
+  }
+  return out;
+}
+
+} // namespace
+
+// -------------------------------------------------------------------------- //
+
+Vec3F Grid::operator()(const Vec3F point) const {
+  if (!blocks.empty()) {
+    return blocks.sampleTrilinear(point - origin);
+  }
+  if (data.empty()) {
+    return Vec3F::ZERO;
+  }
+
+  // Lower sample and fraction along each axis
+  const Vec3F local = (point - origin) / cellSize;
+  const f32 cellX = clamp(local.x, 0.0f, f32(dimX - 1));
+  const f32 cellY = clamp(local.y, 0.0f, f32(dimY - 1));
+  const f32 cellZ = clamp(local.z, 0.0f, f32(dimZ - 1));
+  const u32 x0 = minValue(u32(cellX), maxValue(dimX, 2u) - 2);
+  const u32 y0 = minValue(u32(cellY), maxValue(dimY, 2u) - 2);
+  const u32 z0 = minValue(u32(cellZ), maxValue(dimZ, 2u) - 2);
+  const u32 x1 = minValue(x0 + 1, dimX - 1);
+  const u32 y1 = minValue(y0 + 1, dimY - 1);
+  const u32 z1 = minValue(z0 + 1, dimZ - 1);
+  const f32 fx = cellX - x0;
+  const f32 fy = cellY - y0;
+  const f32 fz = cellZ - z0;
+
+  // Interpolate along x, then y, then z
+  const Vec3F c00 = get(x0, y0, z0) * (1 - fx) + get(x1, y0, z0) * fx;
+  const Vec3F c10 = get(x0, y1, z0) * (1 - fx) + get(x1, y1, z0) * fx;
+  const Vec3F c01 = get(x0, y0, z1) * (1 - fx) + get(x1, y0, z1) * fx;
+  const Vec3F c11 = get(x0, y1, z1) * (1 - fx) + get(x1, y1, z1) * fx;
+  const Vec3F c0 = c00 * (1 - fy) + c10 * fy;
+  const Vec3F c1 = c01 * (1 - fy) + c11 * fy;
+  return c0 * (1 - fz) + c1 * fz;
+}
+
+Grid Grid::fromField(const VectorField &field, u32 downsample,
+                     const Vec3F &origin, u32 bits) {
+  downsample = maxValue(downsample, 1u);
+  const auto &dim = field.getDim();
+  const auto samples = [downsample](u32 size) {
+    return (maxValue(size, 1u) - 1 + downsample - 1) / downsample + 1;
+  };
+
+  Grid g{};
+  g.origin = origin;
+  g.cellSize = field.getCellSize() * downsample;
+  g.dimX = samples(dim.width);
+  g.dimY = samples(dim.height);
+  g.dimZ = samples(dim.depth);
+
+  // Sample the field, then quantise against the largest component
+  std::vector<Vec3F> values;
+  values.reserve(g.dimX * g.dimY * g.dimZ);
+  f32 largest = 0.0f;
+  for (u32 z = 0; z < g.dimZ; z++) {
+    for (u32 y = 0; y < g.dimY; y++) {
+      for (u32 x = 0; x < g.dimX; x++) {
+        const Vec3F v =
+            field.sampleTrilinear(Vec3F(f32(x), f32(y), f32(z)) * g.cellSize);
+        largest = maxValue(largest, std::abs(v.x), std::abs(v.y));
+        largest = maxValue(largest, std::abs(v.z));
+        values.push_back(v);
+      }
+    }
+  }
+  g.scale = largest > 0.0f ? largest / 32767.0f : 1.0f;
+  if (bits > 0) {
+    VectorField samples(g.dimX, g.dimY, g.dimZ, g.cellSize);
+    for (u32 i = 0; i < values.size(); i++) {
+      samples.set(i, values[i]);
+    }
+    g.blocks.encode(samples, bits);
+  } else {
+    g.data.reserve(values.size() * 3);
+    for (const Vec3F &v : values) {
+      g.data.push_back(s16(std::lround(v.x / g.scale)));
+      g.data.push_back(s16(std::lround(v.y / g.scale)));
+      g.data.push_back(s16(std::lround(v.z / g.scale)));
+    }
+  }
+
+  DLOG_VERBOSE("[GRID] baked {}x{}x{} samples from {}x{}x{} cells ({} bytes)",
+               g.dimX, g.dimY, g.dimZ, dim.width, dim.height, dim.depth,
+               g.getSize());
+  return g;
+}
+
+void Grid::toJson(nlohmann::json &value) const {
+  JsonUtil::setValue(value, "origin", origin);
+  value["cellSize"] = cellSize;
+  value["dimensions"] = {dimX, dimY, dimZ};
+  value["scale"] = scale;
+  if (!blocks.empty()) {
+    std::vector<u8> bytes;
+    blocks.toBytes(bytes);
+    value["blocks"] = base64Encode(bytes.data(), u32(bytes.size()));
+    return;
+  }
+
+  // Samples are packed as little-endian 16-bit integers
+  std::vector<u8> bytes;
+  bytes.reserve(data.size() * 2);
+  for (const s16 d : data) {
+    bytes.push_back(u8(u16(d) & 0xFFu));
+    bytes.push_back(u8(u16(d) >> 8u));
+  }
+  value["data"] = base64Encode(bytes.data(), u32(bytes.size()));
+}
+
+Grid Grid::fromJson(const nlohmann::json &value) {
+  Grid g{};
+  g.origin = JsonUtil::getVec3F(value, "origin", Vec3F::ZERO);
+  g.cellSize = value.value("cellSize", 1.0f);
+  g.scale = value.value("scale", 0.0f);
+  const auto jdim = value.find("dimensions");
+  if (jdim != value.end() && jdim->is_array() && jdim->size() == 3) {
+    g.dimX = (*jdim)[0].get<u32>();
+    g.dimY = (*jdim)[1].get<u32>();
+    g.dimZ = (*jdim)[2].get<u32>();
+  }
+
+  // Block compressed samples
+  const String blocks = JsonUtil::getString(value, "blocks", "");
+  if (!blocks.empty()) {
+    const std::vector<u8> bytes = base64Decode(blocks);
+    const bool valid = g.blocks.fromBytes(bytes.data(), bytes.size());
+    const FieldBase::Dim &dim = g.blocks.getDim();
+    if (!valid || dim.width != g.dimX || dim.height != g.dimY ||
+        dim.depth != g.dimZ) {
+      DLOG_WARNING("Grid blocks do not match its dimensions");
+      return Grid{};
+    }
+    return g;
+  }
+
+  const std::vector<u8> bytes =
+      base64Decode(JsonUtil::getString(value, "data", ""));
+  const u32 count = g.dimX * g.dimY * g.dimZ * 3;
+  if (bytes.size() != count * 2) {
+    DLOG_WARNING("Grid data has {} bytes, expected {}", bytes.size(),
+                 count * 2);
+    return Grid{};
+  }
+  g.data.resize(count);
+  for (u32 i = 0; i < count; i++) {
+    g.data[i] = s16(u16(bytes[2 * i]) | u16(u16(bytes[2 * i + 1]) << 8u));
+  }
+  return g;
+}
+
+bool Grid::ToBytes(alflib::RawMemoryWriter &mw) const {
+  mw.Write(static_cast<std::underlying_type<Type>::type>(Type::kGrid));
+  mw.Write(origin.x);
+  mw.Write(origin.y);
+  mw.Write(origin.z);
+  mw.Write(cellSize);
+  mw.Write(dimX);
+  mw.Write(dimY);
+  mw.Write(dimZ);
+  mw.Write(scale);
+
+  // Either the block compressed samples or the 16-bit samples
+  std::vector<u8> bytes;
+  if (!blocks.empty()) {
+    blocks.toBytes(bytes);
+  }
+  bool res = mw.Write(u32(bytes.size()));
+  for (const u8 b : bytes) {
+    res = mw.Write(b);
+  }
+  for (const s16 d : data) {
+    res = mw.Write(d);
+  }
+  return res;
+}
+
+Grid Grid::FromBytes(alflib::RawMemoryReader &mr) {
+  Grid g{};
+  g.origin = bs::Vector3{mr.Read<f32>(), mr.Read<f32>(), mr.Read<f32>()};
+  g.cellSize = mr.Read<f32>();
+  g.dimX = mr.Read<u32>();
+  g.dimY = mr.Read<u32>();
+  g.dimZ = mr.Read<u32>();
+  g.scale = mr.Read<f32>();
+  const u32 blockBytes = mr.Read<u32>();
+  if (blockBytes > 0) {
+    std::vector<u8> bytes(blockBytes);
+    for (u32 i = 0; i < blockBytes; i++) {
+      bytes[i] = mr.Read<u8>();
+    }
+    g.blocks.fromBytes(bytes.data(), bytes.size());
+    return g;
+  }
+  const u32 count = g.dimX * g.dimY * g.dimZ * 3;
+  g.data.resize(count);
+  for (u32 i = 0; i < count; i++) {
+    g.data[i] = mr.Read<s16>();
+  }
+  return g;
+}
+
 } // namespace baseFunctions
 
 // ============================================================ //
@@ -329,6 +738,9 @@ BaseFn BaseFn::fromJson(const nlohmann::json &value) {
   case baseFunctions::Type::kSpline: {
     return BaseFn{Spline::fromJson(value)};
   }
+  case baseFunctions::Type::kGrid: {
+    return BaseFn{Grid::fromJson(value)};
+  }
   case baseFunctions::Type::kConstant:
     [[fallthrough]];
   default: { return BaseFn{Constant::fromJson(value)}; }
@@ -357,6 +769,10 @@ BaseFn BaseFn::FromBytes(alflib::RawMemoryReader &mr) {
     fn = BaseFn{Spline::FromBytes(mr)};
     break;
   }
+  case baseFunctions::Type::kGrid: {
+    fn = BaseFn{Grid::FromBytes(mr)};
+    break;
+  }
   case baseFunctions::Type::kConstant:
     [[fallthrough]];
   default: { fn = BaseFn{Constant::FromBytes(mr)}; }
@@ -371,6 +787,9 @@ String BaseFn::typeToString() const {
   if (isType<Spline>()) {
     return baseFunctions::typeToString(baseFunctions::Type::kSpline);
   }
+  if (isType<Grid>()) {
+    return baseFunctions::typeToString(baseFunctions::Type::kGrid);
+  }
   return baseFunctions::typeToString(baseFunctions::Type::kConstant);
 }
 
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "shared/math/math.hpp"
+#include "shared/sim/block_field.hpp"
 #include "shared/types.hpp"
 #include <variant>
 #include <vector>
@@ -14,6 +15,8 @@ class RawMemoryReader;
 
 namespace wind {
 
+class VectorField;
+
 namespace baseFunctions {
 
 enum class Type : u32 {
@@ -21,6 +24,7 @@ enum class Type : u32 {
   kPolynomial,
   kSpline,
   kSplineCollection,
+  kGrid,
 };
 
 String typeToString(Type type);
@@ -98,12 +102,51 @@ private:
   Vec3F getForce(u32 index) const;
 };
 
+/// Uniform grid over the points of a collection of splines, used to find the
+/// splines near a point without visiting every point.
+struct SplineIndex {
+  /// Point in the grid, tagged with the spline it belongs to
+  struct Entry {
+    u32 spline;
+    u32 point;
+  };
+
+  /// Minimum corner of the grid
+  Vec3F origin = Vec3F::ZERO;
+  /// Size of a grid cell
+  f32 cellSize = 1.0f;
+  /// Number of cells along each axis
+  s32 dimX = 0, dimY = 0, dimZ = 0;
+  /// Offset of the first entry of each cell, plus one past the last cell
+  std::vector<u32> cellStart;
+  /// Entries sorted by cell
+  std::vector<Entry> entries;
+
+  /// Build the index over the points of 'splines'
+  void build(const std::vector<SplineBase> &splines);
+
+  /// Returns whether the index is empty
+  bool empty() const { return entries.empty(); }
+};
+
 /// Spline has a collection of SplineBase.
+///
+/// A query weighs the closest point of each spline with a gaussian whose width
+/// is the distance to the closest point of any spline. Splines further away
+/// than 'kCutoff' widths are skipped, which lets the spatial index limit the
+/// query to nearby points.
 struct Spline {
+  /// Distance, in kernel widths, beyond which splines do not contribute
+  static constexpr f32 kCutoff = 3.0f;
+
   std::vector<SplineBase> splines;
+  SplineIndex index;
 
   Vec3F operator()(Vec3F point) const;
 
+  /// Build the spatial index. Must be called after the splines are changed.
+  void buildIndex() { index.build(splines); }
+
   void toJson(nlohmann::json &value) const;
   static Spline fromJson(const nlohmann::json &value);
 
@@ -111,6 +154,63 @@ struct Spline {
   static Spline FromBytes(alflib::RawMemoryReader &mr);
 };
 
+/// Grid is a baked velocity volume. The velocities are sampled from a
+/// simulation at a coarser resolution and stored as 16-bit integers scaled by
+/// 'scale', and looked up with trilinear interpolation. Points outside the
+/// grid are clamped to its edge.
+///
+/// A grid can instead store its samples block compressed in 'blocks', which
+/// takes about a third of the memory at 4 bits per component, in which case
+/// 'data' is empty.
+struct Grid {
+  /// Position of the first sample
+  Vec3F origin = Vec3F::ZERO;
+  /// Distance between samples
+  f32 cellSize = 1.0f;
+  /// Number of samples along each axis
+  u32 dimX = 0, dimY = 0, dimZ = 0;
+  /// Velocity of one unit of the quantised data
+  f32 scale = 0.0f;
+  /// Quantised velocities, three components per sample with x fastest
+  std::vector<s16> data;
+  /// Block compressed velocities, used instead of 'data' when not empty
+  BlockVectorField blocks;
+
+  Vec3F operator()(Vec3F point) const;
+
+  /// Bake a velocity field into a grid, keeping every 'downsample' cell along
+  /// each axis. The grid covers the whole field, including the boundary, and
+  /// uses the coordinates of 'VectorField::sampleTrilinear' offset by
+  /// 'origin'. If 'bits' is not zero the samples are block compressed with
+  /// that many bits per component.
+  static Grid fromField(const VectorField &field, u32 downsample = 1,
+                        const Vec3F &origin = Vec3F::ZERO, u32 bits = 0);
+
+  /// Returns the velocity of a sample
+  Vec3F get(u32 x, u32 y, u32 z) const {
+    if (!blocks.empty()) {
+      return blocks.get(x, y, z);
+    }
+    const u32 offset = 3 * (x + dimX * (y + dimY * z));
+    return Vec3F(data[offset], data[offset + 1], data[offset + 2]) * scale;
+  }
+
+  /// Returns the number of bits per component of block compressed samples,
+  /// or zero if the samples are stored as 16-bit integers
+  u32 getBits() const { return blocks.empty() ? 0 : blocks.getBits(); }
+
+  /// Returns the size of the samples in bytes
+  u64 getSize() const {
+    return blocks.empty() ? data.size() * sizeof(s16) : blocks.getSize();
+  }
+
+  void toJson(nlohmann::json &value) const;
+  static Grid fromJson(const nlohmann::json &value);
+
+  bool ToBytes(alflib::RawMemoryWriter &mw) const;
+  static Grid FromBytes(alflib::RawMemoryReader &mr);
+};
+
 } // namespace baseFunctions
 
 // ============================================================ //
@@ -120,7 +220,8 @@ struct BaseFn {
   using Polynomial = baseFunctions::Polynomial;
   using SplineBase = baseFunctions::SplineBase;
   using Spline = baseFunctions::Spline;
-  using Variant = std::variant<Constant, Polynomial, Spline>;
+  using Grid = baseFunctions::Grid;
+  using Variant = std::variant<Constant, Polynomial, Spline, Grid>;
 
   Variant fn;
 
@@ -138,7 +239,14 @@ struct BaseFn {
   }
 
   static BaseFn fnSpline(std::vector<SplineBase> &&splines) {
-    return BaseFn{Spline{std::move(splines)}};
+    Spline spline{std::move(splines)};
+    spline.buildIndex();
+    return BaseFn{std::move(spline)};
+  }
+
+  static BaseFn fnGrid(const VectorField &field, u32 downsample = 1,
+                       const Vec3F &origin = Vec3F::ZERO, u32 bits = 0) {
+    return BaseFn{Grid::fromField(field, downsample, origin, bits)};
   }
 
   /// Construct a BaseFn from json object.
@@ -27,6 +27,9 @@
 // ========================================================================== //
 
 #include "shared/scene/component/cwind.hpp"
+#include "shared/sim/pod_model.hpp"
+#include "shared/sim/wind_atlas.hpp"
+#include "shared/sim/wind_snapshots.hpp"
 #include <Components/BsCCollider.h>
 #include <Physics/BsPhysics.h>
 #include <Scene/BsSceneManager.h>
@@ -91,8 +94,17 @@ Vec3F WindSystem::getWindAtPoint(Vec3F point) const {
     return Vec3F::ZERO;
   }
 
+  // Start from the live simulation, if any
+  const WindSnapshots *simSource = getSimSource();
+  Vec3F wind = simSource ? simSource->sample(point) : Vec3F::ZERO;
+  if (const PodModel *podSource = getPodSource()) {
+    wind += podSource->sampleWorld(point);
+  }
+  if (const WindAtlas *atlasSource = getAtlasSource()) {
+    wind += atlasSource->sampleWorld(point);
+  }
+
   // Add effects of each volume
-  Vec3F wind = Vec3F::ZERO;
   const auto colliders = physicsScene->sphereOverlap(sphere, kWindVolumeLayer);
   for (const auto &collider : colliders) {
     bs::HSceneObject so = collider->SO()->getParent();
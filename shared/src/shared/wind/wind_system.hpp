@@ -22,15 +22,22 @@
 
 #pragma once
 
+#include "shared/macros.hpp"
 #include "shared/math/math.hpp"
 #include "shared/types.hpp"
 
+#include <atomic>
+
 // ========================================================================== //
 // WindSystem Declaration
 // ========================================================================== //
 
 namespace wind {
 
+WIND_FORWARD_DECLARE(PodModel);
+WIND_FORWARD_DECLARE(WindAtlas);
+WIND_FORWARD_DECLARE(WindSnapshots);
+
 /// Singleton wind system
 class WindSystem {
 public:
@@ -60,11 +67,52 @@ public:
 
   Vec3F getWindAtPoint(Vec3F point) const;
 
+  /// Set the snapshots of a live simulation that are sampled in addition to
+  /// the wind volumes. Nullptr removes the simulation.
+  void setSimSource(const WindSnapshots *snapshots) {
+    m_simSource.store(snapshots, std::memory_order_release);
+  }
+
+  /// Returns the snapshots of the live simulation, if any
+  const WindSnapshots *getSimSource() const {
+    return m_simSource.load(std::memory_order_acquire);
+  }
+
+  /// Set a reduced-order model that is sampled in addition to the wind
+  /// volumes. Nullptr removes the model.
+  void setPodSource(const PodModel *model) {
+    m_podSource.store(model, std::memory_order_release);
+  }
+
+  /// Returns the reduced-order model, if any
+  const PodModel *getPodSource() const {
+    return m_podSource.load(std::memory_order_acquire);
+  }
+
+  /// Set a wind atlas that is sampled in addition to the wind volumes, with
+  /// the wind that was last set on it. Nullptr removes the atlas.
+  void setAtlasSource(const WindAtlas *atlas) {
+    m_atlasSource.store(atlas, std::memory_order_release);
+  }
+
+  /// Returns the wind atlas, if any
+  const WindAtlas *getAtlasSource() const {
+    return m_atlasSource.load(std::memory_order_acquire);
+  }
+
 private:
   WindSystem() = default;
 
   WindSystem(const WindSystem &other) = delete;
   WindSystem &operator=(const WindSystem &other) = delete;
+
+private:
+  /// Snapshots of the live simulation
+  std::atomic<const WindSnapshots *> m_simSource{nullptr};
+  /// Reduced-order model
+  std::atomic<const PodModel *> m_podSource{nullptr};
+  /// Wind atlas
+  std::atomic<const WindAtlas *> m_atlasSource{nullptr};
 };
 
 inline WindSystem &gWindSystem() { return WindSystem::instance(); }
@@ -81,6 +81,7 @@ File::Result File::Open(const std::string &path_out, const Mode mode) {
 void File::Close() {
   if (file_ && file_ != NULL) {
     fclose(file_);
+    file_ = NULL;
   }
 }
 
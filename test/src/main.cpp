@@ -31,16 +31,29 @@
 
 class TestApp : public wind::App {
 public:
-  explicit TestApp(const Info &info) : App(info) {}
+  TestApp(const Info &info, int argc, char **argv)
+      : App(info), m_argc(argc), m_argv(argv) {}
 
   void onStartup() override {
-    doctest::Context(0, nullptr).run();
+    m_result = doctest::Context(m_argc, m_argv).run();
     quit();
   }
+
+  /// Returns the result of the tests, non-zero if any test failed
+  int getResult() const { return m_result; }
+
+private:
+  /// Command line arguments, passed on to doctest
+  int m_argc;
+  char **m_argv;
+  /// Result of the tests
+  int m_result = 0;
 };
 
 int main(int argc, char **argv) {
-  TestApp app(TestApp::Info{"test", 100, 100, 20});
-  app.hide();
+  TestApp::Info info{"test", 100, 100, 20};
+  info.hidden = true;
+  TestApp app(info, argc, argv);
   app.run();
+  return app.getResult();
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/sim/block_field.hpp>
+#include <shared/sim/vector_field.hpp>
+#include <shared/wind/base_functions.hpp>
+
+#include <cmath>
+#include <filesystem>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+TEST_CASE("Block field error bound") {
+  // Dimensions that are not multiples of the block size
+  VectorField field(13, 6, 9, 0.5f);
+  for (u32 i = 0; i < field.getCellCount(); i++) {
+    const f32 s = f32(i);
+    field.set(i, Vec3F(std::sin(s * 0.3f) * 3.0f, std::cos(s * 0.11f),
+                       s * 0.02f - 5.0f));
+  }
+
+  for (u32 bits : {1u, 2u, 4u, 8u}) {
+    CAPTURE(bits);
+    BlockVectorField block;
+    const f32 maxError = block.encode(field, bits);
+    CHECK_EQ(block.getBits(), bits);
+
+    // Each component is within half a step of its block. The step is
+    // at most the range of the component over the whole field.
+    const f32 levels = f32((1u << bits) - 1u);
+    f32 error = 0.0f;
+    VectorField decoded(13, 6, 9, 0.5f);
+    block.decode(decoded);
+    for (u32 i = 0; i < field.getCellCount(); i++) {
+      const Vec3F d = decoded.get(i) - field.get(i);
+      error = maxValue(error, maxValue(std::abs(d.x),
+                                       maxValue(std::abs(d.y), std::abs(d.z))));
+    }
+    CHECK_LE(error, maxError + 1e-5f);
+    CHECK_LE(maxError, 15.0f / (2.0f * levels) + 1e-5f);
+
+    // Decoding the whole field matches decoding each cell
+    const FieldBase::Dim &dim = block.getDim();
+    for (u32 z = 0; z < dim.depth; z++) {
+      for (u32 y = 0; y < dim.height; y++) {
+        for (u32 x = 0; x < dim.width; x++) {
+          const Vec3F a = block.get(x, y, z);
+          const Vec3F b = decoded.get(s32(x), s32(y), s32(z));
+          CHECK_EQ(a.x, b.x);
+          CHECK_EQ(a.y, b.y);
+          CHECK_EQ(a.z, b.z);
+        }
+      }
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Block field constant") {
+  VectorField field(4, 4, 4, 1.0f);
+  for (u32 i = 0; i < field.getCellCount(); i++) {
+    field.set(i, Vec3F(1.5f, -2.0f, 0.25f));
+  }
+  BlockVectorField block;
+  CHECK_EQ(block.encode(field), 0.0f);
+  const Vec3F v = block.get(3, 2, 1);
+  CHECK_EQ(v.x, 1.5f);
+  CHECK_EQ(v.y, -2.0f);
+  CHECK_EQ(v.z, 0.25f);
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Block field save and load") {
+  VectorField field(6, 5, 7, 0.25f);
+  for (u32 i = 0; i < field.getCellCount(); i++) {
+    field.set(i, Vec3F(f32(i % 5), -f32(i % 3), f32(i) * 0.1f));
+  }
+  BlockVectorField block;
+  block.encode(field, 6);
+
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "wind_block.bin").string();
+  REQUIRE(block.save(path));
+  BlockVectorField loaded;
+  REQUIRE(loaded.load(path));
+  CHECK_EQ(loaded.getBits(), 6u);
+  CHECK_EQ(loaded.getCellSize(), 0.25f);
+  CHECK_EQ(loaded.getSize(), block.getSize());
+  const Vec3F a = block.get(5, 4, 6);
+  const Vec3F b = loaded.get(5, 4, 6);
+  CHECK_EQ(a.x, b.x);
+  CHECK_EQ(a.y, b.y);
+  CHECK_EQ(a.z, b.z);
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Block compressed grid") {
+  VectorField field(13, 6, 9, 0.5f);
+  for (u32 i = 0; i < field.getCellCount(); i++) {
+    const f32 s = f32(i);
+    field.set(i, Vec3F(std::sin(s * 0.3f) * 3.0f, std::cos(s * 0.11f),
+                       s * 0.02f - 5.0f));
+  }
+  const Vec3F origin(2.0f, -1.0f, 0.5f);
+  const BaseFn::Grid grid = BaseFn::Grid::fromField(field, 2, origin);
+  const BaseFn::Grid blocks = BaseFn::Grid::fromField(field, 2, origin, 4);
+  CHECK_EQ(grid.getBits(), 0u);
+  CHECK_EQ(blocks.getBits(), 4u);
+  CHECK(blocks.data.empty());
+  CHECK_LT(blocks.getSize(), grid.getSize());
+
+  // The compressed grid samples the same points, to within half a step of 4
+  // bits over the range of the field
+  const f32 maxError = 15.0f / (2.0f * 15.0f) + 1e-3f;
+  for (const Vec3F &point :
+       {origin, origin + Vec3F(1.3f, 0.7f, 2.2f), origin + Vec3F::ONE * 10.0f,
+        origin - Vec3F::ONE}) {
+    CAPTURE(point.x);
+    const Vec3F d = blocks(point) - grid(point);
+    CHECK_LE(maxValue(std::abs(d.x), std::abs(d.y), std::abs(d.z)),
+             maxError);
+  }
+
+  // The compressed samples survive serialisation
+  nlohmann::json value;
+  blocks.toJson(value);
+  const BaseFn::Grid loaded = BaseFn::Grid::fromJson(value);
+  CHECK_EQ(loaded.getBits(), 4u);
+  const Vec3F point = origin + Vec3F(2.1f, 0.4f, 1.9f);
+  const Vec3F a = blocks(point);
+  const Vec3F b = loaded(point);
+  CHECK_EQ(a.x, b.x);
+  CHECK_EQ(a.y, b.y);
+  CHECK_EQ(a.z, b.z);
+}
+
+} // namespace wind
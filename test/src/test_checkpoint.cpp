@@ -0,0 +1,163 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/sim/checkpoint.hpp>
+#include <shared/sim/wind_sim.hpp>
+
+#include <cstring>
+#include <filesystem>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+/// Setup a simulation with obstructions, a partially open face and
+/// conditions at the faces of the domain that differ from the defaults
+static void testCheckpointSetup(WindSimulation &sim) {
+  for (s32 z = 4; z < 7; z++) {
+    for (s32 y = 1; y < 4; y++) {
+      sim.O().get(5, y, z) = true;
+    }
+  }
+  sim.O().setOpen(0, sim.O().fromPos(8, 2, 3), 0.5f);
+  sim.setDomainCondition(DomainBoundary::kMinZ, DomainCondition::kInflow,
+                         Vec3F(0.0f, 0.5f, 1.0f));
+  sim.setDomainCondition(DomainBoundary::kMaxZ, DomainCondition::kOutflow);
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns whether the state of two simulations is identical
+static bool testCheckpointEqual(const WindSimulation &a,
+                                const WindSimulation &b) {
+  for (u32 i = 0; i < a.V().getCellCount(); i++) {
+    const Vec3F va = a.V().get(i);
+    const Vec3F vb = b.V().get(i);
+    if (va.x != vb.x || va.y != vb.y || va.z != vb.z ||
+        a.O().get(i) != b.O().get(i)) {
+      return false;
+    }
+  }
+  const u32 faceCount = 3 * a.O().getCellCount();
+  return std::memcmp(a.O().getFaces(), b.O().getFaces(),
+                     sizeof(f32) * faceCount) == 0 &&
+         a.O().getPartialCells() == b.O().getPartialCells();
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Checkpoint restore") {
+  WindSimulation a(10, 6, 12, 0.5f);
+  testCheckpointSetup(a);
+  a.stepN(1.0f / 60.0f, 10);
+
+  std::vector<u8> buffer;
+  Checkpoint::write(a, buffer);
+  WindSimulation b(10, 6, 12, 0.5f);
+  REQUIRE(Checkpoint::restore(b, buffer.data(), buffer.size()));
+  CHECK(testCheckpointEqual(a, b));
+  CHECK_EQ(b.getDomainBoundary().conditions[DomainBoundary::kMinZ],
+           DomainCondition::kInflow);
+  CHECK_EQ(b.getDomainBoundary().conditions[DomainBoundary::kMaxZ],
+           DomainCondition::kOutflow);
+  CHECK_EQ(b.getDomainBoundary().inflow[DomainBoundary::kMinZ].y, 0.5f);
+
+  // Both simulations continue in the same way
+  a.stepN(1.0f / 60.0f, 5);
+  b.stepN(1.0f / 60.0f, 5);
+  CHECK(testCheckpointEqual(a, b));
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Checkpoint save and load") {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "wind_checkpoint.bin")
+          .string();
+  WindSimulation a(10, 6, 12, 0.5f);
+  testCheckpointSetup(a);
+  a.stepN(1.0f / 60.0f, 10);
+  REQUIRE(Checkpoint::save(a, path));
+
+  WindSimulation b(10, 6, 12, 0.5f);
+  REQUIRE(Checkpoint::load(b, path));
+  CHECK(testCheckpointEqual(a, b));
+
+  WindSimulation c(8, 6, 12, 0.5f);
+  CHECK_FALSE(Checkpoint::load(c, path));
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Checkpoint corruption") {
+  WindSimulation a(10, 6, 12, 0.5f);
+  testCheckpointSetup(a);
+  a.stepN(1.0f / 60.0f, 10);
+  std::vector<u8> buffer;
+  Checkpoint::write(a, buffer);
+  Checkpoint::Header header;
+  std::memcpy(&header, buffer.data(), sizeof(header));
+
+  // Simulation that must be left untouched by a corrupt checkpoint
+  WindSimulation b(10, 6, 12, 0.5f);
+  b.stepN(1.0f / 60.0f, 3);
+  std::vector<u8> before;
+  Checkpoint::write(b, before);
+
+  const auto restore = [&](const Checkpoint::Header &corrupt, u64 size) {
+    std::vector<u8> data = buffer;
+    std::memcpy(data.data(), &corrupt, sizeof(corrupt));
+    return Checkpoint::restore(b, data.data(), size);
+  };
+
+  SUBCASE("Bad magic") {
+    Checkpoint::Header corrupt = header;
+    corrupt.magic = 0;
+    CHECK_FALSE(restore(corrupt, buffer.size()));
+  }
+
+  SUBCASE("Truncated") {
+    CHECK_FALSE(restore(header, buffer.size() / 2));
+  }
+
+  SUBCASE("Section outside of the data") {
+    Checkpoint::Header corrupt = header;
+    corrupt.offsets[Checkpoint::kObstrFaces] = corrupt.size;
+    CHECK_FALSE(restore(corrupt, buffer.size()));
+  }
+
+  SUBCASE("Invalid domain condition") {
+    Checkpoint::Header corrupt = header;
+    corrupt.conditions[DomainBoundary::kMaxY] = 17u;
+    CHECK_FALSE(restore(corrupt, buffer.size()));
+  }
+
+  std::vector<u8> after;
+  Checkpoint::write(b, after);
+  CHECK(before == after);
+}
+
+} // namespace wind
@@ -0,0 +1,134 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/sim/pod_model.hpp>
+#include <shared/sim/vector_field.hpp>
+#include <shared/sim/wind_sim.hpp>
+
+#include <cmath>
+#include <filesystem>
+#include <vector>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+/// Returns the largest error of any component between two fields, relative to
+/// the largest component of 'b'
+static f32 testPodError(const VectorField &a, const VectorField &b) {
+  f32 error = 0.0f;
+  f32 largest = 0.0f;
+  for (u32 i = 0; i < a.getCellCount(); i++) {
+    const Vec3F va = a.get(i);
+    const Vec3F vb = b.get(i);
+    for (u32 c = 0; c < 3; c++) {
+      error = maxValue(error, std::abs(va[c] - vb[c]));
+      largest = maxValue(largest, std::abs(vb[c]));
+    }
+  }
+  return error / maxValue(largest, 1e-6f);
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("POD reconstruction") {
+  constexpr f32 kDelta = 1.0f / 60.0f;
+  WindSimulation sim(10, 6, 12, 0.5f);
+  for (s32 y = 1; y < 5; y++) {
+    sim.O().get(4, y, 6) = true;
+  }
+  sim.setDomainCondition(DomainBoundary::kMinZ, DomainCondition::kInflow,
+                         Vec3F(0.0f, 0.0f, 2.0f));
+  sim.setDomainCondition(DomainBoundary::kMaxZ, DomainCondition::kOutflow);
+
+  // Keep the snapshots to compare the reconstruction against
+  const FieldBase::Dim &dim = sim.V().getDim();
+  PodBuilder builder(dim, sim.getCellSize());
+  std::vector<VectorField *> snapshots;
+  for (u32 i = 0; i < 8; i++) {
+    sim.stepN(kDelta, 2);
+    builder.addSnapshot(sim.V());
+    VectorField *snapshot =
+        new VectorField(dim.width, dim.height, dim.depth, sim.getCellSize());
+    for (u32 cell = 0; cell < snapshot->getCellCount(); cell++) {
+      snapshot->set(cell, sim.V().get(cell));
+    }
+    snapshots.push_back(snapshot);
+  }
+
+  // With as many modes as snapshots, each snapshot is reconstructed up to
+  // the quantisation of the modes
+  PodModel model;
+  REQUIRE(builder.build(model, kDelta, 8, 1.0f));
+  CHECK_LE(model.getModeCount(), 8u);
+  VectorField field(dim.width, dim.height, dim.depth, sim.getCellSize());
+  for (u32 i = 0; i < snapshots.size(); i++) {
+    CAPTURE(i);
+    model.reconstruct(field);
+    CHECK_LT(testPodError(field, *snapshots[i]), 1e-3f);
+    model.update(kDelta);
+  }
+
+  SUBCASE("Sample") {
+    // World samples at cell centers match the reconstructed cells
+    const Vec3F origin(10.0f, -2.0f, 3.0f);
+    const f32 cellSize = sim.getCellSize();
+    model.setOrigin(origin);
+    model.reconstruct(field);
+    for (u32 cell : {field.fromPos(1, 1, 1), field.fromPos(5, 3, 7),
+                     field.fromPos(10, 6, 12)}) {
+      const FieldBase::Pos pos = field.fromOffset(cell);
+      const Vec3F point =
+          origin + Vec3F(pos.x - 0.5f, pos.y - 0.5f, pos.z - 0.5f) * cellSize;
+      const Vec3F a = model.sampleWorld(point);
+      const Vec3F b = field.get(cell);
+      CHECK(a.x == doctest::Approx(b.x).epsilon(1e-4));
+      CHECK(a.y == doctest::Approx(b.y).epsilon(1e-4));
+      CHECK(a.z == doctest::Approx(b.z).epsilon(1e-4));
+    }
+    const Vec3F outside = model.sampleWorld(origin - Vec3F::ONE);
+    CHECK_EQ(outside.x, 0.0f);
+    CHECK_EQ(outside.y, 0.0f);
+    CHECK_EQ(outside.z, 0.0f);
+  }
+
+  SUBCASE("Save and load") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "wind_model.pod").string();
+    REQUIRE(model.save(path));
+    PodModel loaded;
+    REQUIRE(loaded.load(path));
+    CHECK_EQ(loaded.getModeCount(), model.getModeCount());
+    loaded.reconstruct(field);
+    CHECK_LT(testPodError(field, *snapshots[0]), 1e-3f);
+  }
+
+  for (VectorField *snapshot : snapshots) {
+    delete snapshot;
+  }
+}
+
+} // namespace wind
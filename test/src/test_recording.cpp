@@ -0,0 +1,170 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/sim/recording.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+/// Fill a field with a pattern that changes sign and magnitude between frames,
+/// so that both small and large differences have to be packed.
+static void testRecordingFill(VectorField &field, u32 frame) {
+  for (u32 i = 0; i < field.getCellCount(); i++) {
+    const f32 t = f32(frame);
+    const f32 s = f32(i);
+    field.set(i, Vec3F(std::sin(s * 0.37f + t) * 4.0f,
+                       (frame % 3 == 0 ? -1.0f : 1.0f) * s * 0.01f,
+                       i % 7 == 0 ? t * 25.0f - 100.0f : 0.0f));
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+/// Returns the largest error of any component between two fields
+static f32 testRecordingError(const VectorField &a, const VectorField &b) {
+  f32 error = 0.0f;
+  for (u32 i = 0; i < a.getCellCount(); i++) {
+    const Vec3F d = a.get(i) - b.get(i);
+    error = maxValue(error, maxValue(std::abs(d.x),
+                                     maxValue(std::abs(d.y), std::abs(d.z))));
+  }
+  return error;
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Recording round trip") {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "wind_recording.bin").string();
+  constexpr u32 kFrames = 10;
+  constexpr f32 kQuantum = 0.001f;
+  constexpr f32 kEpsilon = 1e-4f;
+
+  // Width and depth that are not multiples of the brick size
+  VectorField field(11, 5, 9, 0.5f);
+  RecordingWriter writer;
+  REQUIRE(writer.open(path, field.getDim(), 0.5f, kQuantum, 4));
+  for (u32 frame = 0; frame < kFrames; frame++) {
+    testRecordingFill(field, frame);
+    REQUIRE(writer.write(field, frame * 0.1f));
+  }
+  REQUIRE(writer.close());
+
+  RecordingReader reader;
+  REQUIRE(reader.open(path));
+  CHECK_EQ(reader.getFrameCount(), kFrames);
+
+  SUBCASE("Sequential") {
+    for (u32 frame = 0; frame < kFrames; frame++) {
+      if (frame > 0) {
+        REQUIRE(reader.next());
+      }
+      testRecordingFill(field, frame);
+      CHECK_EQ(reader.getFrame(), frame);
+      CHECK_LE(testRecordingError(reader.getField(), field),
+               kQuantum * 0.5f + kEpsilon);
+    }
+    CHECK_FALSE(reader.next());
+  }
+
+  SUBCASE("Seek") {
+    for (u32 frame : {7u, 2u, 9u, 4u, 0u}) {
+      REQUIRE(reader.seek(frame));
+      testRecordingFill(field, frame);
+      CHECK_EQ(reader.getFrame(), frame);
+      CHECK_LE(testRecordingError(reader.getField(), field),
+               kQuantum * 0.5f + kEpsilon);
+    }
+    REQUIRE(reader.seekTime(0.55f));
+    CHECK_EQ(reader.getFrame(), 5u);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Recording corruption") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path();
+  const std::string path = (dir / "wind_recording.bin").string();
+  const std::string corruptPath = (dir / "wind_recording_corrupt.bin").string();
+
+  VectorField field(8, 8, 8, 1.0f);
+  RecordingWriter writer;
+  REQUIRE(writer.open(path, field.getDim(), 1.0f));
+  for (u32 frame = 0; frame < 3; frame++) {
+    testRecordingFill(field, frame);
+    REQUIRE(writer.write(field, f32(frame)));
+  }
+  REQUIRE(writer.close());
+
+  std::ifstream in(path, std::ios::binary);
+  const std::vector<char> data(std::istreambuf_iterator<char>(in), {});
+  in.close();
+
+  const auto openCorrupt = [&](const std::vector<char> &corrupt) {
+    std::ofstream out(corruptPath, std::ios::binary);
+    out.write(corrupt.data(), std::streamsize(corrupt.size()));
+    out.close();
+    RecordingReader reader;
+    return reader.open(corruptPath);
+  };
+
+  Recording::Footer footer;
+  std::memcpy(&footer, data.data() + data.size() - sizeof(footer),
+              sizeof(footer));
+
+  CHECK(openCorrupt(data));
+
+  SUBCASE("Truncated") {
+    std::vector<char> corrupt = data;
+    corrupt.resize(data.size() / 2);
+    CHECK_FALSE(openCorrupt(corrupt));
+  }
+
+  SUBCASE("Frame offset outside the file") {
+    std::vector<char> corrupt = data;
+    Recording::IndexEntry entry;
+    char *ptr = corrupt.data() + footer.indexOffset + sizeof(entry);
+    std::memcpy(&entry, ptr, sizeof(entry));
+    entry.offset = u64(1) << 40u;
+    std::memcpy(ptr, &entry, sizeof(entry));
+    CHECK_FALSE(openCorrupt(corrupt));
+  }
+
+  SUBCASE("Bad magic") {
+    std::vector<char> corrupt = data;
+    corrupt[0] ^= 0x7F;
+    CHECK_FALSE(openCorrupt(corrupt));
+  }
+}
+
+} // namespace wind
@@ -0,0 +1,140 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/utility/task_graph.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+/// Build a graph of 'layers' layers of 'width' tasks, where each task depends
+/// on two tasks of the previous layer. Task 'i' writes 'values[i]' from the
+/// values of its dependencies, so the result depends on the order.
+static void buildLayers(TaskGraph &graph, std::vector<u32> &values, u32 layers,
+                        u32 width) {
+  values.assign(layers * width, 0);
+  for (u32 layer = 0; layer < layers; layer++) {
+    for (u32 i = 0; i < width; i++) {
+      const u32 id = layer * width + i;
+      if (layer == 0) {
+        graph.add([&values, id]() { values[id] = id + 1; });
+        continue;
+      }
+      const u32 a = (layer - 1) * width + i;
+      const u32 b = (layer - 1) * width + (i + 1) % width;
+      graph.add(
+          [&values, id, a, b]() { values[id] = values[a] * 3 + values[b]; },
+          {a, b});
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Task graph dependency order") {
+  TaskPool pool(3);
+  for (u32 repeat = 0; repeat < 20; repeat++) {
+    // Diamond followed by a chain, each task records when it finished
+    TaskGraph graph;
+    std::atomic<u32> counter{0};
+    std::vector<u32> finished(6, 0);
+    const auto task = [&](u32 index) {
+      return [&, index]() { finished[index] = ++counter; };
+    };
+    const TaskGraph::TaskId top = graph.add(task(0));
+    const TaskGraph::TaskId left = graph.add(task(1), {top});
+    const TaskGraph::TaskId right = graph.add(task(2), {top});
+    const TaskGraph::TaskId bottom = graph.add(task(3), {left, right});
+    const TaskGraph::TaskId next = graph.add(task(4), {bottom});
+    graph.add(task(5), {next, top});
+    graph.run(pool);
+
+    CHECK_EQ(counter.load(), 6);
+    CHECK_LT(finished[0], finished[1]);
+    CHECK_LT(finished[0], finished[2]);
+    CHECK_LT(finished[1], finished[3]);
+    CHECK_LT(finished[2], finished[3]);
+    CHECK_LT(finished[3], finished[4]);
+    CHECK_LT(finished[4], finished[5]);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Task graph serial and concurrent runs match") {
+  constexpr u32 kLayers = 8;
+  constexpr u32 kWidth = 16;
+
+  std::vector<u32> serial;
+  TaskGraph serialGraph;
+  buildLayers(serialGraph, serial, kLayers, kWidth);
+  serialGraph.runSerial();
+
+  TaskPool pool(3);
+  std::vector<u32> concurrent;
+  TaskGraph graph;
+  buildLayers(graph, concurrent, kLayers, kWidth);
+  CHECK_EQ(graph.getTaskCount(), kLayers * kWidth);
+  for (u32 repeat = 0; repeat < 10; repeat++) {
+    std::fill(concurrent.begin(), concurrent.end(), 0);
+    graph.run(pool);
+    CHECK(concurrent == serial);
+  }
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Task graph run from a worker") {
+  // Each outer task runs a graph of its own on the same pool. The worker has
+  // to run tasks while it waits, or the pool would run out of workers.
+  constexpr u32 kOuterCount = 8;
+  constexpr u32 kInnerCount = 16;
+  TaskPool pool(2);
+  std::vector<std::vector<u32>> results(kOuterCount);
+  TaskGraph outer;
+  for (u32 i = 0; i < kOuterCount; i++) {
+    outer.add([&pool, &results, i]() {
+      TaskGraph inner;
+      buildLayers(inner, results[i], 2, kInnerCount);
+      inner.run(pool);
+    });
+  }
+  outer.run(pool);
+
+  std::vector<u32> expected;
+  TaskGraph serial;
+  buildLayers(serial, expected, 2, kInnerCount);
+  serial.runSerial();
+  for (const std::vector<u32> &result : results) {
+    CHECK(result == expected);
+  }
+}
+
+} // namespace wind
@@ -0,0 +1,132 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/sim/wind_atlas.hpp>
+#include <shared/sim/wind_sim.hpp>
+
+#include <cmath>
+#include <filesystem>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+/// Check that two vectors are equal up to a relative tolerance
+static void testAtlasCheck(const Vec3F &a, const Vec3F &b) {
+  CHECK(a.x == doctest::Approx(b.x).epsilon(1e-4));
+  CHECK(a.y == doctest::Approx(b.y).epsilon(1e-4));
+  CHECK(a.z == doctest::Approx(b.z).epsilon(1e-4));
+}
+
+// -------------------------------------------------------------------------- //
+
+TEST_CASE("Wind atlas") {
+  constexpr f32 kStrength = 2.0f;
+  WindSimulation sim(10, 4, 10, 0.5f);
+  for (s32 y = 1; y < 3; y++) {
+    sim.O().get(4, y, 5) = true;
+  }
+  WindAtlas atlas;
+  atlas.build(sim, 4, kStrength, 1.0f / 30.0f);
+  REQUIRE_EQ(atlas.getEntryCount(), 4u);
+
+  const FieldBase::Dim &dim = atlas.getDim();
+  const u32 cells[][3] = {{1, 1, 1}, {3, 2, 7}, {6, 1, 4}, {10, 4, 10}};
+
+  SUBCASE("Blend") {
+    // Halfway between two directions the entries are averaged
+    const Vec3F dir0 = atlas.getDirection(0);
+    const Vec3F dir1 = atlas.getDirection(1);
+    Vec3F e0[4];
+    Vec3F e1[4];
+    atlas.setWind(dir0, kStrength);
+    for (u32 i = 0; i < 4; i++) {
+      e0[i] = atlas.sampleCell(cells[i][0], cells[i][1], cells[i][2]);
+    }
+    atlas.setWind(dir1, kStrength);
+    for (u32 i = 0; i < 4; i++) {
+      e1[i] = atlas.sampleCell(cells[i][0], cells[i][1], cells[i][2]);
+    }
+    CHECK_GT(e0[1].length(), 0.1f);
+    CHECK_GT(e1[1].length(), 0.1f);
+
+    atlas.setWind(Vec3F::normalize(dir0 + dir1), kStrength);
+    for (u32 i = 0; i < 4; i++) {
+      CAPTURE(i);
+      testAtlasCheck(atlas.sampleCell(cells[i][0], cells[i][1], cells[i][2]),
+                     (e0[i] + e1[i]) * 0.5f);
+    }
+
+    // The wind scales with the strength
+    atlas.setWind(dir0, kStrength * 3.0f);
+    for (u32 i = 0; i < 4; i++) {
+      CAPTURE(i);
+      testAtlasCheck(atlas.sampleCell(cells[i][0], cells[i][1], cells[i][2]),
+                     e0[i] * 3.0f);
+    }
+  }
+
+  SUBCASE("Sample") {
+    // World samples at cell centers match the cells
+    const Vec3F origin(-4.0f, 1.0f, 2.5f);
+    const f32 cellSize = 0.5f;
+    atlas.setOrigin(origin);
+    atlas.setWind(Vec3F::normalize(Vec3F(1.0f, 0.0f, 1.0f)), kStrength);
+    for (u32 i = 0; i < 4; i++) {
+      CAPTURE(i);
+      const Vec3F point =
+          origin + Vec3F(cells[i][0] - 0.5f, cells[i][1] - 0.5f,
+                         cells[i][2] - 0.5f) *
+                       cellSize;
+      testAtlasCheck(atlas.sampleWorld(point),
+                     atlas.sampleCell(cells[i][0], cells[i][1], cells[i][2]));
+    }
+    const Vec3F outside = atlas.sampleWorld(
+        origin + Vec3F(f32(dim.width), 1.0f, 1.0f) * cellSize);
+    CHECK_EQ(outside.x, 0.0f);
+    CHECK_EQ(outside.y, 0.0f);
+    CHECK_EQ(outside.z, 0.0f);
+  }
+
+  SUBCASE("Save and load") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "wind.atlas").string();
+    REQUIRE(atlas.save(path));
+    WindAtlas loaded;
+    REQUIRE(loaded.load(path));
+    CHECK_EQ(loaded.getEntryCount(), atlas.getEntryCount());
+    const Vec3F direction = Vec3F::normalize(Vec3F(-1.0f, 0.0f, 0.3f));
+    atlas.setWind(direction, kStrength);
+    loaded.setWind(direction, kStrength);
+    for (u32 i = 0; i < 4; i++) {
+      CAPTURE(i);
+      testAtlasCheck(loaded.sampleCell(cells[i][0], cells[i][1], cells[i][2]),
+                     atlas.sampleCell(cells[i][0], cells[i][1], cells[i][2]));
+    }
+  }
+}
+
+} // namespace wind
@@ -0,0 +1,82 @@
+// MIT License
+//
+// Copyright (c) 2020 Filip Bjrklund, Christoffer Gustafsson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "doctest/doctest.h"
+
+#include <shared/sim/vector_field.hpp>
+#include <shared/sim/wind_history.hpp>
+#include <shared/sim/wind_sim.hpp>
+#include <shared/sim/wind_snapshots.hpp>
+
+// ========================================================================== //
+// Tests
+// ========================================================================== //
+
+namespace wind {
+
+TEST_CASE("Wind history") {
+  constexpr f32 kStepDelta = 0.5f;
+  WindSimulation sim(8, 4, 8, 0.5f);
+  sim.setDomainCondition(DomainBoundary::kMinX, DomainCondition::kInflow,
+                         Vec3F(2.0f, 0.0f, 0.0f));
+  sim.setDomainCondition(DomainBoundary::kMaxX, DomainCondition::kOutflow);
+  WindSnapshots snapshots(sim.V().getDim(), sim.getCellSize());
+  const Vec3F origin(3.0f, 0.0f, -1.0f);
+  WindHistory history(&sim, &snapshots, origin, kStepDelta);
+
+  // Queries at the center of a cell return that cell
+  const s32 x = 2;
+  const s32 y = 2;
+  const s32 z = 4;
+  const Vec3F point =
+      origin + Vec3F(x - 0.5f, y - 0.5f, z - 0.5f) * sim.getCellSize();
+  const Vec3F v0 = sim.V().get(x, y, z);
+  Vec3F sample = snapshots.sample(point);
+  CHECK(sample.x == doctest::Approx(v0.x));
+
+  // Less than a step does not step the simulation
+  history.update(0.25f);
+  CHECK_EQ(sim.V().get(x, y, z).x, v0.x);
+
+  // The wind lags one step behind the simulation and is blended in time
+  history.update(0.25f);
+  const Vec3F v1 = sim.V().get(x, y, z);
+  CHECK_NE(v1.x, v0.x);
+  CHECK_EQ(history.getTime(), 0.0f);
+  sample = snapshots.sample(point);
+  CHECK(sample.x == doctest::Approx(v0.x));
+  history.update(0.25f);
+  sample = snapshots.sample(point);
+  CHECK(sample.x == doctest::Approx((v0.x + v1.x) * 0.5f));
+  CHECK(sample.z == doctest::Approx((v0.z + v1.z) * 0.5f));
+  history.update(0.25f);
+  sample = snapshots.sample(point);
+  CHECK(sample.x == doctest::Approx(v1.x));
+
+  // Without times only the latest snapshot is sampled
+  snapshots.publish(sim.V(), origin);
+  snapshots.publish(sim.V(), origin);
+  sample = snapshots.sample(point, -10.0f);
+  CHECK(sample.x == doctest::Approx(sim.V().get(x, y, z).x));
+}
+
+} // namespace wind